@@ -1,14 +1,39 @@
 #version 410
 
-uniform mat4 matrix;
-uniform mat4 perspective;
-uniform mat3 normalMatrix;
+// Camera, light and material of the frame, shared by all the programs
+layout(std140) uniform FrameParameters {
+    mat4 matrix;
+    mat4 perspective;
+    mat4 lightMatrix;
+    mat4 mat_inverse;
+    mat4 persp_inverse;
+    mat3 normalMatrix;
+    vec3 lightPosition;
+    float lightIntensity;
+    vec3 center;
+    float radius;
+    float shininess;
+    float eta;
+    float kr;
+    int bouncesNb;
+    bool blinnPhong;
+    bool transparent;
+};
+
 uniform bool noColor;
 
 in vec4 vertex;
+// Positions quantized over the bounding box of the mesh : bias + scale * vertex
+uniform vec3 positionBias = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
 in vec4 normal;
 in vec4 color;
 
+// Joint whose weights color the mesh, none if negative
+uniform int weightJoint = -1;
+in vec4 skinJoints;
+in vec4 skinWeights;
+
 out vec4 vertColor;
 out vec4 vertNormal;
 
@@ -16,7 +41,13 @@ void main( void )
 {
     if (noColor) vertColor = vec4(0.4, 0.2, 0.6, 1.0);
     else vertColor = color;
+    if (weightJoint >= 0) {
+        // Heat map of its weight, black to red to yellow
+        float w = dot(skinWeights, vec4(equal(skinJoints, vec4(weightJoint))));
+        vertColor = vec4(clamp(vec3(2.0 * w, 2.0 * w - 1.0, 0.0), 0.0, 1.0), 1.0);
+    }
     vertNormal.xyz = normalize(normalMatrix * normal.xyz);
     vertNormal.w = 0.0;
-    gl_Position = perspective * matrix * vertex;
+    vec4 position = vec4(positionBias + positionScale * vertex.xyz, 1.0);
+    gl_Position = perspective * matrix * position;
 }
@@ -1,10 +1,26 @@
 #version 410
 
-uniform float lightIntensity;
+// Camera, light and material of the frame, shared by all the programs
+layout(std140) uniform FrameParameters {
+    mat4 matrix;
+    mat4 perspective;
+    mat4 lightMatrix;
+    mat4 mat_inverse;
+    mat4 persp_inverse;
+    mat3 normalMatrix;
+    vec3 lightPosition;
+    float lightIntensity;
+    vec3 center;
+    float radius;
+    float shininess;
+    float eta;
+    float kr;
+    int bouncesNb;
+    bool blinnPhong;
+    bool transparent;
+};
+
 uniform sampler2D colorTexture;
-uniform bool blinnPhong;
-uniform float shininess;
-uniform float eta;
 uniform float k_a;		//ambient reflection coefficient 
 uniform float k_d = 0.7;		//diffuse reflection coefficient 
 uniform sampler2D shadowMap;
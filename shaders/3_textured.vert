@@ -1,18 +1,47 @@
 #version 410
 
-uniform mat4 matrix;
-uniform mat4 perspective;
-uniform mat3 normalMatrix;
+// Camera, light and material of the frame, shared by all the programs
+layout(std140) uniform FrameParameters {
+    mat4 matrix;
+    mat4 perspective;
+    mat4 lightMatrix;
+    mat4 mat_inverse;
+    mat4 persp_inverse;
+    mat3 normalMatrix;
+    vec3 lightPosition;
+    float lightIntensity;
+    vec3 center;
+    float radius;
+    float shininess;
+    float eta;
+    float kr;
+    int bouncesNb;
+    bool blinnPhong;
+    bool transparent;
+};
+
 uniform bool noColor;
-uniform vec3 lightPosition;
-uniform float radius;
 uniform mat4 worldToLightspace;
 
 in vec4 vertex;
+// Positions quantized over the bounding box of the mesh : bias + scale * vertex
+uniform vec3 positionBias = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
 in vec4 normal;
 in vec4 color;
 in vec2 texcoords;
 
+// Skinning on the GPU : matrices of the joints of the current pose, taking a
+// vertex from the bind pose to the pose, weighted by the 4 heaviest joints
+layout(std140) uniform JointPalette {
+    mat4 jointMatrix[256];
+};
+uniform bool skinning;
+in vec4 skinJoints;
+in vec4 skinWeights;
+// Joint whose weights color the mesh, none if negative
+uniform int weightJoint = -1;
+
 out vec4 eyeVector;
 out vec4 lightVector;
 out vec4 lightSpace;
@@ -22,22 +51,38 @@ out vec2 textCoords;
 
 void main( void )
 {
+    vec4 position = vec4(positionBias + positionScale * vertex.xyz, 1.0);
+    vec3 objectNormal = normal.xyz;
+    if (skinning) {
+        mat4 skin = skinWeights.x * jointMatrix[int(skinJoints.x)]
+                  + skinWeights.y * jointMatrix[int(skinJoints.y)]
+                  + skinWeights.z * jointMatrix[int(skinJoints.z)]
+                  + skinWeights.w * jointMatrix[int(skinJoints.w)];
+        position = vec4((skin * position).xyz, 1.0);
+        objectNormal = mat3(skin) * normal.xyz;
+    }
     if (noColor) vertColor = vec4(0.2, 0.6, 0.7, 1.0 );
     else vertColor = color;
-    vertNormal.xyz = normalize(normalMatrix * normal.xyz);
+    if (weightJoint >= 0) {
+        // Heat map of its weight, black to red to yellow
+        float w = dot(skinWeights, vec4(equal(skinJoints, vec4(weightJoint))));
+        vertColor = vec4(clamp(vec3(2.0 * w, 2.0 * w - 1.0, 0.0), 0.0, 1.0), 1.0);
+    }
+    vertNormal.xyz = normalize(normalMatrix * objectNormal);
     vertNormal.w = 0.0;
 
-    gl_Position = perspective * matrix * vertex;
+    gl_Position = perspective * matrix * position;
 	//TODO : compute L & V
     // From point to light
-	lightVector = -(matrix*(vertex - vec4(lightPosition, 1.0f)));
+	lightVector = -(matrix*(position - vec4(lightPosition, 1.0f)));
 	vec4 eyePosition = vec4(0.0f, 0.0f, 0.0f, 1.0f);
-	eyeVector = normalize(eyePosition - matrix*vertex);// in camera coordinate
+	eyeVector = normalize(eyePosition - matrix*position);// in camera coordinate
 
-    lightSpace = normalize(worldToLightspace * vertex);
+    lightSpace = normalize(worldToLightspace * position);
 
     //textCoords = texcoords;
-    textCoords = vec2(vertex[0]/(2*radius),vertex[2]/(2*radius));
+    vec3 objectPosition = positionBias + positionScale * vertex.xyz;
+    textCoords = vec2(objectPosition[0]/(2*radius),objectPosition[2]/(2*radius));
 
 
     //gl_Position = perspective * matrix * vertex;
@@ -51,7 +51,26 @@ THE SOFTWARE.
  * 3D simplex noise uses only permTexture.
  */
 uniform sampler2D permTexture;
-uniform float radius; // object size.
+
+// Camera, light and material of the frame, shared by all the programs
+layout(std140) uniform FrameParameters {
+    mat4 matrix;
+    mat4 perspective;
+    mat4 lightMatrix;
+    mat4 mat_inverse;
+    mat4 persp_inverse;
+    mat3 normalMatrix;
+    vec3 lightPosition;
+    float lightIntensity;
+    vec3 center;
+    float radius;
+    float shininess;
+    float eta;
+    float kr;
+    int bouncesNb;
+    bool blinnPhong;
+    bool transparent;
+};
 
 /*
  * Both 2D and 3D texture coordinates are defined, for testing purposes.
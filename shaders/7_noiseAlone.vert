@@ -1,12 +1,31 @@
 #version 410
 
-uniform mat4 matrix;
-uniform mat4 perspective;
-uniform mat3 normalMatrix;
+// Camera, light and material of the frame, shared by all the programs
+layout(std140) uniform FrameParameters {
+    mat4 matrix;
+    mat4 perspective;
+    mat4 lightMatrix;
+    mat4 mat_inverse;
+    mat4 persp_inverse;
+    mat3 normalMatrix;
+    vec3 lightPosition;
+    float lightIntensity;
+    vec3 center;
+    float radius;
+    float shininess;
+    float eta;
+    float kr;
+    int bouncesNb;
+    bool blinnPhong;
+    bool transparent;
+};
+
 uniform bool noColor;
-uniform vec3 lightPosition;
 
 in vec4 vertex;
+// Positions quantized over the bounding box of the mesh : bias + scale * vertex
+uniform vec3 positionBias = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
 in vec4 normal;
 in vec4 color;
 
@@ -20,13 +39,14 @@ void main( void )
 {
     if (noColor) vertColor = vec4(0.2, 0.6, 0.7, 1.0 );
     else vertColor = color;
-    vertPos = vertex;
-    vec4 vertPosition = matrix * vertex;
+    vec4 position = vec4(positionBias + positionScale * vertex.xyz, 1.0);
+    vertPos = position;
+    vec4 vertPosition = matrix * position;
     vec4 eyePosition = vec4(0.0, 0.0, 0.0, 1.0);
     eyeVector = normalize(eyePosition - vertPosition);
     lightVector = normalize(matrix * vec4(lightPosition, 1.0) - vertPosition);
     vertNormal.xyz = normalize(normalMatrix * normal.xyz);
     vertNormal.w = 0.0;
 
-    gl_Position = perspective * matrix * vertex;
+    gl_Position = perspective * matrix * position;
 }
@@ -2,15 +2,27 @@
 #define M_PI 3.14159265358979323846
 #define EPSILLON 0.0001
 
-uniform mat4 mat_inverse;
-uniform mat4 persp_inverse;
-uniform sampler2D envMap;
-uniform vec3 center;
-uniform float radius;
+// Camera, light and material of the frame, shared by all the programs
+layout(std140) uniform FrameParameters {
+    mat4 matrix;
+    mat4 perspective;
+    mat4 lightMatrix;
+    mat4 mat_inverse;
+    mat4 persp_inverse;
+    mat3 normalMatrix;
+    vec3 lightPosition;
+    float lightIntensity;
+    vec3 center;
+    float radius;
+    float shininess;
+    float eta;
+    float kr;
+    int bouncesNb;
+    bool blinnPhong;
+    bool transparent;
+};
 
-uniform bool transparent;
-uniform float shininess;
-uniform float eta;
+uniform sampler2D envMap;
 
 in vec4 position;
 
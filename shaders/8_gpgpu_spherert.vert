@@ -2,6 +2,9 @@
 
 // Standard parameters of a VAO
 in vec4 vertex;
+// Positions quantized over the bounding box of the mesh : bias + scale * vertex
+uniform vec3 positionBias = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
 in vec4 normal;
 in vec4 color;
 in vec2 texcoords;
@@ -18,6 +21,6 @@ void main( void )
     vertNormal = normal;
     textCoords = texcoords;
 
-    position = vertex;
-    gl_Position = vertex;
+    position = vec4(positionBias + positionScale * vertex.xyz, 1.0);
+    gl_Position = position;
 }
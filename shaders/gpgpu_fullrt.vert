@@ -2,6 +2,9 @@
 
 // Standard parameters of a VAO
 in vec4 vertex;
+// Positions quantized over the bounding box of the mesh : bias + scale * vertex
+uniform vec3 positionBias = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
 in vec4 normal;
 in vec4 color;
 in vec2 texcoords;
@@ -17,6 +20,7 @@ void main( void )
 	 * Compute texture coordinate by simply
 	 * interval-mapping from [-1..+1] to [0..1]
 	 */
-	textCoords = vertex.xy * 0.5 + vec2(0.5, 0.5);
-	gl_Position = vertex;
+	vec4 position = vec4(positionBias + positionScale * vertex.xyz, 1.0);
+	textCoords = position.xy * 0.5 + vec2(0.5, 0.5);
+	gl_Position = position;
 }
@@ -1,9 +1,21 @@
 #version 330 core
 
 in vec4 vertex;
+// Positions quantized over the bounding box of the mesh : bias + scale * vertex
+uniform vec3 positionBias = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
 in vec4 color;
 in vec4 normal;
 
+// Skinning on the GPU : matrices of the joints of the current pose, taking a
+// vertex from the bind pose to the pose, weighted by the 4 heaviest joints
+layout(std140) uniform JointPalette {
+    mat4 jointMatrix[256];
+};
+uniform bool skinning;
+in vec4 skinJoints;
+in vec4 skinWeights;
+
 // Values that stay constant for the whole mesh.
 uniform mat4 matrix;
 uniform mat4 perspective;
@@ -12,6 +24,14 @@ uniform mat4 perspective;
 void main(){
 	vec4 vertColor = color;
 	vec4 vertNormal = normal;
-	gl_Position = perspective * matrix * vertex;
+	vec4 position = vec4(positionBias + positionScale * vertex.xyz, 1.0);
+	if (skinning) {
+		mat4 skin = skinWeights.x * jointMatrix[int(skinJoints.x)]
+		          + skinWeights.y * jointMatrix[int(skinJoints.y)]
+		          + skinWeights.z * jointMatrix[int(skinJoints.z)]
+		          + skinWeights.w * jointMatrix[int(skinJoints.w)];
+		position = vec4((skin * position).xyz, 1.0);
+	}
+	gl_Position = perspective * matrix * position;
 }
 
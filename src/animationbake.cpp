@@ -0,0 +1,71 @@
+#include "animationbake.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const size_t kAlign = 64;
+
+inline size_t alignUp(size_t n) {
+	return (n + kAlign - 1) & ~(kAlign - 1);
+}
+
+inline size_t frameStride(int nbJoints) {
+	return alignUp(nbJoints * (sizeof(glm::mat4) + sizeof(trimesh::point)));
+}
+
+}
+
+AnimationBake::AnimationBake() : _nbJoints(0), _nbFrames(0), _frameStride(0), _data(NULL) {
+}
+
+AnimationBake::~AnimationBake() {
+	clear();
+}
+
+size_t AnimationBake::bytesFor(int nbJoints, int nbFrames) {
+	return (size_t)nbFrames * frameStride(nbJoints);
+}
+
+bool AnimationBake::bake(const Skeleton & skeleton, size_t maxBytes) {
+	clear();
+	int nbJoints = skeleton.nbJoints();
+	int nbFrames = skeleton.nbFrames();
+	size_t size = bytesFor(nbJoints, nbFrames);
+	if (size == 0 || size > maxBytes) return false;
+
+	_data = static_cast<unsigned char*>(aligned_alloc(kAlign, size));
+	if (_data == NULL) return false;
+	_nbJoints = nbJoints;
+	_nbFrames = nbFrames;
+	_frameStride = frameStride(nbJoints);
+
+	// Frames are independent
+	#pragma omp parallel for schedule(static)
+	for (int f = 0; f < nbFrames; f++) {
+		skeleton.evaluateFrame(f, const_cast<trimesh::point*>(positions(f)), const_cast<glm::mat4*>(matrices(f)));
+	}
+	return true;
+}
+
+void AnimationBake::clear() {
+	free(_data);
+	_data = NULL;
+	_nbJoints = 0;
+	_nbFrames = 0;
+	_frameStride = 0;
+}
+
+const glm::mat4* AnimationBake::matrices(int iframe) const {
+	return reinterpret_cast<const glm::mat4*>(_data + iframe * _frameStride);
+}
+
+const trimesh::point* AnimationBake::positions(int iframe) const {
+	return reinterpret_cast<const trimesh::point*>(_data + iframe * _frameStride + _nbJoints * sizeof(glm::mat4));
+}
+
+void AnimationBake::fetch(int iframe, std::vector<trimesh::point> & positions, std::vector<glm::mat4> & transMatrix) const {
+	memcpy(&transMatrix[0], matrices(iframe), _nbJoints * sizeof(glm::mat4));
+	memcpy(&positions[0], this->positions(iframe), _nbJoints * sizeof(trimesh::point));
+}
@@ -0,0 +1,46 @@
+#ifndef _ANIMATIONBAKE_H_
+#define _ANIMATIONBAKE_H_
+
+#include "skeleton.h"
+
+// World matrices and joint positions of every frame of an animation,
+// computed once so that playback and scrubbing are table lookups.
+// All frames live in one aligned buffer, frame after frame :
+//   nbJoints x glm::mat4, then nbJoints x trimesh::point
+// so that one frame is a contiguous read.
+// When the tables would exceed the memory cap nothing is baked and the
+// caller keeps evaluating the skeleton live.
+class AnimationBake {
+public :
+	static const size_t kDefaultMaxBytes = 64 << 20;
+
+	AnimationBake();
+	~AnimationBake();
+
+	// Evaluates every frame in parallel. Returns false (and holds nothing) when
+	// the skeleton has no motion or the tables need more than maxBytes.
+	bool bake(const Skeleton & skeleton, size_t maxBytes = kDefaultMaxBytes);
+	void clear();
+
+	bool isBaked() const { return _data != NULL; }
+	int nbFrames() const { return _nbFrames; }
+	int nbJoints() const { return _nbJoints; }
+	size_t bytes() const { return (size_t)_nbFrames * _frameStride; }
+	static size_t bytesFor(int nbJoints, int nbFrames);
+
+	const glm::mat4* matrices(int iframe) const;
+	const trimesh::point* positions(int iframe) const;
+	// Copies frame iframe into the arrays used by the viewer
+	void fetch(int iframe, std::vector<trimesh::point> & positions, std::vector<glm::mat4> & transMatrix) const;
+
+private :
+	AnimationBake(const AnimationBake &);
+	AnimationBake & operator=(const AnimationBake &);
+
+	int _nbJoints;
+	int _nbFrames;
+	size_t _frameStride;				// bytes per frame
+	unsigned char* _data;
+};
+
+#endif
@@ -0,0 +1,1291 @@
+#include "benchmark.h"
+#include "joint.h"
+#include "bvhloader.h"
+#include "skeleton.h"
+#include "bvhcache.h"
+#include "animationbake.h"
+#include "crowd.h"
+#include "compressedmotion.h"
+#include "skininfluences.h"
+#include "skinningengine.h"
+#include "vertexcache.h"
+#include "weightfile.h"
+#include "skinlod.h"
+#include "skinbinding.h"
+#include "vertexorder.h"
+#include "vertexformat.h"
+#include "triangleorder.h"
+#include "TriMesh.h"
+
+#include <QDir>
+#include <QStringList>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <fstream>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+// Swallows what the loaders print while they are timed
+struct QuietOutput {
+	std::streambuf* savedOut;
+	std::streambuf* savedErr;
+	QuietOutput() : savedOut(std::cout.rdbuf(NULL)), savedErr(std::cerr.rdbuf(NULL)) {};
+	~QuietOutput() {
+		std::cout.rdbuf(savedOut);
+		std::cerr.rdbuf(savedErr);
+	}
+};
+
+// Largest difference between the animation curves of two trees
+double maxCurveDifference(const Joint* a, const Joint* b) {
+	if (a->_dofs.size() != b->_dofs.size() || a->_children.size() != b->_children.size()) return INFINITY;
+	double diff = 0;
+	for (unsigned int i = 0; i < a->_dofs.size(); i++) {
+		const std::vector<double> & va = a->_dofs[i]._values;
+		const std::vector<double> & vb = b->_dofs[i]._values;
+		if (va.size() != vb.size()) return INFINITY;
+		for (unsigned int f = 0; f < va.size(); f++) diff = std::max(diff, std::fabs(va[f] - vb[f]));
+	}
+	for (unsigned int i = 0; i < a->_children.size(); i++) {
+		diff = std::max(diff, maxCurveDifference(a->_children[i], b->_children[i]));
+	}
+	return diff;
+}
+
+void benchmarkBvhLoaders(const QStringList & files) {
+	std::cout << "== BVH loading (ms, best of 5) ==" << std::endl;
+	std::cout << std::setw(32) << std::left << "file" << std::right
+	          << std::setw(10) << "ifstream" << std::setw(10) << "mmap" << std::setw(10) << "speedup"
+	          << std::setw(12) << "max diff" << std::endl;
+	for (const QString & file : files) {
+		std::string fileName = file.toStdString();
+		int nbJoints, nbIndices, nbFrames;
+		double frameTime;
+		double legacyMs, mappedMs, diff;
+		{
+			QuietOutput quiet;
+			legacyMs = bestTimeMs([&]() {
+				delete Joint::createFromFile(fileName, nbJoints, nbIndices, nbFrames, frameTime);
+			});
+			mappedMs = bestTimeMs([&]() {
+				delete BvhLoader::load(fileName, nbJoints, nbIndices, nbFrames, frameTime);
+			});
+			Joint* legacy = Joint::createFromFile(fileName, nbJoints, nbIndices, nbFrames, frameTime);
+			Joint* mapped = BvhLoader::load(fileName, nbJoints, nbIndices, nbFrames, frameTime);
+			diff = maxCurveDifference(legacy, mapped);
+			delete legacy;
+			delete mapped;
+		}
+		std::cout << std::setw(32) << std::left << QFileInfo(file).fileName().toStdString() << std::right << std::fixed
+		          << std::setprecision(3) << std::setw(10) << legacyMs << std::setw(10) << mappedMs
+		          << std::setprecision(1) << std::setw(9) << legacyMs / mappedMs << "x"
+		          << std::scientific << std::setprecision(1) << std::setw(12) << diff << std::defaultfloat << std::endl;
+	}
+}
+
+// Joints of a tree in depth-first order, i.e. in Skeleton order
+void flatten(Joint* j, std::vector<Joint*> & joints) {
+	joints.push_back(j);
+	for (Joint* child : j->_children) flatten(child, joints);
+}
+
+void benchmarkAnimate(const QStringList & files) {
+	const int passes = 20;
+	std::cout << "== Frame sampling, " << passes << " passes over the clip (us per frame) ==" << std::endl;
+	std::cout << std::setw(32) << std::left << "file" << std::right
+	          << std::setw(12) << "Joint tree" << std::setw(12) << "Skeleton" << std::setw(10) << "speedup"
+	          << std::setw(12) << "max diff" << std::endl;
+	for (const QString & file : files) {
+		std::string fileName = file.toStdString();
+		int nbJoints, nbIndices, nbFrames;
+		double frameTime;
+		Joint* tree;
+		Skeleton* skeleton;
+		{
+			QuietOutput quiet;
+			tree = BvhLoader::load(fileName, nbJoints, nbIndices, nbFrames, frameTime);
+			skeleton = BvhLoader::loadSkeleton(fileName);
+		}
+		if (tree == NULL || skeleton == NULL || nbFrames == 0) {
+			delete tree;
+			delete skeleton;
+			continue;
+		}
+		double treeMs = bestTimeMs([&]() {
+			for (int p = 0; p < passes; p++)
+				for (int f = 0; f < nbFrames; f++) tree->animate(f);
+		});
+		double flatMs = bestTimeMs([&]() {
+			for (int p = 0; p < passes; p++)
+				for (int f = 0; f < nbFrames; f++) skeleton->animate(f);
+		});
+
+		std::vector<Joint*> joints;
+		flatten(tree, joints);
+		double diff = 0;
+		for (int f = 0; f < nbFrames; f++) {
+			tree->animate(f);
+			skeleton->animate(f);
+			for (unsigned int j = 0; j < joints.size(); j++) {
+				const glm::vec3 & t = skeleton->translation(j);
+				const glm::vec3 & r = skeleton->rotation(j);
+				diff = std::max(diff, std::fabs(joints[j]->_curTx - t.x));
+				diff = std::max(diff, std::fabs(joints[j]->_curTy - t.y));
+				diff = std::max(diff, std::fabs(joints[j]->_curTz - t.z));
+				diff = std::max(diff, std::fabs(joints[j]->_curRx - r.x));
+				diff = std::max(diff, std::fabs(joints[j]->_curRy - r.y));
+				diff = std::max(diff, std::fabs(joints[j]->_curRz - r.z));
+			}
+		}
+		double perFrame = 1000.0 / (passes * nbFrames);
+		std::cout << std::setw(32) << std::left << QFileInfo(file).fileName().toStdString() << std::right << std::fixed
+		          << std::setprecision(3) << std::setw(12) << treeMs * perFrame << std::setw(12) << flatMs * perFrame
+		          << std::setprecision(1) << std::setw(9) << treeMs / flatMs << "x"
+		          << std::scientific << std::setprecision(1) << std::setw(12) << diff << std::defaultfloat << std::endl;
+		delete tree;
+		delete skeleton;
+	}
+}
+
+void benchmarkBvhCache(const QStringList & files) {
+	std::cout << "== Skeleton loading (ms, best of 5) ==" << std::endl;
+	std::cout << std::setw(32) << std::left << "file" << std::right
+	          << std::setw(10) << "text" << std::setw(10) << ".bvhc" << std::setw(10) << "speedup"
+	          << std::setw(12) << "max error" << std::endl;
+	for (const QString & file : files) {
+		std::string fileName = file.toStdString();
+		std::string cacheName = BvhCache::cacheFileName(fileName);
+		double textMs, cacheMs;
+		Skeleton* parsed;
+		Skeleton* cached;
+		{
+			QuietOutput quiet;
+			// Makes sure the cache exists and is up to date
+			delete BvhCache::load(fileName);
+			textMs = bestTimeMs([&]() { delete BvhLoader::loadSkeleton(fileName); });
+			cacheMs = bestTimeMs([&]() { delete BvhCache::read(cacheName); });
+			parsed = BvhLoader::loadSkeleton(fileName);
+			cached = BvhCache::read(cacheName);
+		}
+		if (parsed == NULL || cached == NULL) {
+			std::cout << QFileInfo(file).fileName().toStdString() << " : no cache" << std::endl;
+			delete parsed;
+			delete cached;
+			continue;
+		}
+		// Quantization error of the motion matrix
+		double error = 0;
+		for (unsigned int i = 0; i < parsed->_motion.size(); i++) {
+			error = std::max(error, (double)std::fabs(parsed->_motion[i] - cached->_motion[i]));
+		}
+		std::cout << std::setw(32) << std::left << QFileInfo(file).fileName().toStdString() << std::right << std::fixed
+		          << std::setprecision(3) << std::setw(10) << textMs << std::setw(10) << cacheMs
+		          << std::setprecision(1) << std::setw(9) << textMs / cacheMs << "x"
+		          << std::scientific << std::setprecision(1) << std::setw(12) << error << std::defaultfloat << std::endl;
+		delete parsed;
+		delete cached;
+	}
+}
+
+// World matrices of the current pose with one glm::rotate per axis, in the
+// rotation order of each joint (reference for the closed-form kernels)
+void glmPointPositions(const Skeleton & skeleton, std::vector<glm::mat4> & transMatrix) {
+	const float degToRad = glm::pi<float>() / 180;
+	const char* axisOrder[6] = {"XYZ", "YZX", "ZXY", "XZY", "YXZ", "ZYX"};	// by RotateOrder
+	const glm::vec3 axes[3] = {glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)};
+	for (int j = 0; j < skeleton.nbJoints(); j++) {
+		glm::mat4 local = glm::translate(glm::mat4(1.0), skeleton._offset[j] + skeleton.translation(j));
+		const char* order = axisOrder[skeleton._rotateOrder[j]];
+		for (int k = 0; k < 3; k++) {
+			int axis = order[k] - 'X';
+			local = glm::rotate(local, skeleton.rotation(j)[axis] * degToRad, axes[axis]);
+		}
+		transMatrix[j] = (skeleton._parent[j] < 0) ? local : transMatrix[skeleton._parent[j]] * local;
+	}
+}
+
+void benchmarkJointTransforms(const QStringList & files) {
+	const int passes = 20;
+	std::cout << "== Joint world matrices, " << passes << " passes over the clip (us per frame) ==" << std::endl;
+	std::cout << std::setw(32) << std::left << "file" << std::right
+	          << std::setw(10) << "glm" << std::setw(10) << "kernel" << std::setw(10) << "speedup"
+	          << std::setw(12) << "max diff" << std::setw(12) << "rotations" << std::endl;
+	for (const QString & file : files) {
+		std::string fileName = file.toStdString();
+		Skeleton* skeleton;
+		{
+			QuietOutput quiet;
+			skeleton = BvhLoader::loadSkeleton(fileName);
+		}
+		if (skeleton == NULL || skeleton->nbFrames() == 0) {
+			delete skeleton;
+			continue;
+		}
+		int nbJoints = skeleton->nbJoints();
+		int nbFrames = skeleton->nbFrames();
+		std::vector<trimesh::point> positions(nbJoints);
+		std::vector<glm::mat4> matrices(nbJoints);
+		std::vector<glm::mat4> reference(nbJoints);
+		double glmMs = bestTimeMs([&]() {
+			for (int p = 0; p < passes; p++)
+				for (int f = 0; f < nbFrames; f++) {
+					skeleton->animate(f);
+					glmPointPositions(*skeleton, reference);
+				}
+		});
+		double kernelMs = bestTimeMs([&]() {
+			for (int p = 0; p < passes; p++)
+				for (int f = 0; f < nbFrames; f++) {
+					skeleton->animate(f);
+					skeleton->computePointPositions(positions, matrices);
+				}
+		});
+
+		double diff = 0;
+		for (int f = 0; f < nbFrames; f++) {
+			skeleton->animate(f);
+			glmPointPositions(*skeleton, reference);
+			skeleton->computePointPositions(positions, matrices);
+			for (int j = 0; j < nbJoints; j++)
+				for (int c = 0; c < 4; c++)
+					for (int r = 0; r < 4; r++)
+						diff = std::max(diff, (double)std::fabs(reference[j][c][r] - matrices[j][c][r]));
+		}
+		double perFrame = 1000.0 / (passes * nbFrames);
+		std::cout << std::setw(32) << std::left << QFileInfo(file).fileName().toStdString() << std::right << std::fixed
+		          << std::setprecision(3) << std::setw(10) << glmMs * perFrame << std::setw(10) << kernelMs * perFrame
+		          << std::setprecision(1) << std::setw(9) << glmMs / kernelMs << "x"
+		          << std::scientific << std::setprecision(1) << std::setw(12) << diff << std::defaultfloat
+		          << std::setw(12) << (skeleton->uniformRotateOrder() >= 0 ? "batched" : "per joint") << std::endl;
+		delete skeleton;
+	}
+}
+
+void benchmarkIncrementalPose(const QStringList & files) {
+	const int passes = 20;
+	std::cout << "== Incremental pose evaluation, " << passes << " passes over the clip (us per frame) ==" << std::endl;
+	std::cout << std::setw(32) << std::left << "file" << std::right
+	          << std::setw(10) << "static" << std::setw(10) << "joints" << std::setw(10) << "composed" << std::setw(10) << "rotated"
+	          << std::setw(10) << "full" << std::setw(10) << "dirty" << std::setw(10) << "speedup" << std::endl;
+	for (const QString & file : files) {
+		std::string fileName = file.toStdString();
+		Skeleton* skeleton;
+		{
+			QuietOutput quiet;
+			skeleton = BvhLoader::loadSkeleton(fileName);
+		}
+		if (skeleton == NULL || skeleton->nbFrames() == 0) {
+			delete skeleton;
+			continue;
+		}
+		int nbJoints = skeleton->nbJoints();
+		int nbFrames = skeleton->nbFrames();
+		std::vector<trimesh::point> positions(nbJoints);
+		std::vector<glm::mat4> matrices(nbJoints);
+		// Every joint every frame, as before
+		double fullMs = bestTimeMs([&]() {
+			for (int p = 0; p < passes; p++)
+				for (int f = 0; f < nbFrames; f++) {
+					skeleton->animate(f);
+					skeleton->evaluateFrame(f, &positions[0], &matrices[0]);
+				}
+		});
+		double dirtyMs = bestTimeMs([&]() {
+			for (int p = 0; p < passes; p++)
+				for (int f = 0; f < nbFrames; f++) {
+					skeleton->animate(f);
+					skeleton->computePointPositions(positions, matrices);
+				}
+		});
+		skeleton->resetPoseStats();
+		for (int f = 0; f < nbFrames; f++) {
+			skeleton->animate(f);
+			skeleton->computePointPositions(positions, matrices);
+		}
+		const Skeleton::PoseStats & stats = skeleton->poseStats();
+		double perFrame = 1000.0 / (passes * nbFrames);
+		std::cout << std::setw(32) << std::left << QFileInfo(file).fileName().toStdString() << std::right << std::fixed
+		          << std::setw(5) << skeleton->nbStaticChannels() << "/" << std::setw(4) << skeleton->nbChannels()
+		          << std::setw(5) << skeleton->nbStaticJoints() << "/" << std::setw(4) << nbJoints
+		          << std::setprecision(1) << std::setw(9) << 100.0 * stats.evaluated / stats.joints << "%"
+		          << std::setw(9) << 100.0 * stats.rotations / stats.joints << "%"
+		          << std::setprecision(3) << std::setw(10) << fullMs * perFrame << std::setw(10) << dirtyMs * perFrame
+		          << std::setprecision(1) << std::setw(9) << fullMs / dirtyMs << "x" << std::defaultfloat << std::endl;
+		delete skeleton;
+	}
+}
+
+// skin.off with walk1.bvh and weights.txt, bound as in glShaderWindow
+struct SkinScene {
+	trimesh::TriMesh* mesh;
+	Skeleton* skeleton;
+	std::vector<trimesh::point> bindJoints;
+	std::vector<std::vector<double> > weights;	// weights[joint][vertex], as glShaderWindow used to keep them
+	SkinInfluences skin;
+
+	SkinScene() : mesh(NULL), skeleton(NULL) {};
+	~SkinScene() {
+		delete mesh;
+		delete skeleton;
+	}
+
+	bool load(const std::string & modelsPath) {
+		std::string animationPath = modelsPath + "../animation/";
+		{
+			QuietOutput quiet;
+			mesh = trimesh::TriMesh::read((modelsPath + "skin.off").c_str());
+			skeleton = BvhLoader::loadSkeleton(animationPath + "walk1.bvh");
+		}
+		if (mesh == NULL || skeleton == NULL) return false;
+		int nbJoints = skeleton->nbJoints();
+		int nbVertices = mesh->vertices.size();
+
+		trimesh::point center(0, 0, 0, 1);
+		for (int v = 0; v < nbVertices; v++) center += mesh->vertices[v];
+		center /= nbVertices;
+		bindJoints.resize(nbJoints);
+		skeleton->initPointPositions(bindJoints, center);
+
+		// Header line with the joint names, then "vertex w0 .. wn" per line
+		weights.assign(nbJoints, std::vector<double>(nbVertices, 0.0));
+		std::ifstream in((animationPath + "weights.txt").c_str());
+		std::string buf;
+		for (int i = 0; i <= nbJoints && in >> buf; i++) {}
+		int v;
+		while (in >> v) {
+			for (int j = 0; j < nbJoints; j++) {
+				double w = 0;
+				in >> w;
+				if (v >= 0 && v < nbVertices) weights[j][v] = w;
+			}
+		}
+
+		skin.reset(nbVertices);
+		std::vector<int> joints(nbJoints);
+		std::vector<float> row(nbJoints);
+		for (int v = 0; v < nbVertices; v++) {
+			for (int j = 0; j < nbJoints; j++) {
+				joints[j] = j;
+				row[j] = weights[j][v];
+			}
+			skin.setVertex(v, &joints[0], &row[0], nbJoints);
+		}
+		skin.bind(mesh->vertices, bindJoints);
+		return true;
+	}
+};
+
+// Dense weights and per-vertex influence vectors, as in glShaderWindow
+// before the packed layout
+struct LegacyInfluence {
+	int joint_id;
+	trimesh::point translation;
+};
+
+void benchmarkSkinLayout(const std::string & modelsPath) {
+	SkinScene scene;
+	if (!scene.load(modelsPath)) {
+		std::cout << "== Skin layout : skin.off / walk1.bvh not found ==" << std::endl;
+		return;
+	}
+	int nbJoints = scene.skeleton->nbJoints();
+	int nbVertices = scene.mesh->vertices.size();
+	int nbFrames = scene.skeleton->nbFrames();
+	std::vector<std::vector<LegacyInfluence> > legacy(nbVertices);
+	size_t legacyBytes = sizeof(scene.weights) + nbJoints * (sizeof(std::vector<double>) + nbVertices * sizeof(double))
+	                   + sizeof(legacy) + nbVertices * sizeof(std::vector<LegacyInfluence>);
+	for (int v = 0; v < nbVertices; v++) {
+		for (int j = 0; j < nbJoints; j++) {
+			if (scene.weights[j][v] >= 0.00001) {
+				LegacyInfluence influence = {j, scene.mesh->vertices[v] - scene.bindJoints[j]};
+				legacy[v].push_back(influence);
+			}
+		}
+		legacyBytes += legacy[v].capacity() * sizeof(LegacyInfluence);
+	}
+
+	AnimationBake bake;
+	bake.bake(*scene.skeleton);
+	std::vector<trimesh::point> positions(nbJoints);
+	std::vector<glm::mat4> matrices(nbJoints);
+	std::vector<trimesh::point> dense(nbVertices), packed(nbVertices);
+	auto legacySkin = [&]() {
+		for (int v = 0; v < nbVertices; v++) {
+			trimesh::point p(0, 0, 0, 1);
+			for (const LegacyInfluence & influence : legacy[v]) {
+				int j = influence.joint_id;
+				trimesh::point pj = positions[j] + trimesh::point(matrices[j] * glm::vec4(influence.translation[0], influence.translation[1], influence.translation[2], 0));
+				pj[3] = 1;
+				p += (float)scene.weights[j][v] * pj;
+			}
+			dense[v] = p;
+			dense[v][3] = 1;
+		}
+	};
+	auto packedSkin = [&]() {
+		for (int v = 0; v < nbVertices; v++) packed[v] = trimesh::point(scene.skin.skin(v, &matrices[0]));
+	};
+
+	double legacyMs = 0, packedMs = 0, diff = 0;
+	for (int f = 0; f < nbFrames; f++) {
+		bake.fetch(f, positions, matrices);
+		legacyMs += bestTimeMs(legacySkin, 3);
+		packedMs += bestTimeMs(packedSkin, 3);
+		for (int v = 0; v < nbVertices; v++) {
+			for (int k = 0; k < 3; k++) diff = std::max(diff, (double)std::fabs(dense[v][k] - packed[v][k]));
+		}
+	}
+
+	std::cout << "== Skin layout, skin.off (" << nbVertices << " vertices, up to " << scene.skin.width()
+	          << " influences) on walk1.bvh (us per skinning, 1 thread) ==" << std::endl;
+	std::cout << std::setw(24) << std::left << "layout" << std::right << std::setw(10) << "KB"
+	          << std::setw(10) << "us" << std::setw(12) << "max diff" << std::endl;
+	std::cout << std::setw(24) << std::left << "dense + per vertex" << std::right << std::fixed << std::setprecision(1)
+	          << std::setw(10) << legacyBytes / 1024.0 << std::setw(10) << 1000 * legacyMs / nbFrames << std::endl;
+	std::cout << std::setw(24) << std::left << "packed influences" << std::right
+	          << std::setw(10) << scene.skin.bytes() / 1024.0 << std::setw(10) << 1000 * packedMs / nbFrames
+	          << std::scientific << std::setprecision(1) << std::setw(12) << diff << std::defaultfloat << std::endl;
+}
+
+// Every vertex bound to its nbInfluences nearest joints, weights inversely
+// proportional to the distance
+void bindNearestJoints(const std::vector<trimesh::point> & vertices, const std::vector<trimesh::point> & joints,
+                       int nbInfluences, SkinInfluences & skin) {
+	skin.reset(vertices.size());
+	std::vector<std::pair<float, int> > nearest(joints.size());
+	int joint[kMaxInfluences];
+	float weight[kMaxInfluences];
+	for (unsigned int v = 0; v < vertices.size(); v++) {
+		for (unsigned int j = 0; j < joints.size(); j++) nearest[j] = std::make_pair(trimesh::dist(vertices[v], joints[j]), (int)j);
+		int n = std::min(nbInfluences, (int)joints.size());
+		std::partial_sort(nearest.begin(), nearest.begin() + n, nearest.end());
+		float total = 0;
+		for (int i = 0; i < n; i++) {
+			joint[i] = nearest[i].second;
+			weight[i] = 1.0f / (nearest[i].first + 1e-3f);
+			total += weight[i];
+		}
+		for (int i = 0; i < n; i++) weight[i] /= total;
+		skin.setVertex(v, joint, weight, n);
+	}
+	skin.bind(vertices, joints);
+}
+
+void benchmarkSkinningEngine(const std::string & modelsPath) {
+	SkinScene scene;
+	if (!scene.load(modelsPath)) {
+		std::cout << "== Skinning engine : skin.off / walk1.bvh not found ==" << std::endl;
+		return;
+	}
+	Skeleton & skeleton = *scene.skeleton;
+	int nbJoints = skeleton.nbJoints();
+	AnimationBake bake;
+	bake.bake(skeleton);
+	const int frames = std::min(20, skeleton.nbFrames());
+	int threads = 1;
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+
+	std::cout << "== Skinning engine (" << SkinningEngine::instructionSet() << ", " << threads
+	          << " threads) on walk1.bvh, 4 nearest joints but skin.off (us per skinning) ==" << std::endl;
+	std::cout << std::setw(20) << std::left << "model" << std::right << std::setw(10) << "vertices" << std::setw(7) << "width"
+	          << std::setw(10) << "scalar" << std::setw(10) << "kernel" << std::setw(10) << "threads"
+	          << std::setw(8) << "simd" << std::setw(10) << "scaling" << std::setw(12) << "max diff" << std::endl;
+
+	QDir modelsDir(QString::fromStdString(modelsPath));
+	QStringList models("skin.off");
+	for (const QString & name : modelsDir.entryList(QStringList("*.ply"), QDir::Files | QDir::Readable, QDir::Name)) models << name;
+	for (const QString & name : models) {
+		trimesh::TriMesh* mesh = NULL;
+		SkinInfluences bound;
+		const SkinInfluences* skin = &scene.skin;
+		if (name.toStdString() != "skin.off") {
+			{
+				QuietOutput quiet;
+				mesh = trimesh::TriMesh::read(modelsDir.filePath(name).toStdString().c_str());
+			}
+			if (mesh == NULL) continue;
+			int nbVertices = mesh->vertices.size();
+			trimesh::point center(0, 0, 0, 1);
+			for (int v = 0; v < nbVertices; v++) center += mesh->vertices[v];
+			center /= nbVertices;
+			std::vector<trimesh::point> joints(nbJoints);
+			skeleton.initPointPositions(joints, center);
+			bindNearestJoints(mesh->vertices, joints, kMaxInfluences, bound);
+			skin = &bound;
+		}
+		int nbVertices = skin->nbVertices();
+		std::vector<trimesh::point> reference(nbVertices), out(nbVertices);
+		SkinningEngine engine;
+
+		double scalarMs = 0, kernelMs = 0, threadsMs = 0, diff = 0;
+		for (int f = 0; f < frames; f++) {
+			const glm::mat4* matrices = bake.matrices(f);
+			engine.setPose(matrices, nbJoints);
+			scalarMs += bestTimeMs([&]() {
+				for (int v = 0; v < nbVertices; v++) reference[v] = trimesh::point(skin->skin(v, matrices));
+			}, 3);
+#ifdef _OPENMP
+			omp_set_num_threads(1);
+#endif
+			kernelMs += bestTimeMs([&]() { engine.skin(*skin, &out[0]); }, 3);
+#ifdef _OPENMP
+			omp_set_num_threads(threads);
+#endif
+			threadsMs += bestTimeMs([&]() { engine.skin(*skin, &out[0]); }, 3);
+			for (int v = 0; v < nbVertices; v++) {
+				for (int k = 0; k < 4; k++) diff = std::max(diff, (double)std::fabs(reference[v][k] - out[v][k]));
+			}
+		}
+		std::cout << std::setw(20) << std::left << name.toStdString() << std::right << std::setw(10) << nbVertices
+		          << std::setw(7) << skin->width() << std::fixed << std::setprecision(1)
+		          << std::setw(10) << 1000 * scalarMs / frames << std::setw(10) << 1000 * kernelMs / frames
+		          << std::setw(10) << 1000 * threadsMs / frames
+		          << std::setw(7) << scalarMs / kernelMs << "x" << std::setw(9) << kernelMs / threadsMs << "x"
+		          << std::scientific << std::setprecision(1) << std::setw(12) << diff << std::defaultfloat << std::endl;
+		delete mesh;
+	}
+}
+
+// Largest weight difference between two skins of the same mesh
+double maxWeightDifference(const SkinInfluences & a, const SkinInfluences & b, int nbJoints) {
+	if (a.nbVertices() != b.nbVertices()) return INFINITY;
+	double diff = 0;
+	for (int v = 0; v < a.nbVertices(); v++) {
+		for (int j = 0; j < nbJoints; j++) diff = std::max(diff, (double)std::fabs(a.weight(v, j) - b.weight(v, j)));
+	}
+	return diff;
+}
+
+void benchmarkWeightFiles(const std::string & modelsPath) {
+	std::string animationPath = modelsPath + "../animation/";
+	std::string dense = animationPath + "weights.txt";
+	SkinWeights weights;
+	if (!WeightFile::read(dense, weights)) {
+		std::cout << "== Weight files : weights.txt not found ==" << std::endl;
+		return;
+	}
+	int nbJoints = weights.nbJoints();
+	int nbVertices = weights.nbVertices();
+	std::string sparse = animationPath + "weights.bench.sparse.txt";
+	std::string binary = animationPath + "weights.bench.skw";
+	WeightFile::writeSparse(sparse, weights);
+	WeightFile::writeBinary(binary, weights);
+
+	// The viewer's former parser : ifstream >> string, then stoi / stof
+	SkinInfluences legacy;
+	double legacyMs = bestTimeMs([&]() {
+		std::ifstream in(dense.c_str());
+		std::string buf;
+		in >> buf;
+		for (int i = 0; i < nbJoints; i++) in >> buf;
+		legacy.reset(nbVertices);
+		std::vector<int> joints(nbJoints);
+		std::vector<float> row(nbJoints);
+		for (int i = 0; i < nbJoints; i++) joints[i] = i;
+		while (in >> buf) {
+			int v = std::stoi(buf);
+			for (int i = 0; i < nbJoints; i++) {
+				in >> buf;
+				row[i] = std::stof(buf);
+			}
+			if (v >= 0 && v < legacy.nbVertices()) legacy.setVertex(v, joints.data(), row.data(), nbJoints);
+		}
+	});
+
+	std::cout << "== Weight files, " << nbVertices << " vertices x " << nbJoints << " joints, "
+	          << weights.nbInfluences() << " non-zero (ms, best of 5) ==" << std::endl;
+	std::cout << std::setw(20) << std::left << "format" << std::right << std::setw(10) << "KB"
+	          << std::setw(10) << "load" << std::setw(10) << "speedup" << std::setw(12) << "max diff" << std::endl;
+	std::cout << std::setw(20) << std::left << "dense, ifstream" << std::right << std::fixed << std::setprecision(1)
+	          << std::setw(10) << QFileInfo(QString::fromStdString(dense)).size() / 1024.0
+	          << std::setprecision(3) << std::setw(10) << legacyMs << std::defaultfloat << std::endl;
+	const char* names[] = {"dense", "sparse text", "binary"};
+	std::string files[] = {dense, sparse, binary};
+	for (int i = 0; i < 3; i++) {
+		SkinInfluences skin;
+		double ms = bestTimeMs([&]() { WeightFile::load(files[i], nbJoints, nbVertices, skin); });
+		std::cout << std::setw(20) << std::left << names[i] << std::right << std::fixed << std::setprecision(1)
+		          << std::setw(10) << QFileInfo(QString::fromStdString(files[i])).size() / 1024.0
+		          << std::setprecision(3) << std::setw(10) << ms
+		          << std::setprecision(1) << std::setw(9) << legacyMs / ms << "x"
+		          << std::scientific << std::setprecision(1) << std::setw(12) << maxWeightDifference(legacy, skin, nbJoints)
+		          << std::defaultfloat << std::endl;
+	}
+	remove(sparse.c_str());
+	remove(binary.c_str());
+}
+
+void benchmarkVertexCache(const std::string & modelsPath) {
+	SkinScene scene;
+	if (!scene.load(modelsPath)) {
+		std::cout << "== Vertex cache : skin.off / walk1.bvh not found ==" << std::endl;
+		return;
+	}
+	const SkinInfluences & skin = scene.skin;
+	int nbVertices = skin.nbVertices();
+	int nbFrames = scene.skeleton->nbFrames();
+	AnimationBake bake;
+	bake.bake(*scene.skeleton);
+	std::string fileName = modelsPath + "../animation/walk1.bench.vac";
+	double exportMs = bestTimeMs([&]() { VertexCache::write(fileName, skin, bake, scene.skeleton->frameTime()); }, 3);
+	VertexCache cache;
+	if (!cache.open(fileName)) {
+		std::cout << "== Vertex cache : could not write " << fileName << " ==" << std::endl;
+		return;
+	}
+
+	// Playback in order, against skinning every frame on one thread
+	std::vector<trimesh::point> skinned(nbVertices), played(nbVertices);
+	SkinningEngine engine;
+	double skinMs = bestTimeMs([&]() {
+		for (int f = 0; f < nbFrames; f++) {
+			engine.setPose(bake.matrices(f), bake.nbJoints());
+			engine.skinRange(skin, 0, nbVertices, &skinned[0]);
+		}
+	}, 3);
+	double playMs = bestTimeMs([&]() {
+		for (int f = 0; f < nbFrames; f++) cache.fetch(f, &played[0]);
+	}, 3);
+	// Random frames decode from the start of their run
+	double seekMs = bestTimeMs([&]() {
+		for (int f = 0; f < nbFrames; f++) cache.fetch((f * 7919) % nbFrames, &played[0]);
+	}, 3);
+	double error = 0;
+	for (int f = 0; f < nbFrames; f++) {
+		engine.setPose(bake.matrices(f), bake.nbJoints());
+		engine.skinRange(skin, 0, nbVertices, &skinned[0]);
+		cache.fetch(f, &played[0]);
+		for (int v = 0; v < nbVertices; v++) error = std::max(error, (double)trimesh::dist(skinned[v], played[v]));
+	}
+	size_t raw = (size_t)nbFrames * nbVertices * sizeof(trimesh::point);
+
+	std::cout << "== Vertex cache, skin.off (" << nbVertices << " vertices) on walk1.bvh (" << nbFrames
+	          << " frames), us per frame ==" << std::endl;
+	std::cout << std::setw(10) << "export ms" << std::setw(10) << "raw KB" << std::setw(10) << "cache KB"
+	          << std::setw(8) << "ratio" << std::setw(12) << "B/vertex" << std::setw(10) << "skinning"
+	          << std::setw(10) << "playback" << std::setw(10) << "random" << std::setw(12) << "max error" << std::endl;
+	std::cout << std::fixed << std::setprecision(1) << std::setw(10) << exportMs << std::setw(10) << raw / 1024.0
+	          << std::setw(10) << cache.bytes() / 1024.0 << std::setw(7) << (double)raw / cache.bytes() << "x"
+	          << std::setprecision(2) << std::setw(12) << (double)cache.bytes() / ((double)nbFrames * nbVertices)
+	          << std::setprecision(1) << std::setw(10) << 1000 * skinMs / nbFrames << std::setw(10) << 1000 * playMs / nbFrames
+	          << std::setw(10) << 1000 * seekMs / nbFrames
+	          << std::scientific << std::setprecision(1) << std::setw(12) << error << std::defaultfloat << std::endl;
+	cache.close();
+	remove(fileName.c_str());
+}
+
+void benchmarkCrowd(const std::string & modelsPath) {
+	SkinScene scene;
+	if (!scene.load(modelsPath)) {
+		std::cout << "== Crowd : skin.off / walk1.bvh not found ==" << std::endl;
+		return;
+	}
+	const SkinInfluences & skin = scene.skin;
+	AnimationBake bake;
+	bake.bake(*scene.skeleton);
+	const int updates = 10;
+	int threads = 1;
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+
+	std::cout << "== Crowd update, skin.off (" << skin.nbVertices() << " vertices) on walk1.bvh, "
+	          << threads << " threads (ms per update) ==" << std::endl;
+	std::cout << std::setw(12) << "characters" << std::setw(12) << "1 thread" << std::setw(12) << "threads"
+	          << std::setw(10) << "speedup" << std::setw(14) << "us/character" << std::endl;
+	for (int n = 1; n <= 256; n *= 4) {
+		Crowd crowd(*scene.skeleton, skin, &bake);
+		for (int c = 0; c < n; c++) {
+			// On a grid, each one at a different point of the clip
+			glm::mat4 root = glm::translate(glm::mat4(1.0), glm::vec3(100.0f * (c % 16), 0.0f, 100.0f * (c / 16)));
+			crowd.add(0.037 * c, root);
+		}
+		auto run = [&]() {
+			for (int u = 0; u < updates; u++) crowd.evaluate(u * scene.skeleton->frameTime());
+		};
+#ifdef _OPENMP
+		omp_set_num_threads(1);
+#endif
+		double serialMs = bestTimeMs(run, 3) / updates;
+#ifdef _OPENMP
+		omp_set_num_threads(threads);
+#endif
+		double parallelMs = bestTimeMs(run, 3) / updates;
+		std::cout << std::setw(12) << n << std::fixed << std::setprecision(3)
+		          << std::setw(12) << serialMs << std::setw(12) << parallelMs
+		          << std::setprecision(1) << std::setw(9) << serialMs / parallelMs << "x"
+		          << std::setprecision(2) << std::setw(14) << 1000 * parallelMs / n << std::defaultfloat << std::endl;
+	}
+}
+
+void benchmarkSkinLod(const std::string & modelsPath) {
+	SkinScene scene;
+	if (!scene.load(modelsPath)) {
+		std::cout << "== Skinning LOD : skin.off / walk1.bvh not found ==" << std::endl;
+		return;
+	}
+	const SkinInfluences & skin = scene.skin;
+	int nbVertices = skin.nbVertices();
+	AnimationBake bake;
+	bake.bake(*scene.skeleton);
+	int nbFrames = bake.nbFrames();
+	scene.mesh->need_faces();
+	scene.mesh->need_bsphere();
+	SkinLod lod;
+	double buildMs = bestTimeMs([&]() { lod.build(scene.mesh->vertices, scene.mesh->faces, skin); }, 3);
+	float radius = scene.mesh->bsphere.r;
+
+	// Each level against the full skin over the whole clip; a level updated
+	// every n frames also shows poses up to n - 1 frames late, moved along
+	// with the root joint. Errors on screen for the largest radius of the level
+	std::cout << "== Skinning LOD, skin.off (" << nbVertices << " vertices, radius " << radius << ") on walk1.bvh, built in "
+	          << buildMs << " ms (us per skinning, 1 thread) ==" << std::endl;
+	std::cout << std::setw(8) << "level" << std::setw(10) << "vertices" << std::setw(11) << "triangles" << std::setw(7) << "width"
+	          << std::setw(10) << "skinning" << std::setw(10) << "interval" << std::setw(10) << "per frame"
+	          << std::setw(12) << "mean error" << std::setw(12) << "max error" << std::setw(12) << "late error"
+	          << std::setw(10) << "max px" << std::setw(10) << "late px" << std::endl;
+	SkinningEngine engine;
+	std::vector<trimesh::point> full(nbVertices), out(nbVertices), scratch;
+	std::vector<std::vector<trimesh::point> > frames(nbFrames, std::vector<trimesh::point>(nbVertices));
+	for (int f = 0; f < nbFrames; f++) {
+		engine.setPose(bake.matrices(f), bake.nbJoints());
+		engine.skin(skin, &frames[f][0]);
+	}
+#ifdef _OPENMP
+	int threads = omp_get_max_threads();
+	omp_set_num_threads(1);
+#endif
+	double fullUs = 0;
+	for (int l = 0; l < lod.nbLevels(); l++) {
+		const SkinLodLevel & level = lod.level(l);
+		engine.setPose(bake.matrices(0), bake.nbJoints());
+		double us = 1000 * bestTimeMs([&]() { lod.skin(l, engine, &out[0], scratch); });
+		if (l == 0) fullUs = us;
+		double maxError = 0, meanError = 0, lateError = 0;
+		for (int f = 0; f < nbFrames; f++) {
+			const glm::mat4* matrices = bake.matrices(f);
+			for (int v = 0; v < nbVertices; v++) {
+				double e = trimesh::dist(trimesh::point(lod.skinVertex(l, v, matrices)), frames[f][v]);
+				maxError = std::max(maxError, e);
+				meanError += e;
+				for (int late = 1; late < level.updateInterval && late <= f; late++) {
+					glm::mat4 drift = matrices[0] * glm::inverse(bake.matrices(f - late)[0]);
+					const trimesh::point & p = frames[f - late][v];
+					glm::vec4 moved = drift * glm::vec4(p[0], p[1], p[2], 1.0f);
+					lateError = std::max(lateError, (double)trimesh::dist(trimesh::point(moved), frames[f][v]));
+				}
+			}
+		}
+		meanError /= (double)nbFrames * nbVertices;
+		int triangles = level.indices.empty() ? scene.mesh->faces.size() : level.indices.size() / 3;
+		double pixels = (l == 0) ? 0 : lod.level(l - 1).minRadius / radius;
+		std::cout << std::setw(8) << l << std::setw(10) << level.nbSkinned() << std::setw(11) << triangles
+		          << std::setw(7) << level.skin.width() << std::fixed << std::setprecision(1) << std::setw(10) << us
+		          << std::setw(10) << level.updateInterval << std::setw(9) << fullUs / (us / level.updateInterval) << "x"
+		          << std::scientific << std::setprecision(2) << std::setw(12) << meanError << std::setw(12) << maxError
+		          << std::setw(12) << lateError << std::fixed << std::setprecision(1);
+		if (l == 0) std::cout << std::setw(10) << "-" << std::setw(10) << "-";
+		else std::cout << std::setw(10) << pixels * maxError << std::setw(10) << pixels * lateError;
+		std::cout << std::defaultfloat << std::endl;
+	}
+#ifdef _OPENMP
+	omp_set_num_threads(threads);
+#endif
+
+	// A crowd seen from one corner of its grid, most characters far away
+	const int n = 256;
+	const float spacing = 3 * radius;
+	const float focal = 1000.0f;
+	const int updates = 12;
+	Crowd reference(*scene.skeleton, skin, &bake), levels(*scene.skeleton, skin, &bake);
+	for (int c = 0; c < n; c++) {
+		glm::mat4 root = glm::translate(glm::mat4(1.0), glm::vec3(spacing * (c % 16), 0.0f, spacing * (c / 16)));
+		reference.add(0.037 * c, root);
+		levels.add(0.037 * c, root);
+	}
+	levels.setLod(&lod);
+	levels.setView(glm::vec3(-spacing, 0.0f, -spacing), focal, radius);
+	double referenceMs = bestTimeMs([&]() {
+		for (int u = 0; u < updates; u++) reference.evaluate(u * scene.skeleton->frameTime());
+	}, 3) / updates;
+	int skinned = 0;
+	double levelsMs = bestTimeMs([&]() {
+		skinned = 0;
+		for (int u = 0; u < updates; u++) {
+			levels.evaluate(u * scene.skeleton->frameTime());
+			skinned += levels.nbSkinned();
+		}
+	}, 3) / updates;
+	std::vector<int> perLevel(lod.nbLevels(), 0);
+	for (int c = 0; c < n; c++) perLevel[levels.level(c)]++;
+	std::cout << n << " characters " << spacing << " apart, focal " << focal << " px : ";
+	for (int l = 0; l < lod.nbLevels(); l++) std::cout << perLevel[l] << " at level " << l << (l + 1 < lod.nbLevels() ? ", " : "");
+	std::cout << std::endl << std::fixed << std::setprecision(3) << "  full skin " << referenceMs << " ms per update, levels "
+	          << levelsMs << " ms (" << std::setprecision(1) << referenceMs / levelsMs << "x), "
+	          << (double)skinned / updates << " characters skinned per update" << std::defaultfloat << std::endl;
+}
+
+// Weights as glShaderWindow computed them : nearest joint points, brute force
+void legacyRigidBinding(const std::vector<trimesh::point> & vertices, const std::vector<trimesh::point> & joints, SkinInfluences & skin) {
+	skin.reset(vertices.size());
+	const float weight = 1;
+	for (size_t v = 0; v < vertices.size(); v++) {
+		double distanceMin = std::numeric_limits<double>::max();
+		int iMin = 0;
+		for (size_t i = 0; i < joints.size(); i++) {
+			double dist = trimesh::dist(joints[i], vertices[v]);
+			if (dist < distanceMin) {
+				distanceMin = dist;
+				iMin = i;
+			}
+		}
+		skin.setVertex(v, &iMin, &weight, 1);
+	}
+}
+
+void legacySmoothBinding(const std::vector<trimesh::point> & vertices, const std::vector<trimesh::point> & joints, SkinInfluences & skin) {
+	struct DistancesMin {
+		std::vector<std::pair<int, double>> data;
+		DistancesMin(std::vector<std::pair<int, double>> d) : data(d) { }
+		std::pair<int, double> getMaxDistance() {
+			double distanceMax = 0;
+			int iMax = 0;
+			for (size_t i = 0; i < data.size(); i++) {
+				if (data[i].second > distanceMax) {
+					distanceMax = data[i].second;
+					iMax = i;
+				}
+			}
+			return std::pair<int, double>(iMax, distanceMax);
+		}
+		void normalize() {
+			double sum = 0;
+			for (size_t i = 0; i < data.size(); i++) sum += data[i].second;
+			for (size_t i = 0; i < data.size(); i++) data[i].second /= sum;
+		}
+	};
+	const int n = 2;
+	skin.reset(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		// Two vectors per vertex, the largest distance looked for at every joint
+		std::vector<std::pair<int, double>> distancesMin = std::vector<std::pair<int, double>>(n);
+		DistancesMin smallest = DistancesMin(distancesMin);
+		for (int i = 0; i < n; i++) smallest.data[i] = std::pair<int, double>(i, trimesh::dist(joints[i], vertices[v]));
+		for (size_t i = n; i < joints.size(); i++) {
+			std::pair<int, double> maxOfMins = smallest.getMaxDistance();
+			double dist = trimesh::dist(joints[i], vertices[v]);
+			if (dist < maxOfMins.second) smallest.data[maxOfMins.first] = std::pair<int, double>(i, dist);
+		}
+		smallest.normalize();
+		for (int i = 0; i < n; i++) smallest.data[i].second = 1 - smallest.data[i].second;
+		smallest.normalize();
+		int joint[n];
+		float weight[n];
+		for (int i = 0; i < n; i++) {
+			joint[i] = smallest.data[i].first;
+			weight[i] = smallest.data[i].second;
+		}
+		skin.setVertex(v, joint, weight, n);
+	}
+}
+
+void benchmarkSkinBinding(const std::string & modelsPath) {
+	SkinScene scene;
+	if (!scene.load(modelsPath)) {
+		std::cout << "== Skin binding : skin.off / walk1.bvh not found ==" << std::endl;
+		return;
+	}
+	const Skeleton & skeleton = *scene.skeleton;
+	int nbJoints = skeleton.nbJoints();
+	int threads = 1;
+#ifdef _OPENMP
+	threads = omp_get_max_threads();
+#endif
+	std::cout << "== Skin binding, walk1.bvh (" << nbJoints << " joints), " << threads
+	          << " threads (ms per binding) ==" << std::endl;
+	std::cout << std::setw(20) << std::left << "model" << std::right << std::setw(10) << "vertices"
+	          << std::setw(12) << "rigid pts" << std::setw(12) << "rigid bones" << std::setw(9) << "speedup"
+	          << std::setw(13) << "smooth pts" << std::setw(13) << "smooth bones" << std::setw(9) << "speedup" << std::endl;
+
+	QDir modelsDir(QString::fromStdString(modelsPath));
+	QStringList models("skin.off");
+	for (const QString & name : modelsDir.entryList(QStringList("*.ply"), QDir::Files | QDir::Readable, QDir::Name)) models << name;
+	for (const QString & name : models) {
+		trimesh::TriMesh* mesh = scene.mesh;
+		std::vector<trimesh::point> joints = scene.bindJoints;
+		if (name.toStdString() != "skin.off") {
+			{
+				QuietOutput quiet;
+				mesh = trimesh::TriMesh::read(modelsDir.filePath(name).toStdString().c_str());
+			}
+			if (mesh == NULL) continue;
+			trimesh::point center(0, 0, 0, 1);
+			for (size_t v = 0; v < mesh->vertices.size(); v++) center += mesh->vertices[v];
+			center /= mesh->vertices.size();
+			skeleton.initPointPositions(joints, center);
+		}
+		SkinInfluences skin;
+		SkinBinding binding;
+		double legacyRigidMs = bestTimeMs([&]() { legacyRigidBinding(mesh->vertices, joints, skin); }, 3);
+		double rigidMs = bestTimeMs([&]() {
+			binding.build(skeleton, joints);
+			binding.bindRigid(mesh->vertices, skin);
+		}, 3);
+		double legacySmoothMs = bestTimeMs([&]() { legacySmoothBinding(mesh->vertices, joints, skin); }, 3);
+		double smoothMs = bestTimeMs([&]() {
+			binding.build(skeleton, joints);
+			binding.bindSmooth(mesh->vertices, 2, skin);
+		}, 3);
+		std::cout << std::setw(20) << std::left << name.toStdString() << std::right << std::setw(10) << mesh->vertices.size()
+		          << std::fixed << std::setprecision(2) << std::setw(12) << legacyRigidMs << std::setw(12) << rigidMs
+		          << std::setprecision(1) << std::setw(8) << legacyRigidMs / rigidMs << "x"
+		          << std::setprecision(2) << std::setw(13) << legacySmoothMs << std::setw(13) << smoothMs
+		          << std::setprecision(1) << std::setw(8) << legacySmoothMs / smoothMs << "x" << std::defaultfloat << std::endl;
+		if (mesh != scene.mesh) delete mesh;
+	}
+}
+
+// Skinning in file order against vertices sorted by joints and skinned by
+// batches : weights.txt for skin.off, the smooth weights of the S key for
+// the other models
+void benchmarkVertexOrder(const std::string & modelsPath) {
+	SkinScene scene;
+	if (!scene.load(modelsPath)) {
+		std::cout << "== Vertex order : skin.off / walk1.bvh not found ==" << std::endl;
+		return;
+	}
+	const Skeleton & skeleton = *scene.skeleton;
+	int nbJoints = skeleton.nbJoints();
+	AnimationBake bake;
+	bake.bake(skeleton);
+	const int frames = std::min(20, skeleton.nbFrames());
+	std::cout << "== Vertex order by joints (" << SkinningEngine::instructionSet() << "), walk1.bvh (us per skinning) ==" << std::endl;
+	std::cout << std::setw(20) << std::left << "model" << std::right << std::setw(10) << "vertices" << std::setw(7) << "width"
+	          << std::setw(9) << "sort ms" << std::setw(9) << "batches" << std::setw(8) << "shared"
+	          << std::setw(10) << "file" << std::setw(10) << "sorted" << std::setw(10) << "batched"
+	          << std::setw(9) << "speedup" << std::setw(12) << "max diff" << std::endl;
+
+	QDir modelsDir(QString::fromStdString(modelsPath));
+	QStringList models("skin.off");
+	for (const QString & name : modelsDir.entryList(QStringList("*.ply"), QDir::Files | QDir::Readable, QDir::Name)) models << name;
+	for (const QString & name : models) {
+		trimesh::TriMesh* mesh;
+		SkinInfluences skin;
+		if (name.toStdString() == "skin.off") {
+			mesh = new trimesh::TriMesh(*scene.mesh);
+			skin = scene.skin;
+		} else {
+			{
+				QuietOutput quiet;
+				mesh = trimesh::TriMesh::read(modelsDir.filePath(name).toStdString().c_str());
+			}
+			if (mesh == NULL) continue;
+			trimesh::point center(0, 0, 0, 1);
+			for (size_t v = 0; v < mesh->vertices.size(); v++) center += mesh->vertices[v];
+			center /= mesh->vertices.size();
+			std::vector<trimesh::point> joints(nbJoints);
+			skeleton.initPointPositions(joints, center);
+			SkinBinding binding;
+			binding.build(skeleton, joints);
+			binding.bindSmooth(mesh->vertices, 2, skin);
+			skin.bind(mesh->vertices, joints);
+		}
+		int nbVertices = skin.nbVertices();
+
+		// Sorted once for real, timed on copies
+		double sortMs = bestTimeMs([&]() {
+			trimesh::TriMesh copy(*mesh);
+			SkinInfluences sortedSkin(skin);
+			VertexOrder order;
+			order.sort(&copy, sortedSkin);
+		}, 3);
+		trimesh::TriMesh sortedMesh(*mesh);
+		SkinInfluences sorted(skin);
+		VertexOrder order;
+		order.sort(&sortedMesh, sorted);
+		std::vector<SkinBatch> batches;
+		SkinningEngine::batches(sorted, batches);
+		int nbShared = 0;
+		for (size_t b = 0; b < batches.size(); b++) {
+			if (batches[b].width > 0) nbShared += batches[b].last - batches[b].first;
+		}
+
+		std::vector<trimesh::point> reference(nbVertices), out(nbVertices);
+		SkinningEngine engine;
+		double fileMs = 0, sortedMs = 0, batchedMs = 0, diff = 0;
+		for (int f = 0; f < frames; f++) {
+			engine.setPose(bake.matrices(f), nbJoints);
+			fileMs += bestTimeMs([&]() { engine.skin(skin, &reference[0]); }, 3);
+			sortedMs += bestTimeMs([&]() { engine.skin(sorted, &out[0]); }, 3);
+			batchedMs += bestTimeMs([&]() { engine.skin(sorted, batches, &out[0]); }, 3);
+			// Same positions, each at its new index
+			for (int v = 0; v < nbVertices; v++) {
+				const trimesh::point & p = reference[order.fileVertices()[v]];
+				for (int k = 0; k < 4; k++) diff = std::max(diff, (double)std::fabs(p[k] - out[v][k]));
+			}
+		}
+		std::cout << std::setw(20) << std::left << name.toStdString() << std::right << std::setw(10) << nbVertices
+		          << std::setw(7) << skin.width() << std::fixed << std::setprecision(2) << std::setw(9) << sortMs
+		          << std::setw(9) << batches.size() << std::setprecision(0) << std::setw(7) << 100.0 * nbShared / nbVertices << "%"
+		          << std::setprecision(1) << std::setw(10) << 1000 * fileMs / frames << std::setw(10) << 1000 * sortedMs / frames
+		          << std::setw(10) << 1000 * batchedMs / frames << std::setw(8) << fileMs / batchedMs << "x"
+		          << std::scientific << std::setprecision(1) << std::setw(12) << diff << std::defaultfloat << std::endl;
+		delete mesh;
+	}
+}
+
+// Bytes per vertex of the separate float buffers against the packed ones,
+// and what quantizing costs in precision
+void benchmarkVertexFormat(const std::string & modelsPath) {
+	std::cout << "== Packed vertex format (" << sizeof(PackedVertex) << " bytes) ==" << std::endl;
+	std::cout << std::setw(20) << std::left << "model" << std::right << std::setw(10) << "vertices"
+	          << std::setw(8) << "floats" << std::setw(8) << "packed" << std::setw(8) << "ratio" << std::setw(9) << "pack ms"
+	          << std::setw(12) << "pos error" << std::setw(12) << "normal deg" << std::endl;
+
+	QDir modelsDir(QString::fromStdString(modelsPath));
+	QStringList models("skin.off");
+	for (const QString & name : modelsDir.entryList(QStringList("*.ply"), QDir::Files | QDir::Readable, QDir::Name)) models << name;
+	for (const QString & name : models) {
+		trimesh::TriMesh* mesh;
+		{
+			QuietOutput quiet;
+			mesh = trimesh::TriMesh::read(modelsDir.filePath(name).toStdString().c_str());
+			if (mesh == NULL) continue;
+			mesh->need_normals();
+		}
+		int nbVertices = mesh->vertices.size();
+		bool hasColors = mesh->colors.size() > 0;
+		bool hasTexcoords = mesh->texcoords.size() > 0;
+		// As bindSceneToProgram uploaded them before
+		size_t floatBytes = sizeof(trimesh::point) + sizeof(trimesh::vec)
+		                    + (hasColors ? sizeof(trimesh::Color) : 0) + (hasTexcoords ? sizeof(trimesh::vec2) : 0);
+
+		PackedMesh packed;
+		double packMs = bestTimeMs([&]() {
+			packed.pack(&mesh->vertices[0], &mesh->normals[0], hasColors ? &mesh->colors[0][0] : NULL,
+			            hasTexcoords ? &mesh->texcoords[0] : NULL, nbVertices);
+		}, 5);
+		// Position error relative to the size of the model, normal error in degrees
+		double positionError = 0, normalError = 0;
+		const float* scale = packed.scale();
+		float size = std::sqrt(scale[0] * scale[0] + scale[1] * scale[1] + scale[2] * scale[2]);
+		for (int v = 0; v < nbVertices; v++) {
+			positionError = std::max(positionError, (double)trimesh::dist(packed.position(v), mesh->vertices[v]) / size);
+			trimesh::vec n = mesh->normals[v], m = packed.normal(v);
+			float c = (n[0] * m[0] + n[1] * m[1] + n[2] * m[2]) / (trimesh::len(n) * trimesh::len(m));
+			normalError = std::max(normalError, std::acos(std::min(1.0, (double)c)) * 180 / M_PI);
+		}
+		std::cout << std::setw(20) << std::left << name.toStdString() << std::right << std::setw(10) << nbVertices
+		          << std::setw(8) << floatBytes << std::setw(8) << sizeof(PackedVertex)
+		          << std::fixed << std::setprecision(2) << std::setw(7) << (double)floatBytes / sizeof(PackedVertex) << "x"
+		          << std::setw(9) << packMs << std::scientific << std::setprecision(1) << std::setw(12) << positionError
+		          << std::fixed << std::setprecision(3) << std::setw(12) << normalError << std::defaultfloat << std::endl;
+		delete mesh;
+	}
+}
+
+// Vertices transformed per triangle in file order, after Tipsify and after
+// the overdraw sort, and what the optimization costs at load
+void benchmarkTriangleOrder(const std::string & modelsPath) {
+	std::cout << "== Triangle order (FIFO of " << TriangleOrder::kCacheSize << " vertices, ACMR / ATVR) ==" << std::endl;
+	std::cout << std::setw(20) << std::left << "model" << std::right << std::setw(9) << "faces"
+	          << std::setw(14) << "file" << std::setw(14) << "tipsify" << std::setw(14) << "overdraw"
+	          << std::setw(10) << "clusters" << std::setw(10) << "ACMR 32" << std::setw(8) << "ms" << std::endl;
+
+	QDir modelsDir(QString::fromStdString(modelsPath));
+	QStringList models("skin.off");
+	for (const QString & name : modelsDir.entryList(QStringList("*.ply"), QDir::Files | QDir::Readable, QDir::Name)) models << name;
+	for (const QString & name : models) {
+		trimesh::TriMesh* mesh;
+		{
+			QuietOutput quiet;
+			mesh = trimesh::TriMesh::read(modelsDir.filePath(name).toStdString().c_str());
+			if (mesh == NULL) continue;
+			mesh->need_faces();
+		}
+		int nbVertices = mesh->vertices.size();
+		const int cacheSize = TriangleOrder::kCacheSize;
+		CacheStats file = TriangleOrder::simulate(mesh->faces, nbVertices);
+
+		std::vector<int> faceOrder, clusters;
+		TriangleOrder::tipsify(mesh->faces, nbVertices, cacheSize, faceOrder, clusters);
+		std::vector<trimesh::TriMesh::Face> faces(faceOrder.size());
+		for (size_t f = 0; f < faceOrder.size(); f++) faces[f] = mesh->faces[faceOrder[f]];
+		CacheStats tipsified = TriangleOrder::simulate(faces, nbVertices);
+
+		double ms = bestTimeMs([&]() {
+			trimesh::TriMesh copy(*mesh);
+			std::vector<int> order;
+			TriangleOrder::optimize(&copy, order);
+			VertexOrder::permute(&copy, order);
+		}, 3);
+		std::vector<int> order;
+		TriangleOrder::optimize(mesh, order);
+		VertexOrder::permute(mesh, order);
+		CacheStats sorted = TriangleOrder::simulate(mesh->faces, nbVertices);
+		CacheStats sorted32 = TriangleOrder::simulate(mesh->faces, nbVertices, 32);
+
+		std::cout << std::setw(20) << std::left << name.toStdString() << std::right << std::setw(9) << mesh->faces.size()
+		          << std::fixed << std::setprecision(3)
+		          << std::setw(8) << file.acmr << " / " << std::setprecision(2) << file.atvr
+		          << std::setprecision(3) << std::setw(8) << tipsified.acmr << " / " << std::setprecision(2) << tipsified.atvr
+		          << std::setprecision(3) << std::setw(8) << sorted.acmr << " / " << std::setprecision(2) << sorted.atvr
+		          << std::setw(10) << clusters.size() << std::setprecision(3) << std::setw(10) << sorted32.acmr
+		          << std::setprecision(2) << std::setw(8) << ms << std::defaultfloat << std::endl;
+		delete mesh;
+	}
+}
+
+void benchmarkCompression(const QStringList & files) {
+	std::cout << "== Motion compression (tolerance 0.1 deg, 0.01 unit), sizes in KB ==" << std::endl;
+	std::cout << std::setw(32) << std::left << "file" << std::right
+	          << std::setw(10) << "double" << std::setw(10) << "float" << std::setw(10) << "keys"
+	          << std::setw(10) << "ratio" << std::setw(8) << "kept" << std::setw(12) << "curve err"
+	          << std::setw(12) << "joint err" << std::setw(12) << "us/sample" << std::endl;
+	for (const QString & file : files) {
+		std::string fileName = file.toStdString();
+		Skeleton* skeleton;
+		{
+			QuietOutput quiet;
+			skeleton = BvhLoader::loadSkeleton(fileName);
+		}
+		if (skeleton == NULL || skeleton->nbFrames() == 0) {
+			delete skeleton;
+			continue;
+		}
+		int nbJoints = skeleton->nbJoints();
+		int nbChannels = skeleton->nbChannels();
+		int nbFrames = skeleton->nbFrames();
+		CompressedMotion motion;
+		motion.compress(*skeleton);
+
+		// Errors on the frames : channel values, then joint positions
+		std::vector<float> row(nbChannels);
+		std::vector<trimesh::point> exact(nbJoints), decoded(nbJoints);
+		std::vector<glm::mat4> matrices(nbJoints);
+		double curveError = 0, jointError = 0;
+		for (int f = 0; f < nbFrames; f++) {
+			motion.sampleFrame(f, &row[0]);
+			for (int c = 0; c < nbChannels; c++) {
+				float d = std::fabs(row[c] - skeleton->frame(f)[c]);
+				curveError = std::max(curveError, (double)std::min(d, 360 - d));
+			}
+			skeleton->evaluateFrame(f, &exact[0], &matrices[0]);
+			skeleton->evaluateRow(&row[0], &decoded[0], &matrices[0]);
+			for (int j = 0; j < nbJoints; j++) jointError = std::max(jointError, (double)trimesh::dist(exact[j], decoded[j]));
+		}
+		const int samples = 1000;
+		double sampleMs = bestTimeMs([&]() {
+			for (int i = 0; i < samples; i++) motion.sample(i * 0.0123, &row[0]);
+		});
+
+		size_t doubles = (size_t)nbFrames * nbChannels * sizeof(double);
+		size_t floats = skeleton->_motion.size() * sizeof(float);
+		std::cout << std::setw(32) << std::left << QFileInfo(file).fileName().toStdString() << std::right << std::fixed
+		          << std::setprecision(1) << std::setw(10) << doubles / 1024.0 << std::setw(10) << floats / 1024.0
+		          << std::setw(10) << motion.bytes() / 1024.0 << std::setw(9) << (double)doubles / motion.bytes() << "x"
+		          << std::setw(7) << 100.0 * motion.nbKeys() / ((double)nbFrames * nbChannels) << "%"
+		          << std::scientific << std::setprecision(1) << std::setw(12) << curveError << std::setw(12) << jointError
+		          << std::fixed << std::setprecision(3) << std::setw(12) << 1000 * sampleMs / samples << std::defaultfloat << std::endl;
+		delete skeleton;
+	}
+}
+
+void benchmarkBake(const QStringList & files) {
+	const int passes = 20;
+	std::cout << "== Baked joint tables, " << passes << " passes over the clip (us per frame) ==" << std::endl;
+	std::cout << std::setw(32) << std::left << "file" << std::right
+	          << std::setw(10) << "bake ms" << std::setw(10) << "KB"
+	          << std::setw(10) << "live" << std::setw(10) << "baked" << std::setw(10) << "speedup"
+	          << std::setw(12) << "max diff" << std::endl;
+	for (const QString & file : files) {
+		std::string fileName = file.toStdString();
+		Skeleton* skeleton;
+		{
+			QuietOutput quiet;
+			skeleton = BvhLoader::loadSkeleton(fileName);
+		}
+		if (skeleton == NULL || skeleton->nbFrames() == 0) {
+			delete skeleton;
+			continue;
+		}
+		int nbJoints = skeleton->nbJoints();
+		int nbFrames = skeleton->nbFrames();
+		std::vector<trimesh::point> positions(nbJoints);
+		std::vector<glm::mat4> matrices(nbJoints);
+		AnimationBake bake;
+		double bakeMs = bestTimeMs([&]() { bake.bake(*skeleton); });
+		if (!bake.isBaked()) {
+			std::cout << QFileInfo(file).fileName().toStdString() << " : over the bake memory cap" << std::endl;
+			delete skeleton;
+			continue;
+		}
+		double liveMs = bestTimeMs([&]() {
+			for (int p = 0; p < passes; p++)
+				for (int f = 0; f < nbFrames; f++) {
+					skeleton->animate(f);
+					skeleton->computePointPositions(positions, matrices);
+				}
+		});
+		double bakedMs = bestTimeMs([&]() {
+			for (int p = 0; p < passes; p++)
+				for (int f = 0; f < nbFrames; f++) bake.fetch(f, positions, matrices);
+		});
+
+		double diff = 0;
+		for (int f = 0; f < nbFrames; f++) {
+			skeleton->animate(f);
+			skeleton->computePointPositions(positions, matrices);
+			const trimesh::point* baked = bake.positions(f);
+			for (int j = 0; j < nbJoints; j++) {
+				for (int k = 0; k < 3; k++) diff = std::max(diff, (double)std::fabs(positions[j][k] - baked[j][k]));
+			}
+		}
+		double perFrame = 1000.0 / (passes * nbFrames);
+		std::cout << std::setw(32) << std::left << QFileInfo(file).fileName().toStdString() << std::right << std::fixed
+		          << std::setprecision(3) << std::setw(10) << bakeMs << std::setw(10) << bake.bytes() / 1024
+		          << std::setw(10) << liveMs * perFrame << std::setw(10) << bakedMs * perFrame
+		          << std::setprecision(1) << std::setw(9) << liveMs / bakedMs << "x"
+		          << std::scientific << std::setprecision(1) << std::setw(12) << diff << std::defaultfloat << std::endl;
+		delete skeleton;
+	}
+}
+
+}
+
+int runBenchmarks(const std::string & modelsPath) {
+	QDir animationDir(QString::fromStdString(modelsPath) + "../animation/");
+	QStringList bvhFiles;
+	for (const QString & name : animationDir.entryList(QStringList("*.bvh"), QDir::Files | QDir::Readable, QDir::Name)) {
+		bvhFiles << animationDir.filePath(name);
+	}
+	if (bvhFiles.isEmpty()) {
+		std::cerr << "No .bvh file found in " << animationDir.path().toStdString() << std::endl;
+		return 1;
+	}
+	benchmarkBvhLoaders(bvhFiles);
+	benchmarkAnimate(bvhFiles);
+	benchmarkBvhCache(bvhFiles);
+	benchmarkJointTransforms(bvhFiles);
+	benchmarkIncrementalPose(bvhFiles);
+	benchmarkCompression(bvhFiles);
+	benchmarkBake(bvhFiles);
+	benchmarkWeightFiles(modelsPath);
+	benchmarkSkinLayout(modelsPath);
+	benchmarkSkinningEngine(modelsPath);
+	benchmarkVertexCache(modelsPath);
+	benchmarkCrowd(modelsPath);
+	benchmarkSkinLod(modelsPath);
+	benchmarkSkinBinding(modelsPath);
+	benchmarkVertexOrder(modelsPath);
+	benchmarkVertexFormat(modelsPath);
+	benchmarkTriangleOrder(modelsPath);
+	return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <chrono>
+#include <string>
+
+// Best wall-clock time of fn() over several runs, in milliseconds
+template<typename F>
+double bestTimeMs(F fn, int runs = 5) {
+	double best = -1;
+	for (int i = 0; i < runs; i++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		fn();
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		if (best < 0 || elapsed.count() < best) best = elapsed.count();
+	}
+	return best;
+}
+
+// Runs the benchmarks on the bundled data ("myViewer -benchmark").
+// modelsPath is the models directory, animations are read from ../animation/
+int runBenchmarks(const std::string & modelsPath);
+
+#endif
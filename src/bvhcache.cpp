@@ -0,0 +1,193 @@
+#include "bvhcache.h"
+#include "bvhloader.h"
+#include "mappedfile.h"
+#include "fnvhash.h"
+
+#include <sys/stat.h>
+#include <utime.h>
+#include <ctime>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+const char kMagic[4] = {'B', 'V', 'H', 'C'};
+const uint32_t kVersion = 1;
+const int kQuantMax = 32767;
+
+// Section offsets of a cache file described by its header
+struct BvhcLayout {
+	size_t joints, channels, names, motion, end;
+
+	BvhcLayout(const BvhcHeader & h) {
+		joints = sizeof(BvhcHeader);
+		channels = joints + align8(h.nbJoints * sizeof(BvhcJoint));
+		names = channels + align8(h.nbChannels * sizeof(BvhcChannel));
+		motion = names + h.namesSize;
+		end = motion + align8((size_t)h.nbFrames * h.nbChannels * sizeof(int16_t));
+	}
+};
+
+}
+
+std::string BvhCache::cacheFileName(const std::string & bvhFileName) {
+	return bvhFileName + "c";
+}
+
+Skeleton* BvhCache::load(const std::string & bvhFileName) {
+	std::string cacheName = cacheFileName(bvhFileName);
+	struct stat source, cache;
+	if (stat(bvhFileName.c_str(), &source) != 0) {
+		std::cerr << "Failed to load the file " << bvhFileName.data() << std::endl;
+		return NULL;
+	}
+	if (stat(cacheName.c_str(), &cache) == 0) {
+		BvhcHeader header;
+		Skeleton* skeleton = read(cacheName, &header);
+		if (skeleton != NULL && header.sourceSize == (uint64_t)source.st_size) {
+			if (cache.st_mtime >= source.st_mtime) {
+				return skeleton;
+			}
+			// Source is newer : the cache is still good if only the date changed.
+			// Dated again, so that the next loads do not hash the source.
+			MappedFile file;
+			if (file.open(bvhFileName) && fnv1a(file.data(), file.size()) == header.sourceHash) {
+				struct utimbuf date;
+				date.actime = date.modtime = std::max(time(NULL), source.st_mtime);
+				if (utime(cacheName.c_str(), &date) != 0
+				    && !write(cacheName, *skeleton, header.sourceHash, header.sourceSize)) {
+					std::cerr << "Could not write the cache " << cacheName << std::endl;
+				}
+				return skeleton;
+			}
+		}
+		delete skeleton;
+		std::cout << "Outdated cache " << cacheName << std::endl;
+	}
+
+	Skeleton* skeleton = BvhLoader::loadSkeleton(bvhFileName);
+	MappedFile file;
+	if (skeleton != NULL && file.open(bvhFileName)) {
+		if (!write(cacheName, *skeleton, fnv1a(file.data(), file.size()), file.size())) {
+			std::cerr << "Could not write the cache " << cacheName << std::endl;
+		}
+	}
+	return skeleton;
+}
+
+Skeleton* BvhCache::read(const std::string & cacheFileName, BvhcHeader* header) {
+	MappedFile file;
+	if (!file.open(cacheFileName) || file.size() < sizeof(BvhcHeader)) return NULL;
+	const BvhcHeader & h = *reinterpret_cast<const BvhcHeader*>(file.data());
+	if (memcmp(h.magic, kMagic, 4) != 0 || h.version != kVersion) return NULL;
+	BvhcLayout layout(h);
+	if (layout.end != file.size()) return NULL;
+	// Nothing past here is trusted : a damaged file is parsed again from the .bvh
+	const BvhcJoint* joints = reinterpret_cast<const BvhcJoint*>(file.data() + layout.joints);
+	const BvhcChannel* channels = reinterpret_cast<const BvhcChannel*>(file.data() + layout.channels);
+	const char* namesEnd = file.data() + layout.names + h.namesSize;
+	const char* name = file.data() + layout.names;
+	for (uint32_t j = 0; j < h.nbJoints; j++) {
+		const BvhcJoint & joint = joints[j];
+		if (joint.parent < -1 || joint.parent >= (int32_t)j) return NULL;
+		if (joint.channelBegin < 0 || joint.channelCount < 0
+		    || (int64_t)joint.channelBegin + joint.channelCount > (int64_t)h.nbChannels) return NULL;
+		const char* nul = (const char*)memchr(name, '\0', namesEnd - name);
+		if (nul == NULL) return NULL;
+		name = nul + 1;
+	}
+	for (uint32_t c = 0; c < h.nbChannels; c++) {
+		if (channels[c].type > chUnknown) return NULL;
+	}
+	if (header != NULL) *header = h;
+
+	Skeleton* skeleton = new Skeleton(h.nbJoints, h.nbChannels);
+	name = file.data() + layout.names;
+	for (uint32_t j = 0; j < h.nbJoints; j++) {
+		skeleton->_parent[j] = joints[j].parent;
+		skeleton->_channelBegin[j] = joints[j].channelBegin;
+		skeleton->_channelCount[j] = joints[j].channelCount;
+		skeleton->_offset[j] = glm::vec3(joints[j].offset[0], joints[j].offset[1], joints[j].offset[2]);
+		skeleton->_names[j] = name;
+		name += skeleton->_names[j].size() + 1;
+	}
+	for (uint32_t c = 0; c < h.nbChannels; c++) {
+		skeleton->_channelType[c] = channels[c].type;
+	}
+	skeleton->bindChannels();
+
+	const int16_t* quantized = reinterpret_cast<const int16_t*>(file.data() + layout.motion);
+	std::vector<float> motion((size_t)h.nbFrames * h.nbChannels);
+	for (size_t i = 0; i < motion.size(); i++) {
+		const BvhcChannel & ch = channels[i % h.nbChannels];
+		motion[i] = ch.bias + ch.scale * quantized[i];
+	}
+	skeleton->setMotion(h.nbFrames, h.frameTime, motion);
+
+	std::cout << "Loaded " << cacheFileName << " (" << h.nbJoints << " joints, " << h.nbFrames << " frames)" << std::endl;
+	return skeleton;
+}
+
+bool BvhCache::write(const std::string & cacheFileName, const Skeleton & skeleton, uint64_t sourceHash, uint64_t sourceSize) {
+	int nbJoints = skeleton.nbJoints();
+	int nbChannels = skeleton.nbChannels();
+	int nbFrames = skeleton.nbFrames();
+
+	BvhcHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, kMagic, 4);
+	h.version = kVersion;
+	h.sourceHash = sourceHash;
+	h.sourceSize = sourceSize;
+	h.nbJoints = nbJoints;
+	h.nbChannels = nbChannels;
+	h.nbFrames = nbFrames;
+	h.frameTime = skeleton.frameTime();
+	std::string names;
+	for (const std::string & name : skeleton._names) {
+		names += name;
+		names += '\0';
+	}
+	names.resize(align8(names.size()), '\0');
+	h.namesSize = names.size();
+	BvhcLayout layout(h);
+
+	std::vector<char> data(layout.end, 0);
+	memcpy(&data[0], &h, sizeof(h));
+	BvhcJoint* joints = reinterpret_cast<BvhcJoint*>(&data[layout.joints]);
+	for (int j = 0; j < nbJoints; j++) {
+		joints[j].parent = skeleton._parent[j];
+		joints[j].channelBegin = skeleton._channelBegin[j];
+		joints[j].channelCount = skeleton._channelCount[j];
+		joints[j].offset[0] = skeleton._offset[j].x;
+		joints[j].offset[1] = skeleton._offset[j].y;
+		joints[j].offset[2] = skeleton._offset[j].z;
+	}
+	memcpy(&data[layout.names], names.data(), names.size());
+
+	// Each channel is quantized over its own range
+	BvhcChannel* channels = reinterpret_cast<BvhcChannel*>(&data[layout.channels]);
+	int16_t* quantized = reinterpret_cast<int16_t*>(&data[layout.motion]);
+	for (int c = 0; c < nbChannels; c++) {
+		float vmin = 0, vmax = 0;
+		for (int f = 0; f < nbFrames; f++) {
+			float v = skeleton.frame(f)[c];
+			vmin = (f == 0) ? v : std::min(vmin, v);
+			vmax = (f == 0) ? v : std::max(vmax, v);
+		}
+		channels[c].type = skeleton._channelType[c];
+		channels[c].bias = 0.5f * (vmin + vmax);
+		channels[c].scale = (vmax - vmin) / (2 * kQuantMax);
+		for (int f = 0; f < nbFrames; f++) {
+			long q = 0;
+			if (channels[c].scale > 0) {
+				q = lround((skeleton.frame(f)[c] - channels[c].bias) / channels[c].scale);
+			}
+			quantized[(size_t)f * nbChannels + c] = std::max(-(long)kQuantMax, std::min((long)kQuantMax, q));
+		}
+	}
+
+	return writeFileAtomically(cacheFileName, data.data(), data.size());
+}
@@ -0,0 +1,58 @@
+#ifndef _BVHCACHE_H_
+#define _BVHCACHE_H_
+
+#include "skeleton.h"
+#include <string>
+#include <stdint.h>
+
+// Precompiled animation next to its source : walk1.bvh -> walk1.bvhc.
+// The file holds the parsed skeleton and the motion matrix quantized to
+// 16 bits per value (per channel range), behind a versioned header that
+// records a hash of the source .bvh. Loading maps it and copies the arrays
+// out, there is no text to parse.
+//
+// Layout (native endianness, every section 8-byte aligned) :
+//   BvhcHeader
+//   joints    : nbJoints x BvhcJoint
+//   channels  : nbChannels x BvhcChannel
+//   names     : nbJoints zero-terminated strings
+//   motion    : nbFrames x nbChannels int16, frame-major
+struct BvhcHeader {
+	char magic[4];				// "BVHC"
+	uint32_t version;
+	uint64_t sourceHash;		// FNV-1a of the .bvh bytes
+	uint64_t sourceSize;
+	uint32_t nbJoints;
+	uint32_t nbChannels;
+	uint32_t nbFrames;
+	uint32_t namesSize;			// bytes, padding included
+	double frameTime;
+};
+
+struct BvhcJoint {
+	int32_t parent;
+	int32_t channelBegin;
+	int32_t channelCount;
+	float offset[3];
+};
+
+struct BvhcChannel {
+	uint32_t type;				// ChannelType
+	float bias;					// value = bias + scale * q
+	float scale;
+	float pad;
+};
+
+class BvhCache {
+public :
+	// Skeleton of a .bvh : from its cache when it is up to date, otherwise
+	// parsed from the text file and the cache is rewritten.
+	static Skeleton* load(const std::string & bvhFileName);
+
+	static std::string cacheFileName(const std::string & bvhFileName);
+	// Cache content only (no check against the source). NULL if unreadable.
+	static Skeleton* read(const std::string & cacheFileName, BvhcHeader* header = NULL);
+	static bool write(const std::string & cacheFileName, const Skeleton & skeleton, uint64_t sourceHash, uint64_t sourceSize);
+};
+
+#endif
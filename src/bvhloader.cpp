@@ -0,0 +1,254 @@
+#include "bvhloader.h"
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+#include <stack>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+const string_view kMotion = "MOTION";
+const string_view kChannels = "CHANNELS";
+const string_view kEnd = "End";
+const string_view kJoint = "JOINT";
+const string_view kOffset = "OFFSET";
+const string_view kRoot = "ROOT";
+const string_view kCloseBracket = "}";
+
+inline bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Whitespace separated tokens of a mapped buffer, without any copy
+struct Tokenizer {
+	const char* p;
+	const char* end;
+
+	Tokenizer(const char* b, const char* e) : p(b), end(e) {};
+
+	string_view next() {
+		while (p < end && isBlank(*p)) p++;
+		const char* b = p;
+		while (p < end && !isBlank(*p)) p++;
+		return string_view(b, p - b);
+	}
+};
+
+template<typename T>
+bool toNumber(string_view tok, T & value) {
+	const char* b = tok.data();
+	const char* e = b + tok.size();
+	// from_chars does not accept an explicit '+'
+	if (b < e && *b == '+') b++;
+	from_chars_result r = from_chars(b, e, value);
+	return r.ec == errc() && r.ptr == e;
+}
+
+// HIERARCHY block, up to the MOTION keyword : joint tree with empty curves.
+// Returns NULL if the block is malformed.
+Joint* parseHierarchy(Tokenizer & tok, int & nbJoints) {
+	Joint* root = NULL;
+	std::stack<Joint*> currentHierarchyStack;
+	int currentId = 0;
+	bool ok = true;
+
+	string_view buf;
+	while (ok && buf != kMotion) {
+		buf = tok.next();
+		if (buf.empty()) {
+			ok = false;
+		} else if (buf == kRoot) {
+			root = new Joint();
+			root->_name = string(tok.next());
+			currentHierarchyStack.push(root);
+		} else if (currentHierarchyStack.empty()) {
+			// HIERARCHY keyword, or garbage before ROOT
+			continue;
+		} else if (buf == kOffset) {
+			Joint* j = currentHierarchyStack.top();
+			ok = toNumber(tok.next(), j->_offX) && toNumber(tok.next(), j->_offY) && toNumber(tok.next(), j->_offZ);
+		} else if (buf == kJoint || buf == kEnd) {
+			Joint* tmp = new Joint();
+			currentId++;
+			currentHierarchyStack.top()->_children.push_back(tmp);
+			currentHierarchyStack.push(tmp);
+			tmp->_name = string(tok.next());
+		} else if (buf == kCloseBracket) {
+			currentHierarchyStack.pop();
+		} else if (buf == kChannels) {
+			int nb_channels = 0;
+			ok = toNumber(tok.next(), nb_channels);
+			Joint* j = currentHierarchyStack.top();
+			for (int i = 0; ok && i < nb_channels; i++) {
+				j->_dofs.push_back(AnimCurve(string(tok.next())));
+			}
+		}
+	}
+	if (!ok) {
+		delete root;
+		return NULL;
+	}
+	nbJoints = currentId + 1;
+	return root;
+}
+
+// "Frames: N" then "Frame Time: t"
+bool parseFrameInfo(Tokenizer & tok, int & nbFrames, double & frameTime) {
+	tok.next();
+	bool ok = toNumber(tok.next(), nbFrames) && nbFrames >= 0;
+	tok.next();
+	tok.next();
+	return ok && toNumber(tok.next(), frameTime);
+}
+
+// Reads nb values of one MOTION row in [p, end) through store(frame, channel, value).
+// Returns false if the row does not hold exactly nb numbers.
+template<typename Store>
+bool parseRow(const char* p, const char* end, int nb, int frame, Store & store) {
+	for (int c = 0; c < nb; c++) {
+		while (p < end && isBlank(*p)) p++;
+		if (p < end && *p == '+') p++;
+		double v;
+		from_chars_result r = from_chars(p, end, v);
+		if (r.ec != errc()) return false;
+		store(frame, c, v);
+		p = r.ptr;
+	}
+	while (p < end && isBlank(*p)) p++;
+	return p == end;
+}
+
+// Splits the MOTION values, starting after "Frame Time: t", into rows (one
+// frame per line) : the start of at most nbFrames rows, then the end of the
+// last one. A frame takes a row or more, so there are no more frames in the
+// file than rows, whatever its header says.
+std::vector<const char*> splitRows(const char* begin, const char* end, int nbFrames) {
+	std::vector<const char*> rows;
+	rows.reserve(std::min<ptrdiff_t>(nbFrames, std::count(begin, end, '\n') + 1) + 1);
+	const char* p = begin;
+	while (p < end && (int)rows.size() < nbFrames) {
+		while (p < end && isBlank(*p)) p++;
+		if (p == end) break;
+		rows.push_back(p);
+		const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+		p = eol ? eol + 1 : end;
+	}
+	rows.push_back(p);
+	return rows;
+}
+
+// MOTION values of the rows from splitRows, stored for at most rows.size() - 1
+// frames. When every frame is on its own line, rows are parsed in parallel.
+// Returns the number of complete frames.
+template<typename Store>
+int parseMotion(const std::vector<const char*> & rows, const char* begin, const char* end, int nbChannels, Store & store) {
+	int nbRows = rows.size() - 1;
+	bool rowsOk = true;
+	#pragma omp parallel for schedule(static) reduction(&&:rowsOk)
+	for (int f = 0; f < nbRows; f++) {
+		rowsOk = parseRow(rows[f], rows[f + 1], nbChannels, f, store) && rowsOk;
+	}
+	if (rowsOk) return nbRows;
+
+	// Frames spread over several lines (or truncated file) : sequential read
+	Tokenizer motion(begin, end);
+	for (int f = 0; f < nbRows; f++) {
+		for (int c = 0; c < nbChannels; c++) {
+			double v;
+			if (!toNumber(motion.next(), v)) return f;
+			store(f, c, v);
+		}
+	}
+	return nbRows;
+}
+
+// Maps the file and reads everything up to the first MOTION value
+Joint* parseHeader(MappedFile & file, const std::string & fileName, Tokenizer & tok, int & nbJoints, int & nbFrames, double & frameTime) {
+	std::cout << "Loading from " << fileName << "..." << std::endl;
+	if (!file.open(fileName)) {
+		std::cerr << "Failed to load the file " << fileName.data() << std::endl;
+		return NULL;
+	}
+	tok = Tokenizer(file.data(), file.end());
+	Joint* root = parseHierarchy(tok, nbJoints);
+	if (root == NULL || !parseFrameInfo(tok, nbFrames, frameTime)) {
+		std::cerr << "Malformed bvh file " << fileName.data() << std::endl;
+		delete root;
+		return NULL;
+	}
+	std::cout << "Frames : " << nbFrames << std::endl;
+	return root;
+}
+
+}
+
+Joint* BvhLoader::load(const std::string & fileName, int & nb_children, int & nb_indices, int & maxFrameNb, double & frameTime) {
+	MappedFile file;
+	Tokenizer tok(NULL, NULL);
+	int nbFrames;
+	Joint* root = parseHeader(file, fileName, tok, nb_children, nbFrames, frameTime);
+	if (root == NULL) return NULL;
+	nb_indices = (nb_children - 1) * 2;
+	std::vector<const char*> rows = splitRows(tok.p, file.end(), nbFrames);
+	int nbRows = rows.size() - 1;
+
+	// Depth-first numbering of the joints, and channels in file order which
+	// is the column order of the MOTION rows
+	std::vector<std::vector<double>*> columns;
+	std::stack<Joint*> dfs;
+	dfs.push(root);
+	int id = 0;
+	while (!dfs.empty()) {
+		Joint* j = dfs.top();
+		dfs.pop();
+		j->_id = id++;
+		for (AnimCurve & curve : j->_dofs) {
+			curve._values.assign(nbRows, 0.0);
+			columns.push_back(&curve._values);
+		}
+		for (int i = j->_children.size() - 1; i >= 0; i--) dfs.push(j->_children[i]);
+	}
+
+	int nbChannels = columns.size();
+	auto store = [&columns](int f, int c, double v) { (*columns[c])[f] = v; };
+	maxFrameNb = parseMotion(rows, tok.p, file.end(), nbChannels, store);
+	if (maxFrameNb < nbFrames) {
+		std::cerr << "Only " << maxFrameNb << " complete frames in " << fileName.data() << std::endl;
+	}
+	if (maxFrameNb < nbRows) {
+		for (std::vector<double>* column : columns) column->resize(maxFrameNb);
+	}
+
+	std::cout << "file loaded" << std::endl;
+	return root;
+}
+
+Skeleton* BvhLoader::loadSkeleton(const std::string & fileName) {
+	MappedFile file;
+	Tokenizer tok(NULL, NULL);
+	int nbJoints, nbFrames;
+	double frameTime;
+	Joint* root = parseHeader(file, fileName, tok, nbJoints, nbFrames, frameTime);
+	if (root == NULL) return NULL;
+	Skeleton* skeleton = Skeleton::fromJoint(root);
+	delete root;
+
+	// Straight into the frame-major matrix
+	int nbChannels = skeleton->nbChannels();
+	std::vector<const char*> rows = splitRows(tok.p, file.end(), nbFrames);
+	std::vector<float> motion((rows.size() - 1) * nbChannels);
+	auto store = [&motion, nbChannels](int f, int c, double v) { motion[(size_t)f * nbChannels + c] = v; };
+	int nbRead = parseMotion(rows, tok.p, file.end(), nbChannels, store);
+	if (nbRead < nbFrames) {
+		std::cerr << "Only " << nbRead << " complete frames in " << fileName.data() << std::endl;
+	}
+	motion.resize((size_t)nbRead * nbChannels);
+	skeleton->setMotion(nbRead, frameTime, motion);
+
+	std::cout << "file loaded" << std::endl;
+	return skeleton;
+}
@@ -0,0 +1,20 @@
+#ifndef _BVHLOADER_H_
+#define _BVHLOADER_H_
+
+#include "joint.h"
+#include "skeleton.h"
+#include <string>
+
+// Fast .bvh reader : the file is memory-mapped and tokenized in place,
+// numbers are read with std::from_chars (no std::string per value).
+// Once the HIERARCHY gives the channel layout, the MOTION rows are
+// independent and are parsed in parallel.
+class BvhLoader {
+public :
+	// Same Joint tree as Joint::createFromFile
+	static Joint* load(const std::string & fileName, int & nb_children, int & nb_indices, int & maxFrameNb, double & frameTime);
+	// Flat skeleton, MOTION parsed directly into its frame-major matrix
+	static Skeleton* loadSkeleton(const std::string & fileName);
+};
+
+#endif
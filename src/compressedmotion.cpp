@@ -0,0 +1,126 @@
+#include "compressedmotion.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int kQuantMax = 32767;
+// Key frames are stored on 16 bits
+const int kMaxFrames = 65535;
+
+// Linear interpolation, rotations going the short way around
+inline float interpolate(float a, float b, float alpha, bool rotation) {
+	float delta = b - a;
+	if (rotation) {
+		if (delta > 180) delta -= 360;
+		else if (delta < -180) delta += 360;
+	}
+	return a + alpha * delta;
+}
+
+}
+
+CompressedMotion::CompressedMotion() : _nbFrames(0), _frameTime(0) {
+}
+
+void CompressedMotion::compress(const Skeleton & skeleton, float rotationTolerance, float translationTolerance) {
+	int nbChannels = skeleton.nbChannels();
+	_nbFrames = skeleton.nbFrames();
+	if (_nbFrames > kMaxFrames) {
+		std::cerr << "Only the first " << kMaxFrames << " frames are compressed" << std::endl;
+		_nbFrames = kMaxFrames;
+	}
+	_frameTime = (skeleton.frameTime() > 0) ? skeleton.frameTime() : 1.0 / 30;
+	_channels.assign(nbChannels, Channel());
+	_keyFrame.clear();
+	_keyValue.clear();
+	if (_nbFrames == 0) return;
+
+	std::vector<float> curve(_nbFrames);
+	for (int c = 0; c < nbChannels; c++) {
+		Channel & ch = _channels[c];
+		ch.rotation = (skeleton._channelType[c] >= chXrot && skeleton._channelType[c] <= chZrot);
+		float tolerance = ch.rotation ? rotationTolerance : translationTolerance;
+
+		float vmin = skeleton.frame(0)[c], vmax = vmin;
+		for (int f = 0; f < _nbFrames; f++) {
+			curve[f] = skeleton.frame(f)[c];
+			vmin = std::min(vmin, curve[f]);
+			vmax = std::max(vmax, curve[f]);
+		}
+		ch.bias = 0.5f * (vmin + vmax);
+		ch.scale = (vmax - vmin) / (2 * kQuantMax);
+		auto quantize = [&ch](float v) -> int16_t {
+			if (ch.scale <= 0) return 0;
+			return std::max(-kQuantMax, std::min(kQuantMax, (int)lround((v - ch.bias) / ch.scale)));
+		};
+		auto value = [&ch](int16_t q) { return ch.bias + ch.scale * q; };
+
+		ch.firstKey = _keyFrame.size();
+		_keyFrame.push_back(0);
+		// Constant channel : one key at the middle of the range
+		if (_nbFrames == 1 || vmax - vmin <= tolerance) {
+			_keyValue.push_back(0);
+			ch.nbKeys = 1;
+			continue;
+		}
+		_keyValue.push_back(quantize(curve[0]));
+		// Greedy : extend the segment from the last key as long as the line
+		// to the candidate (through quantized values) fits every frame between
+		int anchor = 0;
+		for (int end = 2; end < _nbFrames; end++) {
+			float a = value(_keyValue.back());
+			float b = value(quantize(curve[end]));
+			bool fits = true;
+			for (int f = anchor + 1; fits && f < end; f++) {
+				float alpha = float(f - anchor) / (end - anchor);
+				fits = std::fabs(interpolate(a, b, alpha, ch.rotation) - curve[f]) <= tolerance;
+			}
+			if (!fits) {
+				anchor = end - 1;
+				_keyFrame.push_back(anchor);
+				_keyValue.push_back(quantize(curve[anchor]));
+			}
+		}
+		if (_keyFrame.back() != _nbFrames - 1) {
+			_keyFrame.push_back(_nbFrames - 1);
+			_keyValue.push_back(quantize(curve[_nbFrames - 1]));
+		}
+		ch.nbKeys = _keyFrame.size() - ch.firstKey;
+	}
+}
+
+size_t CompressedMotion::bytes() const {
+	return _channels.size() * sizeof(Channel) + _keyFrame.size() * sizeof(uint16_t) + _keyValue.size() * sizeof(int16_t);
+}
+
+void CompressedMotion::sample(double t, float* row) const {
+	sampleFrame(t / _frameTime, row);
+}
+
+void CompressedMotion::sampleFrame(double position, float* row) const {
+	if (_nbFrames == 0) return;
+	position = std::fmod(position, (double)_nbFrames);
+	if (position < 0) position += _nbFrames;
+
+	for (unsigned int c = 0; c < _channels.size(); c++) {
+		const Channel & ch = _channels[c];
+		const uint16_t* frames = &_keyFrame[ch.firstKey];
+		const int16_t* values = &_keyValue[ch.firstKey];
+		int last = ch.nbKeys - 1;
+		float v;
+		if (last == 0) {
+			v = ch.bias + ch.scale * values[0];
+		} else if (position >= frames[last]) {
+			// Between the last frame and the first one, when looping
+			float alpha = float(position - frames[last]);
+			v = interpolate(ch.bias + ch.scale * values[last], ch.bias + ch.scale * values[0], alpha, ch.rotation);
+		} else {
+			int k = std::upper_bound(frames, frames + ch.nbKeys, (uint16_t)position) - frames - 1;
+			float alpha = float((position - frames[k]) / (frames[k + 1] - frames[k]));
+			v = interpolate(ch.bias + ch.scale * values[k], ch.bias + ch.scale * values[k + 1], alpha, ch.rotation);
+		}
+		row[c] = v;
+	}
+}
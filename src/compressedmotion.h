@@ -0,0 +1,46 @@
+#ifndef _COMPRESSEDMOTION_H_
+#define _COMPRESSEDMOTION_H_
+
+#include "skeleton.h"
+#include <stdint.h>
+
+// Keyframe-reduced copy of a skeleton motion.
+// Each channel keeps only the frames needed to stay within a tolerance of
+// the original curve when linearly interpolated, values quantized to 16
+// bits over the channel range (constant channels end up with one key).
+// The curves can be sampled at any time, not only on frames.
+class CompressedMotion {
+public :
+	CompressedMotion();
+
+	// Tolerances in degrees for rotations and in file units for translations
+	void compress(const Skeleton & skeleton, float rotationTolerance = 0.1f, float translationTolerance = 0.01f);
+
+	int nbChannels() const { return _channels.size(); }
+	int nbFrames() const { return _nbFrames; }
+	int nbKeys() const { return _keyFrame.size(); }
+	double duration() const { return _nbFrames * _frameTime; }
+	size_t bytes() const;
+
+	// Channel values at time t (seconds, looping over the clip) into row
+	void sample(double t, float* row) const;
+	// Same at a (fractional) frame position
+	void sampleFrame(double position, float* row) const;
+
+private :
+	struct Channel {
+		float bias;					// value = bias + scale * q
+		float scale;
+		uint32_t firstKey;			// in _keyFrame / _keyValue
+		uint32_t nbKeys;
+		bool rotation;				// interpolated the short way around
+	};
+
+	std::vector<Channel> _channels;
+	std::vector<uint16_t> _keyFrame;	// frame of each key, increasing per channel
+	std::vector<int16_t> _keyValue;		// quantized value of each key
+	int _nbFrames;
+	double _frameTime;
+};
+
+#endif
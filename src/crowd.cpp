@@ -0,0 +1,116 @@
+#include "crowd.h"
+
+#include <cmath>
+#include <cfloat>
+
+Crowd::Crowd(const Skeleton & skeleton, const SkinInfluences & skin, const AnimationBake* bake)
+	: _skeleton(skeleton), _skin(skin), _bake(bake), _nbJoints(skeleton.nbJoints()), _nbVertices(skin.nbVertices()),
+	  _lod(NULL), _eye(0.0f), _focal(1000.0f), _radius(1.0f), _updates(0), _nbSkinned(0) {
+	if (_bake != NULL && (!_bake->isBaked() || _bake->nbJoints() != _nbJoints)) _bake = NULL;
+}
+
+int Crowd::add(double timeOffset, const glm::mat4 & root) {
+	_timeOffset.push_back(timeOffset);
+	_root.push_back(root);
+	_frame.push_back(0);
+	_level.push_back(0);
+	_skinnedRoot.push_back(glm::mat4(1.0f));
+	_matrices.resize(_matrices.size() + _nbJoints);
+	_positions.resize(_positions.size() + _nbJoints);
+	_vertices.resize(_vertices.size() + _nbVertices);
+	return size() - 1;
+}
+
+void Crowd::clear() {
+	_timeOffset.clear();
+	_root.clear();
+	_frame.clear();
+	_level.clear();
+	_skinnedRoot.clear();
+	_matrices.clear();
+	_positions.clear();
+	_vertices.clear();
+}
+
+void Crowd::setView(const glm::vec3 & eye, float focal, float radius) {
+	_eye = eye;
+	_focal = focal;
+	_radius = radius;
+}
+
+void Crowd::evaluate(double time) {
+	int nbCharacters = size();
+	int nbFrames = _skeleton.nbFrames();
+	if (nbCharacters == 0 || nbFrames == 0) return;
+	double frameTime = (_skeleton.frameTime() > 0) ? _skeleton.frameTime() : 1.0 / 30;
+	for (int c = 0; c < nbCharacters; c++) {
+		long long index = (long long)std::floor((time + _timeOffset[c]) / frameTime);
+		_frame[c] = (int)(((index % nbFrames) + nbFrames) % nbFrames);
+	}
+	if (_lod != NULL && _lod->nbLevels() > 0) {
+		// Characters due this update, spread over the interval of their level
+		_skinned.clear();
+		for (int c = 0; c < nbCharacters; c++) {
+			float distance = glm::length(glm::vec3(_root[c][3]) - _eye);
+			_level[c] = _lod->select((distance > 0) ? _focal * _radius / distance : FLT_MAX);
+			if ((_updates + c) % _lod->level(_level[c]).updateInterval == 0) _skinned.push_back(c);
+		}
+		_updates++;
+		_nbSkinned = _skinned.size();
+		#pragma omp parallel for schedule(static)
+		for (int c = 0; c < nbCharacters; c++) {
+			pose(c);
+		}
+		#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < _nbSkinned; i++) {
+			skinLevel(_skinned[i]);
+			_skinnedRoot[_skinned[i]] = _matrices[(size_t)_skinned[i] * _nbJoints];
+		}
+		return;
+	}
+	_nbSkinned = nbCharacters;
+
+	#pragma omp parallel for schedule(static)
+	for (int c = 0; c < nbCharacters; c++) {
+		pose(c);
+	}
+	// Characters x vertices, so that a few characters still use every core
+	#pragma omp parallel for collapse(2) schedule(static)
+	for (int c = 0; c < nbCharacters; c++) {
+		for (int v = 0; v < _nbVertices; v++) {
+			skin(c, v);
+		}
+	}
+}
+
+void Crowd::pose(int character) {
+	glm::mat4* matrices = &_matrices[(size_t)character * _nbJoints];
+	trimesh::point* positions = &_positions[(size_t)character * _nbJoints];
+	if (_bake != NULL) {
+		const glm::mat4* baked = _bake->matrices(_frame[character]);
+		for (int j = 0; j < _nbJoints; j++) matrices[j] = _root[character] * baked[j];
+	} else {
+		_skeleton.evaluateFrame(_frame[character], positions, matrices);
+		for (int j = 0; j < _nbJoints; j++) matrices[j] = _root[character] * matrices[j];
+	}
+}
+
+void Crowd::skin(int character, int vertex) {
+	const glm::mat4* matrices = &_matrices[(size_t)character * _nbJoints];
+	_vertices[(size_t)character * _nbVertices + vertex] = trimesh::point(_skin.skin(vertex, matrices));
+}
+
+glm::mat4 Crowd::drift(int character) const {
+	if (_lod == NULL) return glm::mat4(1.0f);
+	return jointMatrices(character)[0] * glm::inverse(_skinnedRoot[character]);
+}
+
+// Vertices of the character's level, the others keep their last position
+void Crowd::skinLevel(int character) {
+	const SkinLodLevel & level = _lod->level(_level[character]);
+	const glm::mat4* matrices = &_matrices[(size_t)character * _nbJoints];
+	trimesh::point* out = &_vertices[(size_t)character * _nbVertices];
+	for (int i = 0; i < level.nbSkinned(); i++) {
+		out[level.vertices.empty() ? i : level.vertices[i]] = trimesh::point(level.skin.skin(i, matrices));
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef _CROWD_H_
+#define _CROWD_H_
+
+#include "skeleton.h"
+#include "animationbake.h"
+#include "skininfluences.h"
+#include "skinlod.h"
+
+// Many characters playing the same clip, each with its own time offset and
+// root transform, sharing one skin. Per-character state and results are
+// stored in contiguous arrays (character c uses slice c of each array) and
+// every update poses then skins all characters in parallel.
+// With levels of detail, each character is skinned at the level of its size
+// on screen, and only on the updates of its level's interval. In between, it
+// is still posed : its vertices are drawn moved along with its root joint.
+class Crowd {
+public :
+	// The skeleton, skin and bake must outlive the crowd. Without a bake (or
+	// an empty one) poses are evaluated from the motion.
+	Crowd(const Skeleton & skeleton, const SkinInfluences & skin, const AnimationBake* bake = NULL);
+
+	int add(double timeOffset, const glm::mat4 & root);
+	void clear();
+	int size() const { return _timeOffset.size(); }
+
+	// Levels of detail of the skin (NULL : always the full skin) and the
+	// viewpoint they are chosen from : eye position, focal length in pixels
+	// and radius of a character around its root
+	void setLod(const SkinLod* lod) { _lod = lod; }
+	void setView(const glm::vec3 & eye, float focal, float radius);
+
+	// Poses and skins every character at time t (seconds)
+	void evaluate(double time);
+
+	int frame(int character) const { return _frame[character]; }
+	int level(int character) const { return _level[character]; }
+	// Transform to draw the vertices with, from the root joint they were
+	// skinned at to the current one (identity when skinned this update)
+	glm::mat4 drift(int character) const;
+	// Characters skinned by the last update
+	int nbSkinned() const { return _nbSkinned; }
+	const glm::mat4* jointMatrices(int character) const { return &_matrices[(size_t)character * _nbJoints]; }
+	const trimesh::point* vertices(int character) const { return &_vertices[(size_t)character * _nbVertices]; }
+
+private :
+	void pose(int character);
+	void skin(int character, int vertex);
+	void skinLevel(int character);
+
+	const Skeleton & _skeleton;
+	const SkinInfluences & _skin;
+	const AnimationBake* _bake;
+	int _nbJoints;
+	int _nbVertices;
+	const SkinLod* _lod;
+	glm::vec3 _eye;
+	float _focal;
+	float _radius;
+	int _updates;
+	int _nbSkinned;
+
+	// Per character
+	std::vector<double> _timeOffset;
+	std::vector<glm::mat4> _root;
+	std::vector<int> _frame;
+	std::vector<int> _level;
+	std::vector<glm::mat4> _skinnedRoot;	// root joint matrix of the skinned vertices
+	std::vector<int> _skinned;		// characters of this update, when levels are used
+	// Per character, nbJoints or nbVertices each
+	std::vector<glm::mat4> _matrices;
+	std::vector<trimesh::point> _positions;
+	std::vector<trimesh::point> _vertices;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "dynamicbuffer.h"
+
+#include <QtGui/QOpenGLContext>
+#include <string.h>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace {
+
+// Region offsets are kept aligned for any attribute type
+const size_t kAlignment = 256;
+// Fence waits are retried by slices of this (nanoseconds)
+const GLuint64 kWaitSlice = 1000000;
+
+typedef void (QOPENGLF_APIENTRYP BufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// glBufferStorage of the current context, NULL before GL 4.4 without ARB_buffer_storage
+BufferStorage bufferStorage() {
+	QOpenGLContext* context = QOpenGLContext::currentContext();
+	if (context == NULL) return NULL;
+	QSurfaceFormat format = context->format();
+	bool core = format.version() >= qMakePair(4, 4);
+	if (!core && !context->hasExtension("GL_ARB_buffer_storage")) return NULL;
+	return (BufferStorage)context->getProcAddress("glBufferStorage");
+}
+
+}
+
+DynamicBuffer::DynamicBuffer() : _gl(NULL), _buffer(0), _regionBytes(0), _persistent(false), _mapped(NULL),
+	_current(-1), _writing(-1), _nbStalls(0) {
+	for (int r = 0; r < kRegions; r++) _fences[r] = 0;
+}
+
+void DynamicBuffer::allocate(OpenGLFunctions* gl, size_t bytes) {
+	bytes = (bytes + kAlignment - 1) / kAlignment * kAlignment;
+	if (_buffer != 0 && _gl == gl && bytes <= _regionBytes) return;
+	destroy();
+	_gl = gl;
+	_regionBytes = bytes;
+	_nbStalls = 0;
+	_gl->glGenBuffers(1, &_buffer);
+	_gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+	BufferStorage storage = bufferStorage();
+	if (storage != NULL) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		storage(GL_ARRAY_BUFFER, kRegions * _regionBytes, NULL, flags);
+		_mapped = (char*)_gl->glMapBufferRange(GL_ARRAY_BUFFER, 0, kRegions * _regionBytes, flags);
+	}
+	_persistent = (_mapped != NULL);
+	if (!_persistent) {
+		// Storage made by glBufferStorage is immutable : start from a new buffer
+		if (storage != NULL) {
+			_gl->glDeleteBuffers(1, &_buffer);
+			_gl->glGenBuffers(1, &_buffer);
+			_gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+		}
+		_gl->glBufferData(GL_ARRAY_BUFFER, kRegions * _regionBytes, NULL, GL_STREAM_DRAW);
+	}
+	_gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DynamicBuffer::destroy() {
+	if (_buffer == 0) return;
+	for (int r = 0; r < kRegions; r++) {
+		if (_fences[r]) _gl->glDeleteSync(_fences[r]);
+		_fences[r] = 0;
+	}
+	if (_mapped != NULL || _writing >= 0) {
+		_gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+		_gl->glUnmapBuffer(GL_ARRAY_BUFFER);
+		_gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	_gl->glDeleteBuffers(1, &_buffer);
+	_buffer = 0;
+	_regionBytes = 0;
+	_persistent = false;
+	_mapped = NULL;
+	_current = -1;
+	_writing = -1;
+}
+
+void DynamicBuffer::wait(int region) {
+	if (!_fences[region]) return;
+	GLenum status = _gl->glClientWaitSync(_fences[region], 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		_nbStalls++;
+		do {
+			status = _gl->glClientWaitSync(_fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, kWaitSlice);
+		} while (status == GL_TIMEOUT_EXPIRED);
+	}
+	_gl->glDeleteSync(_fences[region]);
+	_fences[region] = 0;
+}
+
+void* DynamicBuffer::beginWrite() {
+	if (_buffer == 0) return NULL;
+	if (_writing >= 0) endWrite();
+	int region = (_current + 1) % kRegions;
+	wait(region);
+	if (_persistent) {
+		_writing = region;
+		return _mapped + region * _regionBytes;
+	}
+	_gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+	void* p = _gl->glMapBufferRange(GL_ARRAY_BUFFER, region * _regionBytes, _regionBytes,
+	                                GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	_gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (p != NULL) _writing = region;
+	return p;
+}
+
+size_t DynamicBuffer::endWrite() {
+	if (_writing < 0) return (_current < 0) ? 0 : _current * _regionBytes;
+	if (!_persistent) {
+		_gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+		_gl->glUnmapBuffer(GL_ARRAY_BUFFER);
+		_gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	_current = _writing;
+	_writing = -1;
+	return _current * _regionBytes;
+}
+
+size_t DynamicBuffer::write(const void* data, size_t bytes) {
+	void* p = beginWrite();
+	if (p != NULL) {
+		memcpy(p, data, bytes);
+		return endWrite();
+	}
+	if (_buffer == 0) return 0;
+	// Already waited for by beginWrite
+	_current = (_current + 1) % kRegions;
+	_gl->glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+	_gl->glBufferSubData(GL_ARRAY_BUFFER, _current * _regionBytes, bytes, data);
+	_gl->glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return _current * _regionBytes;
+}
+
+void DynamicBuffer::fence() {
+	if (_current < 0) return;
+	// Drawn again : the last draws are the ones to wait for
+	if (_fences[_current]) _gl->glDeleteSync(_fences[_current]);
+	_fences[_current] = _gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,57 @@
+#ifndef _DYNAMICBUFFER_H_
+#define _DYNAMICBUFFER_H_
+
+#include "openglwindow.h"
+
+// Buffer rewritten every frame, without reallocating it nor waiting for the
+// draws of the frame before : kRegions regions of one buffer used in turn,
+// the CPU writing the next while the GPU reads the previous ones. A fence
+// after the draws reading a region guards it until it comes round again.
+// With glBufferStorage (GL 4.4) the buffer stays mapped, persistent and
+// coherent, and writes go straight to it. Otherwise each region is mapped
+// unsynchronized for the time of its writes, the fences doing the waiting.
+class DynamicBuffer {
+public :
+	static const int kRegions = 3;
+
+	DynamicBuffer();
+
+	// Regions of at least bytes each, the buffer made again if they are
+	// smaller; contents are lost. Needs the context to be current.
+	void allocate(OpenGLFunctions* gl, size_t bytes);
+	void destroy();
+	bool isCreated() const { return _buffer != 0; }
+	bool isPersistent() const { return _persistent; }
+	GLuint bufferId() const { return _buffer; }
+	// Waits that had to block, since allocate
+	int nbStalls() const { return _nbStalls; }
+
+	// Next region, once the GPU is done with it : NULL if it cannot be mapped
+	void* beginWrite();
+	// Ends the writes to the region, from now on the current one. Returns its
+	// offset in the buffer, for the attribute pointers.
+	size_t endWrite();
+	// beginWrite, copy and endWrite; a region that cannot be mapped is
+	// written by glBufferSubData instead
+	size_t write(const void* data, size_t bytes);
+	// After the draws reading the current region
+	void fence();
+
+private :
+	DynamicBuffer(const DynamicBuffer &);
+	DynamicBuffer & operator=(const DynamicBuffer &);
+
+	void wait(int region);
+
+	OpenGLFunctions* _gl;
+	GLuint _buffer;
+	size_t _regionBytes;
+	bool _persistent;
+	char* _mapped;				// whole buffer when persistent
+	GLsync _fences[kRegions];
+	int _current;				// region drawn, -1 before the first write
+	int _writing;				// region mapped by beginWrite, -1 otherwise
+	int _nbStalls;
+};
+
+#endif
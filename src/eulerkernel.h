@@ -0,0 +1,138 @@
+#ifndef _EULERKERNEL_H_
+#define _EULERKERNEL_H_
+
+#include "joint.h"
+#include <cmath>
+
+// Closed-form rotation matrices from Euler angles, one kernel per
+// RotateOrder. The order names the product : roZYX is Rz * Ry * Rx, which
+// is what a joint with channels "Zrotation Yrotation Xrotation" means.
+//
+// Entries are written row-major, r[k * stride] being entry (k / 3, k % 3),
+// so the same kernel fills one matrix (stride 1) or lane i of a batch of
+// structure-of-arrays matrices (stride kEulerBatch), which vectorizes.
+
+template<RotateOrder O> struct EulerKernel;
+
+template<> struct EulerKernel<roXYZ> {
+	static inline void rotation(float cx, float sx, float cy, float sy, float cz, float sz, float* r, int stride) {
+		r[0 * stride] = cy * cz;				r[1 * stride] = -cy * sz;				r[2 * stride] = sy;
+		r[3 * stride] = sx * sy * cz + cx * sz;	r[4 * stride] = cx * cz - sx * sy * sz;	r[5 * stride] = -sx * cy;
+		r[6 * stride] = sx * sz - cx * sy * cz;	r[7 * stride] = cx * sy * sz + sx * cz;	r[8 * stride] = cx * cy;
+	}
+};
+
+template<> struct EulerKernel<roYZX> {
+	static inline void rotation(float cx, float sx, float cy, float sy, float cz, float sz, float* r, int stride) {
+		r[0 * stride] = cy * cz;				r[1 * stride] = sx * sy - cx * cy * sz;	r[2 * stride] = cx * sy + sx * cy * sz;
+		r[3 * stride] = sz;						r[4 * stride] = cx * cz;				r[5 * stride] = -sx * cz;
+		r[6 * stride] = -sy * cz;				r[7 * stride] = cx * sy * sz + sx * cy;	r[8 * stride] = cx * cy - sx * sy * sz;
+	}
+};
+
+template<> struct EulerKernel<roZXY> {
+	static inline void rotation(float cx, float sx, float cy, float sy, float cz, float sz, float* r, int stride) {
+		r[0 * stride] = cy * cz - sx * sy * sz;	r[1 * stride] = -cx * sz;				r[2 * stride] = sy * cz + sx * cy * sz;
+		r[3 * stride] = cy * sz + sx * sy * cz;	r[4 * stride] = cx * cz;				r[5 * stride] = sy * sz - sx * cy * cz;
+		r[6 * stride] = -cx * sy;				r[7 * stride] = sx;						r[8 * stride] = cx * cy;
+	}
+};
+
+template<> struct EulerKernel<roXZY> {
+	static inline void rotation(float cx, float sx, float cy, float sy, float cz, float sz, float* r, int stride) {
+		r[0 * stride] = cy * cz;				r[1 * stride] = -sz;					r[2 * stride] = sy * cz;
+		r[3 * stride] = cx * cy * sz + sx * sy;	r[4 * stride] = cx * cz;				r[5 * stride] = cx * sy * sz - sx * cy;
+		r[6 * stride] = sx * cy * sz - cx * sy;	r[7 * stride] = sx * cz;				r[8 * stride] = sx * sy * sz + cx * cy;
+	}
+};
+
+template<> struct EulerKernel<roYXZ> {
+	static inline void rotation(float cx, float sx, float cy, float sy, float cz, float sz, float* r, int stride) {
+		r[0 * stride] = cy * cz + sx * sy * sz;	r[1 * stride] = sx * sy * cz - cy * sz;	r[2 * stride] = cx * sy;
+		r[3 * stride] = cx * sz;				r[4 * stride] = cx * cz;				r[5 * stride] = -sx;
+		r[6 * stride] = sx * cy * sz - sy * cz;	r[7 * stride] = sy * sz + sx * cy * cz;	r[8 * stride] = cx * cy;
+	}
+};
+
+template<> struct EulerKernel<roZYX> {
+	static inline void rotation(float cx, float sx, float cy, float sy, float cz, float sz, float* r, int stride) {
+		r[0 * stride] = cy * cz;				r[1 * stride] = sx * sy * cz - cx * sz;	r[2 * stride] = cx * sy * cz + sx * sz;
+		r[3 * stride] = cy * sz;				r[4 * stride] = cx * cz + sx * sy * sz;	r[5 * stride] = cx * sy * sz - sx * cz;
+		r[6 * stride] = -sy;					r[7 * stride] = sx * cy;				r[8 * stride] = cx * cy;
+	}
+};
+
+const int kEulerBatch = 16;
+
+// Rotations of n <= kEulerBatch joints sharing the same order, angles in
+// degrees : r[k][i] is entry k of joint i
+template<RotateOrder O>
+void eulerBatch(int n, const float* rx, const float* ry, const float* rz, float r[9][kEulerBatch]) {
+	const float degToRad = float(M_PI / 180);
+	float cx[kEulerBatch], sx[kEulerBatch], cy[kEulerBatch], sy[kEulerBatch], cz[kEulerBatch], sz[kEulerBatch];
+	for (int i = 0; i < n; i++) {
+		cx[i] = std::cos(rx[i] * degToRad);
+		sx[i] = std::sin(rx[i] * degToRad);
+		cy[i] = std::cos(ry[i] * degToRad);
+		sy[i] = std::sin(ry[i] * degToRad);
+		cz[i] = std::cos(rz[i] * degToRad);
+		sz[i] = std::sin(rz[i] * degToRad);
+	}
+	#pragma omp simd
+	for (int i = 0; i < n; i++) {
+		EulerKernel<O>::rotation(cx[i], sx[i], cy[i], sy[i], cz[i], sz[i], &r[0][i], kEulerBatch);
+	}
+}
+
+// Run-time order, dispatched once per batch
+inline void eulerBatch(RotateOrder order, int n, const float* rx, const float* ry, const float* rz, float r[9][kEulerBatch]) {
+	switch (order) {
+		case roXYZ: eulerBatch<roXYZ>(n, rx, ry, rz, r); break;
+		case roYZX: eulerBatch<roYZX>(n, rx, ry, rz, r); break;
+		case roZXY: eulerBatch<roZXY>(n, rx, ry, rz, r); break;
+		case roXZY: eulerBatch<roXZY>(n, rx, ry, rz, r); break;
+		case roYXZ: eulerBatch<roYXZ>(n, rx, ry, rz, r); break;
+		case roZYX: eulerBatch<roZYX>(n, rx, ry, rz, r); break;
+	}
+}
+
+// One rotation, angles in degrees
+inline void eulerRotation(RotateOrder order, float rx, float ry, float rz, float* r, int stride = 1) {
+	const float degToRad = float(M_PI / 180);
+	float cx = std::cos(rx * degToRad), sx = std::sin(rx * degToRad);
+	float cy = std::cos(ry * degToRad), sy = std::sin(ry * degToRad);
+	float cz = std::cos(rz * degToRad), sz = std::sin(rz * degToRad);
+	switch (order) {
+		case roXYZ: EulerKernel<roXYZ>::rotation(cx, sx, cy, sy, cz, sz, r, stride); break;
+		case roYZX: EulerKernel<roYZX>::rotation(cx, sx, cy, sy, cz, sz, r, stride); break;
+		case roZXY: EulerKernel<roZXY>::rotation(cx, sx, cy, sy, cz, sz, r, stride); break;
+		case roXZY: EulerKernel<roXZY>::rotation(cx, sx, cy, sy, cz, sz, r, stride); break;
+		case roYXZ: EulerKernel<roYXZ>::rotation(cx, sx, cy, sy, cz, sz, r, stride); break;
+		case roZYX: EulerKernel<roZYX>::rotation(cx, sx, cy, sy, cz, sz, r, stride); break;
+	}
+}
+
+// Order of the rotation channels of a joint, from their types in file order.
+// Axes without a channel do not rotate and are put last.
+inline RotateOrder rotateOrderFromChannels(const unsigned char* types, int nb) {
+	int axes[3];
+	int n = 0;
+	bool used[3] = {false, false, false};
+	for (int c = 0; c < nb; c++) {
+		if (types[c] < chXrot || types[c] > chZrot) continue;
+		int axis = types[c] - chXrot;
+		if (!used[axis] && n < 3) {
+			used[axis] = true;
+			axes[n++] = axis;
+		}
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		if (!used[axis]) axes[n++] = axis;
+	}
+	// Orders by axis sequence, X=0 Y=1 Z=2
+	if (axes[0] == 0) return axes[1] == 1 ? roXYZ : roXZY;
+	if (axes[0] == 1) return axes[1] == 2 ? roYZX : roYXZ;
+	return axes[1] == 0 ? roZXY : roZYX;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _FNVHASH_H_
+#define _FNVHASH_H_
+
+#include <cstddef>
+#include <stdint.h>
+
+// 64 bit FNV-1a, to tell whether the source of a cache file changed. Data
+// in several pieces is hashed by passing the hash of the pieces before.
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+
+inline uint64_t fnv1a(const char* data, size_t size, uint64_t h = kFnvOffset) {
+	for (size_t i = 0; i < size; i++) {
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+#endif
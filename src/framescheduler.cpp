@@ -0,0 +1,74 @@
+#include "framescheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Used when the file gives no usable Frame Time
+const double kDefaultFrameTime = 1.0 / 30;
+
+inline double elapsedMs(FrameScheduler::Clock::time_point from, FrameScheduler::Clock::time_point to) {
+	return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+}
+
+FrameScheduler::FrameScheduler() : _running(false), _frameTime(kDefaultFrameTime), _nbFrames(1), _startFrame(0),
+                                   _frame(0), _alpha(0), _lastIndex(0), _next(0) {
+	_stats = FrameStats();
+}
+
+void FrameScheduler::start(double frameTime, int nbFrames, int startFrame) {
+	_frameTime = (frameTime > 0) ? frameTime : kDefaultFrameTime;
+	_nbFrames = std::max(nbFrames, 1);
+	_startFrame = startFrame % _nbFrames;
+	_frame = _startFrame;
+	_alpha = 0;
+	_lastIndex = 0;
+	_start = _lastTick = Clock::now();
+	_next = 0;
+	_stats = FrameStats();
+	_running = true;
+}
+
+void FrameScheduler::stop() {
+	_running = false;
+}
+
+void FrameScheduler::tick() {
+	if (!_running) return;
+	Clock::time_point now = Clock::now();
+	if (_stats.rendered > 0) record(elapsedMs(_lastTick, now));
+	_stats.rendered++;
+	_lastTick = now;
+
+	double position = elapsedMs(_start, now) / (1000 * _frameTime);
+	long long index = (long long)position;
+	// More than one frame since the last tick : the ones in between are dropped
+	if (index > _lastIndex + 1) _stats.skipped += index - _lastIndex - 1;
+	_lastIndex = index;
+	_frame = (int)((_startFrame + index) % _nbFrames);
+	_alpha = (float)(position - index);
+}
+
+int FrameScheduler::msToNextFrame() const {
+	if (!_running) return 0;
+	double nextMs = (_lastIndex + 1) * 1000 * _frameTime;
+	return std::max(0, (int)std::ceil(nextMs - elapsedMs(_start, Clock::now())));
+}
+
+void FrameScheduler::record(double intervalMs) {
+	_intervals[_next] = intervalMs;
+	_next = (_next + 1) % FrameStats::kWindow;
+	_stats.count = std::min(_stats.count + 1, FrameStats::kWindow);
+	_stats.lastMs = intervalMs;
+	double sum = 0;
+	_stats.minMs = _stats.maxMs = intervalMs;
+	for (int i = 0; i < _stats.count; i++) {
+		sum += _intervals[i];
+		_stats.minMs = std::min(_stats.minMs, _intervals[i]);
+		_stats.maxMs = std::max(_stats.maxMs, _intervals[i]);
+	}
+	_stats.meanMs = sum / _stats.count;
+}
@@ -0,0 +1,61 @@
+#ifndef _FRAMESCHEDULER_H_
+#define _FRAMESCHEDULER_H_
+
+#include <chrono>
+
+// Render interval statistics, over the last kWindow rendered frames
+struct FrameStats {
+	static const int kWindow = 120;
+	int count;				// intervals in the window
+	double lastMs;
+	double meanMs;
+	double minMs;
+	double maxMs;
+	long long rendered;		// frames rendered since start()
+	long long skipped;		// animation frames never shown since start()
+};
+
+// Plays an animation in real time whatever the display rate.
+// The animation clock is the wall clock (steady_clock) scaled by the .bvh
+// Frame Time : each tick() tells which frame to show, with the fraction
+// towards the next one for interpolation. When rendering falls behind, the
+// frames in between are skipped rather than slowing the animation down.
+class FrameScheduler {
+public :
+	typedef std::chrono::steady_clock Clock;
+
+	FrameScheduler();
+
+	// Starts playing from startFrame (frameTime in seconds)
+	void start(double frameTime, int nbFrames, int startFrame = 0);
+	void stop();
+	bool isRunning() const { return _running; }
+
+	// To be called once per rendered frame : advances to the current time
+	void tick();
+	int frame() const { return _frame; }
+	int nextFrame() const { return (_frame + 1) % _nbFrames; }
+	float alpha() const { return _alpha; }	// in [0, 1[, towards nextFrame()
+	// Wall time until the shown frame changes, to sleep in between
+	int msToNextFrame() const;
+
+	const FrameStats & stats() const { return _stats; }
+
+private :
+	void record(double intervalMs);
+
+	bool _running;
+	double _frameTime;
+	int _nbFrames;
+	int _startFrame;
+	int _frame;
+	float _alpha;
+	long long _lastIndex;		// frames elapsed since start at the last tick
+	Clock::time_point _start;
+	Clock::time_point _lastTick;
+	double _intervals[FrameStats::kWindow];
+	int _next;
+	FrameStats _stats;
+};
+
+#endif
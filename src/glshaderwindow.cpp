@@ -1,6 +1,9 @@
 #include "glshaderwindow.h"
+#include "bvhcache.h"
+#include "weightfile.h"
 
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QMessageBox>
 #include <QPixmap>
 #include <QScreen>
@@ -17,12 +20,14 @@
 #include <QComboBox>
 #include <QDebug>
 #include <assert.h>
-#include <ctime>
-#include <chrono>
-#include <thread>
+#include <limits.h>
+#include <float.h>
+#include <string.h>
 
 
 #include <fstream>
+#include <algorithm>
+#include <chrono>
 
 #include "perlinNoise.h" // defines tables for Perlin Noise
 
@@ -30,17 +35,86 @@
 
 bool full_shader = true;
 
+// Skinning in the vertex shaders : fixed attribute locations, so that every
+// program drawing m_vao finds the influences at the same place
+static const GLuint kSkinJointsLocation = 14;
+static const GLuint kSkinWeightsLocation = 15;
+// Size of the JointPalette block of the shaders, 16KB
+static const int kMaxPaletteJoints = 256;
+static const GLuint kJointPaletteBinding = 0;
+static const GLuint kFrameParametersBinding = 1;
+
+// Attributes of the program read from the PackedVertex buffer bound
+static void setPackedAttributes(QOpenGLShaderProgram* program, bool colors, bool texcoords)
+{
+    const int stride = sizeof(PackedVertex);
+    program->setAttributeBuffer("vertex", GL_UNSIGNED_SHORT, PackedMesh::kPositionOffset, 4, stride);
+    program->enableAttributeArray("vertex");
+    program->setAttributeBuffer("normal", GL_INT_2_10_10_10_REV, PackedMesh::kNormalOffset, 4, stride);
+    program->enableAttributeArray("normal");
+    if (colors) {
+        program->setAttributeBuffer("color", GL_UNSIGNED_BYTE, PackedMesh::kColorOffset, 4, stride);
+        program->enableAttributeArray("color");
+    }
+    if (texcoords) {
+        program->setAttributeBuffer("texcoords", GL_HALF_FLOAT, PackedMesh::kTexcoordOffset, 2, stride);
+        program->enableAttributeArray("texcoords");
+    }
+}
+
+// Positions read as bias + scale * vertex : quantized over the bounding box
+// of mesh, or floats when mesh is NULL
+static void setPositionTransform(QOpenGLShaderProgram* program, const UniformLocations & uniforms, const PackedMesh* mesh)
+{
+    if (mesh) {
+        const float* bias = mesh->bias();
+        const float* scale = mesh->scale();
+        program->setUniformValue(uniforms.positionBias, QVector3D(bias[0], bias[1], bias[2]));
+        program->setUniformValue(uniforms.positionScale, QVector3D(scale[0], scale[1], scale[2]));
+    } else {
+        program->setUniformValue(uniforms.positionBias, QVector3D(0, 0, 0));
+        program->setUniformValue(uniforms.positionScale, QVector3D(1, 1, 1));
+    }
+}
+
+void UniformLocations::resolve(QOpenGLShaderProgram* program)
+{
+    matrix = program->uniformLocation("matrix");
+    perspective = program->uniformLocation("perspective");
+    worldToLightspace = program->uniformLocation("worldToLightspace");
+    shadowMap = program->uniformLocation("shadowMap");
+    k_a = program->uniformLocation("k_a");
+    k_d = program->uniformLocation("k_d");
+    skinning = program->uniformLocation("skinning");
+    weightJoint = program->uniformLocation("weightJoint");
+    colorTexture = program->uniformLocation("colorTexture");
+    envMap = program->uniformLocation("envMap");
+    permTexture = program->uniformLocation("permTexture");
+    computeResult = program->uniformLocation("computeResult");
+    positionBias = program->uniformLocation("positionBias");
+    positionScale = program->uniformLocation("positionScale");
+    bbmin = program->uniformLocation("bbmin");
+    bbmax = program->uniformLocation("bbmax");
+    skinnedBounds = program->uniformLocation("skinnedBounds");
+    groundDistance = program->uniformLocation("groundDistance");
+    framebuffer = program->uniformLocation("framebuffer");
+}
+
 glShaderWindow::glShaderWindow(QWindow *parent)
 // Initialize obvious default values here (e.g. 0 for pointers)
     : OpenGLWindow(parent), modelMesh(0),
-      m_program(0), ground_program(0),joint_program(0), compute_program(0), shadowMapGenerationProgram(0),
+      m_program(0), ground_program(0),joint_program(0), compute_program(0), shadowMapGenerationProgram(0), skinning_program(0),
       g_vertices(0), g_normals(0), g_texcoords(0), g_colors(0), g_indices(0),
-      j_vertices(0), j_colors(0), j_indices(0), j_initialSkinningData(0),j_vertTransMatrix(0),
+      j_vertices(0), j_colors(0), j_indices(0), j_vertTransMatrix(0),
       gpgpu_vertices(0), gpgpu_normals(0), gpgpu_texcoords(0), gpgpu_colors(0), gpgpu_indices(0),
       environmentMap(0), texture(0), permTexture(0), pixels(0), mouseButton(Qt::NoButton), auxWidget(0),
       isGPGPU(false), hasComputeShaders(false), blinnPhong(true), transparent(true), kr(0.2), eta(1.5), bounces(2), lightIntensity(1.0f), shininess(50.0f), lightDistance(5.0f), groundDistance(0.78),
       shadowMap_fboId(0), shadowMap_rboId(0), shadowMap_textureId(0), fullScreenSnapshots(false), m_skeleton(NULL), m_frameTime(0),
-      m_indexBuffer(QOpenGLBuffer::IndexBuffer), ground_indexBuffer(QOpenGLBuffer::IndexBuffer), joint_indexBuffer(QOpenGLBuffer::IndexBuffer), m_frameNb(0), m_maxFrameNb(0), m_timePrevFram(0), m_animated(false), j_weightedJointNb(0), m_animatedMesh(0), _shift(false)
+      m_indexBuffer(QOpenGLBuffer::IndexBuffer), ground_indexBuffer(QOpenGLBuffer::IndexBuffer), joint_indexBuffer(QOpenGLBuffer::IndexBuffer), m_frameNb(0), m_maxFrameNb(0), m_animated(false), m_interpolate(false), j_weightedJointNb(-1), m_animatedMesh(0), _shift(false),
+      m_gpuSkinning(true), m_skinAttributesStale(true), m_skinWeightsStale(true),
+      m_skinLodEnabled(false), m_lodLevel(0), m_lodSkipped(0), m_jointPaletteStale(true), m_jointPaletteUbo(0), m_packedPositions(true),
+      m_optimizeTriangles(true), m_drawQuery(0), m_drawQueryPending(false), m_drawMs(0), m_drawSamples(0),
+      m_frameUbo(0), m_linkMs(0), m_renderMs(0), m_renderSamples(0)
 {
     // Default values you might want to tinker with
     shadowMapDimension = 2048;
@@ -51,11 +125,19 @@ glShaderWindow::glShaderWindow(QWindow *parent)
     m_fragShaderSuffix << "*.frag" << "*.fs";
     m_vertShaderSuffix << "*.vert" << "*.vs";
     m_compShaderSuffix << "*.comp" << "*.cs";
+
+    for (int i = 0; i < 4; i++) ssbo[i] = 0;
+    for (int i = 0; i < 5; i++) skin_ssbo[i] = 0;
+
+    m_frameTimer.setSingleShot(true);
+    m_frameTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_frameTimer, SIGNAL(timeout()), this, SLOT(renderLater()));
 }
 
 glShaderWindow::~glShaderWindow()
 {
     if (modelMesh) delete modelMesh;
+    if (m_skeleton) delete m_skeleton;
     if (m_program) {
         m_program->release();
         delete m_program;
@@ -76,31 +158,29 @@ glShaderWindow::~glShaderWindow()
         compute_program->release();
         delete compute_program;
     }
+    if (skinning_program) delete skinning_program;
+    if (skin_ssbo[0]) glDeleteBuffers(5, skin_ssbo);
     if (shadowMap_textureId) glDeleteTextures(1, &shadowMap_textureId);
     if (shadowMap_fboId) glDeleteFramebuffers(1, &shadowMap_fboId);
     if (shadowMap_rboId) glDeleteRenderbuffers(1, &shadowMap_rboId);
+    if (m_jointPaletteUbo) glDeleteBuffers(1, &m_jointPaletteUbo);
+    if (m_drawQuery) glDeleteQueries(1, &m_drawQuery);
+    if (m_frameUbo) glDeleteBuffers(1, &m_frameUbo);
+    m_meshRing.destroy();
+    m_jointRing.destroy();
     if (pixels) delete [] pixels;
     m_vertexBuffer.release();
     m_vertexBuffer.destroy();
     m_indexBuffer.release();
     m_indexBuffer.destroy();
-    m_colorBuffer.release();
-    m_colorBuffer.destroy();
-    m_normalBuffer.release();
-    m_normalBuffer.destroy();
-    m_texcoordBuffer.release();
-    m_texcoordBuffer.destroy();
+    m_skinJointBuffer.destroy();
+    m_skinWeightBuffer.destroy();
     m_vao.release();
     m_vao.destroy();
     ground_vertexBuffer.release();
     ground_vertexBuffer.destroy();
     ground_indexBuffer.release();
     ground_indexBuffer.destroy();
-    ground_colorBuffer.destroy();
-    ground_normalBuffer.release();
-    ground_normalBuffer.destroy();
-    ground_texcoordBuffer.release();
-    ground_texcoordBuffer.destroy();
     ground_vao.release();
     ground_vao.destroy();
     joint_vertexBuffer.release();
@@ -147,12 +227,21 @@ void glShaderWindow::openNewBvhFile() {
     if (ret == QDialog::Accepted) {
         bvhfileName = dialog.selectedFiles()[0];
         if (!bvhfileName.isNull()) {
-            m_skeleton = Joint::createFromFile(bvhfileName.toStdString(), j_numPoints, j_numIndices, m_maxFrameNb, m_frameTime);
+            Skeleton* skeleton = BvhCache::load(bvhfileName.toStdString());
+            if (skeleton == NULL) return;
+            if (m_skeleton) delete m_skeleton;
+            m_skeleton = skeleton;
+            m_vertexCache.close();
+            j_numPoints = m_skeleton->nbJoints();
+            j_weightedJointNb = -1;
+            j_numIndices = (j_numPoints - 1) * 2;
+            m_maxFrameNb = m_skeleton->nbFrames();
+            m_frameTime = m_skeleton->frameTime();
+            if (m_animated) m_scheduler.start(m_frameTime, m_maxFrameNb);
+            if (!m_bake.bake(*m_skeleton)) {
+                std::cout << "Animation not baked, joints evaluated at each frame" << std::endl;
+            }
             //std::cout << "numPoints : " << j_numPoints << ", numIndices : " << j_numIndices << std::endl;
-            //m_skeleton->printDataStructure(0);
-            //m_skeleton->printDataStructure(1);
-            //m_skeleton->printDataStructure(2);
-            //m_skeleton->printDataStructure(3);
 			m_frameNb = 0;
 
             // Creation of j_indices
@@ -175,23 +264,13 @@ void glShaderWindow::openNewBvhFile() {
 
             // Init squelette position neutre
             m_skeleton->initPointPositions(j_vertices, meshCenterOfMass);
-
-            // Init tableau des poids
-            j_weightData = std::vector<std::vector<double>>(j_numPoints, std::vector<double>(modelMesh->vertices.size()));
+            j_bindVertices = j_vertices;
+            updateJointVertexArray();
 
             // Remplissage tableau des poids selon skinning rigide
             rigidSkinning();
 
-            for (int j = 0; j < modelMesh->vertices.size(); j++) {
-                for (int i = 0; i < j_weightData.size(); i++) {
-                    if (j_weightData[i][j] > 0.000001) {
-                        std::cout << j_weightData[i][j] << " ";
-                    }
-                }
-                std::cout << std::endl;
-            }
-
-			// Remplissage structure de données j_initialSkinningData (vector de vector d'objet(num_joint, translation pour y aller))
+			// Décalages des sommets aux articulations en position neutre
             fillSkinData();
 
 			printState();
@@ -200,133 +279,58 @@ void glShaderWindow::openNewBvhFile() {
 }
 
 void glShaderWindow::fillSkinData() {
-	j_initialSkinningData = std::vector<std::vector<skinningData>>();
-	// Remplissage structure de données j_initialSkinningData (vector de vector d'objet(num_joint, translation pour y aller))
-	for (int vertexId = 0; vertexId < modelMesh->vertices.size(); vertexId++) {
-		std::vector<skinningData> tmp;
-		for (int jointId = 0; jointId < j_vertices.size(); jointId++) {
-			if (j_weightData[jointId][vertexId] >= 0.00001) {
-				tmp.push_back(skinningData(jointId, modelMesh->vertices[vertexId] - j_vertices[jointId]));
-			}
-		}
-		j_initialSkinningData.push_back(tmp);
+	// Vertices sorted by their influences : the mesh is uploaded again in that order
+	if (m_vertexOrder.sort(modelMesh, m_skin)) {
+		if (compute_program) createSSBO();
+		bindSceneToProgram();
 	}
+	// Influences already chosen : only their offsets to the joints in bind pose
+	m_skin.bind(modelMesh->vertices, j_bindVertices);
+	SkinningEngine::batches(m_skin, m_skinBatches);
+	m_skinAttributesStale = true;
+	m_skinWeightsStale = true;
+	if (m_skinLodEnabled) m_skinLod.build(modelMesh->vertices, modelMesh->faces, m_skin);
+	else m_skinLod.clear();
+	m_lodLevel = 0;
 }
 
 
 
-// Parse dans j_weightData : j_weightData[i][j]->poids du joint i sur le vertex j
+// Poids dans m_skin : texte dense (une ligne par sommet, un poids par joint),
+// texte creux ou binaire, voir weightfile.h. Les lignes sont les sommets du fichier du modele
 void glShaderWindow::parseWeightFile(std::string fileName) {
-    std::ifstream inputfile(fileName.data());
-	if(inputfile.good()) {
-        std::string buf;	
-		inputfile >> buf;
-        for (int i = 0; i < j_numPoints; i++) {
-		    inputfile >> buf;
-        }
-        while(!inputfile.eof()) {
-			inputfile >> buf;
-			if (inputfile.eof()) {
-				break;
-			}
-
-            int num_vertice = std::stoi(buf);
-
-            for (int i = 0; i < j_numPoints; i++) {
-			    inputfile >> buf;
-                j_weightData[i][num_vertice] = std::stof(buf);
-            }
-        }
-		inputfile.close();
-	} else {
+	SkinInfluences fileSkin;
+	if (!WeightFile::load(fileName, j_numPoints, modelMesh->vertices.size(), fileSkin)) {
 		std::cerr << "Failed to load the file " << fileName.data() << std::endl;
 		fflush(stdout);
-    }
+		return;
+	}
+	if (fileSkin.nbTruncated() > 0) {
+		std::cout << fileSkin.nbTruncated() << " vertices limited to their " << kMaxInfluences << " heaviest joints" << std::endl;
+	}
+	m_skin.copyVertices(fileSkin, m_vertexOrder.fileVertices());
 	fillSkinData();
     std::cout << "weight file loaded" << std::endl;
 }
 
+// Chaque sommet suit l'articulation de l'os le plus proche
 void glShaderWindow::rigidSkinning() {
-    for (int j = 0; j < modelMesh->vertices.size(); j++) {
-        double distanceMin = std::numeric_limits<double>::max();
-        int iMin = 0;
-        for (int i = 0; i < j_vertices.size(); i++) {
-            j_weightData[i][j] = 0;
-            double dist = trimesh::dist(j_vertices[i], modelMesh->vertices[j]);
-            if (dist < distanceMin) {
-                distanceMin = dist;
-                iMin = i;
-            }
-        }
-        j_weightData[iMin][j] = 1;
-    }
+    if (j_bindVertices.empty() || m_skeleton == NULL) return;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    m_binding.build(*m_skeleton, j_bindVertices);
+    m_binding.bindRigid(modelMesh->vertices, m_skin);
+    std::cout << "Rigid weights of " << m_skin.nbVertices() << " vertices in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
 }
 
+// Chaque sommet suit les SMOOTH_SKINNING_ART_NB articulations des os les plus proches
 void glShaderWindow::smoothSkinning() {
-    struct DistancesMin {
-        std::vector<std::pair<int, double>> data;
-        DistancesMin(std::vector<std::pair<int, double>> d) : data(d) { }
-        void replace(int iMax, std::pair<int, double> newPair) {
-            data[iMax] = newPair;
-        }
-        std::pair<int, double> getMaxDistance() {
-            double distanceMax = 0;
-            int iMax = 0;
-            for (int i = 0; i < data.size(); i++) {
-                if (data[i].second > distanceMax) {
-                    distanceMax = data[i].second;
-                    iMax = i;
-                }
-            }
-            return std::pair<int, double>(iMax, distanceMax);
-        }
-        void normalize() {
-            double sum = 0;
-            for (int i = 0; i < data.size(); i++) {
-                sum += data[i].second;
-            }
-            for (int i = 0; i < data.size(); i++) {
-                data[i].second /= sum;
-            }
-        }
-        void generateWeights() {
-            normalize();
-            for (int i = 0; i < data.size(); i++) {
-                data[i].second = 1 - data[i].second;
-            }
-            normalize();
-        }
-        void print() {
-            std::cout << "PRINT" << std::endl;
-            for (int i = 0; i < data.size(); i++) {
-                std::cout << data[i].first << " " << data[i].second << std::endl;
-            }
-        }
-    };
-
-    for (int j = 0; j < modelMesh->vertices.size(); j++) {
-        std::vector<std::pair<int, double>> distancesMin = std::vector<std::pair<int, double>>(SMOOTH_SKINNING_ART_NB);
-        DistancesMin smallest_dists = DistancesMin(distancesMin);
-        for (int i = 0; i < SMOOTH_SKINNING_ART_NB; i++) {
-            j_weightData[i][j] = 0;
-            double dist = trimesh::dist(j_vertices[i], modelMesh->vertices[j]);
-            smallest_dists.data[i] = std::pair<int, double>(i, dist);
-        }
-        for (int i = SMOOTH_SKINNING_ART_NB; i < j_vertices.size(); i++) {
-            j_weightData[i][j] = 0;
-            std::pair<int, double> maxOfMins = smallest_dists.getMaxDistance();
-            double dist = trimesh::dist(j_vertices[i], modelMesh->vertices[j]);
-
-            if (dist < maxOfMins.second) {
-                smallest_dists.replace(maxOfMins.first, std::pair<int, double>(i, dist));
-            }
-        }
-        smallest_dists.generateWeights();
-
-        for (int i = 0; i < SMOOTH_SKINNING_ART_NB; i++) {
-            j_weightData[smallest_dists.data[i].first][j] = smallest_dists.data[i].second;
-        }
-    }
+    if (j_bindVertices.size() < SMOOTH_SKINNING_ART_NB || m_skeleton == NULL) return;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    m_binding.build(*m_skeleton, j_bindVertices);
+    m_binding.bindSmooth(modelMesh->vertices, SMOOTH_SKINNING_ART_NB, m_skin);
+    std::cout << "Smooth weights of " << m_skin.nbVertices() << " vertices in "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
 }
 
 trimesh::point glShaderWindow::getMeshCenter() {
@@ -335,6 +339,7 @@ trimesh::point glShaderWindow::getMeshCenter() {
         centerOfMass += modelMesh->vertices[i];
     }
     centerOfMass /= modelMesh->vertices.size();
+    return centerOfMass;
 }
 
 void glShaderWindow::openNewWeightFile() {
@@ -342,7 +347,7 @@ void glShaderWindow::openNewWeightFile() {
         std::cerr << "No bvh loaded, load one before loading its weights" << std::endl;
         return;
     }
-    QFileDialog dialog(0, "Open weight file", workingDirectory + "../animation/", "*.txt");
+    QFileDialog dialog(0, "Open weight file", workingDirectory + "../animation/", "*.txt *.skw");
     dialog.setAcceptMode(QFileDialog::AcceptOpen);
     QString weightFilename;
     int ret = dialog.exec();
@@ -353,53 +358,46 @@ void glShaderWindow::openNewWeightFile() {
             parseWeightFile(weightFilename.toStdString());
         }
     }
-
-    //displayWeightColor(j_weightedJointNb);
 }
 
-void glShaderWindow::animateMesh() {
-	for(int k = 0; k< modelMesh->vertices.size(); k++) {
-		trimesh::point p_i = trimesh::point(0,0,0,1);
-		assert(j_initialSkinningData[k].size() != 0 );
-		for(int i = 0; i<j_initialSkinningData[k].size();i++) {
-			int j_id = j_initialSkinningData[k][i].joint_id;
-			//compute p_ik thanks to saved matrice
-			trimesh::point p_ik = animatePoint(j_vertices[j_id], j_initialSkinningData[k][i]);
-			p_ik[3] = 1;
-			//combinaison lineaire
-			p_i += (float)j_weightData[j_id][k] * p_ik ;
+void glShaderWindow::animateMesh(trimesh::point* out) {
+	size_t nbVertices = m_animatedMesh.size();
+	if (m_vertexCache.isOpen()) {
+		// Frame already skinned, streamed from the cache
+		bool fetched;
+		if (m_vertexOrder.isFileOrder()) fetched = m_vertexCache.fetch(m_frameNb, out);
+		else {
+			// Frames in file order
+			m_lodScratch.resize(nbVertices);
+			fetched = m_vertexCache.fetch(m_frameNb, m_lodScratch.data());
+			const std::vector<int> & fileOf = m_vertexOrder.fileVertices();
+			if (fetched) for (size_t v = 0; v < nbVertices; v++) out[v] = m_lodScratch[fileOf[v]];
 		}
-		m_animatedMesh[k] = trimesh::point(p_i);
-		m_animatedMesh[k][3] = 1;
-		if(_shift){
-			m_animatedMesh[k] += trimesh::point(50,0,0,0);
+		if (!fetched) {
+			// Last frame kept on screen; skinning again once this one is drawn
+			std::cerr << "Damaged vertex cache at frame " << m_frameNb << ", skinning again" << std::endl;
+			m_vertexCache.close();
+			QTimer::singleShot(0, this, &glShaderWindow::restartSkinning);
+		}
+	} else {
+		// Combinaison lineaire des sommets transformés par chaque joint, sur tous les coeurs
+		m_skinning.setPose(j_vertTransMatrix.data(), j_vertTransMatrix.size());
+		if (lodActive()) m_skinLod.skin(m_lodLevel, m_skinning, out, m_lodScratch);
+		else m_skinning.skin(m_skin, m_skinBatches, out);
+	}
+	if(_shift){
+		for(size_t k = 0; k < nbVertices; k++) {
+			out[k] += trimesh::point(50,0,0,0);
 		}
 	}
 }
 
-trimesh::point glShaderWindow::animatePoint(trimesh::point p, skinningData data) {
-
-    glm::mat4 m_j = j_vertTransMatrix[data.joint_id];
-	return p + trimesh::point( m_j  * glm::vec4(data.translation[0],data.translation[1],data.translation[2],0));
-}
-
+// Weights of a joint (-1 : none) colored by the vertex shaders from the
+// influence attributes, uploaded once : only a uniform changes
 void glShaderWindow::displayWeightColor(int jointId) {
-
-    m_vao.bind();
-    std::vector<trimesh::Color> colors = std::vector<trimesh::Color>(j_weightData[jointId].size());
-    for(int i=0; i< j_weightData[jointId].size(); i++) {
-        colors[i] = trimesh::Color( j_weightData[jointId][i], 0.f, 0.f);
-    }
-    m_colorBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_colorBuffer.allocate(colors.data(), colors.size() * sizeof(trimesh::Color));
-
-    m_program->bind();
-    m_program->setAttributeBuffer( "color", GL_FLOAT, 0, 4 );
-    m_program->enableAttributeArray( "color" );
-    m_program->setUniformValue("noColor", false);
-    m_program->release();
-    m_vao.release();
-    renderNow();
+	j_weightedJointNb = jointId;
+	if (jointId >= 0) std::cout << "Weights of joint " << jointId << std::endl;
+	renderNow();
 }
 
 void glShaderWindow::openNewTexture() {
@@ -640,18 +638,18 @@ QWidget *glShaderWindow::makeAuxWindow()
 void glShaderWindow::createSSBO() 
 {
 #ifndef __APPLE__
-    glGenBuffers(4, ssbo);
+    if (!ssbo[0]) glGenBuffers(4, ssbo);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[0]);
     // TODO: test if 4 float alignment works better
-    glBufferData(GL_SHADER_STORAGE_BUFFER, modelMesh->vertices.size() * sizeof(trimesh::point), &(modelMesh->vertices.front()), GL_STATIC_READ);
+    // Vertices and normals are rewritten by the compute skinning when animated
+    glBufferData(GL_SHADER_STORAGE_BUFFER, modelMesh->vertices.size() * sizeof(trimesh::point), &(modelMesh->vertices.front()), GL_DYNAMIC_COPY);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[1]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, modelMesh->normals.size() * sizeof(trimesh::vec), &(modelMesh->normals.front()), GL_STATIC_READ);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, modelMesh->normals.size() * sizeof(trimesh::vec), &(modelMesh->normals.front()), GL_DYNAMIC_COPY);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[2]);
     glBufferData(GL_SHADER_STORAGE_BUFFER, modelMesh->colors.size() * sizeof(trimesh::Color), &(modelMesh->colors.front()), GL_STATIC_READ);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[3]);
     glBufferData(GL_SHADER_STORAGE_BUFFER, modelMesh->faces.size() * 3 * sizeof(int), &(modelMesh->faces.front()), GL_STATIC_READ);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-    compute_program->bind();
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssbo[0]);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, ssbo[1]);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, ssbo[2]);
@@ -696,79 +694,37 @@ void glShaderWindow::bindSceneToProgram()
         }
     } else m_numFaces = modelMesh->faces.size();
 
+    bool hasColors = isGPGPU || (modelMesh->colors.size() > 0);
+    bool hasTexcoords = isGPGPU || (modelMesh->texcoords.size() > 0);
+    if (!isGPGPU) m_packedMesh.pack(&(modelMesh->vertices.front()), &(modelMesh->normals.front()),
+                                    hasColors ? &(modelMesh->colors.front()[0]) : NULL,
+                                    hasTexcoords ? &(modelMesh->texcoords.front()) : NULL, modelMesh->vertices.size());
+    else m_packedMesh.pack(gpgpu_vertices, gpgpu_normals, &(gpgpu_colors[0][0]), gpgpu_texcoords, 4);
     m_vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
     m_vertexBuffer.bind();
-    if (!isGPGPU) m_vertexBuffer.allocate(&(modelMesh->vertices.front()), modelMesh->vertices.size() * sizeof(trimesh::point));
-    else m_vertexBuffer.allocate(gpgpu_vertices, 4 * sizeof(trimesh::point));
+    m_vertexBuffer.allocate(m_packedMesh.data(), m_packedMesh.bytes());
+    m_packedPositions = true;
 
     m_indexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
     m_indexBuffer.bind();
     if (!isGPGPU) m_indexBuffer.allocate(&(modelMesh->faces.front()), m_numFaces * 3 * sizeof(int));
     else m_indexBuffer.allocate(gpgpu_indices, m_numFaces * 3 * sizeof(int));
+    // All the triangles : back to the finest level of detail
+    m_lodLevel = 0;
+    m_lodSkipped = 0;
 
-    if (modelMesh->colors.size() > 0) {
-        m_colorBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-        m_colorBuffer.bind();
-        if (!isGPGPU) m_colorBuffer.allocate(&(modelMesh->colors.front()), modelMesh->colors.size() * sizeof(trimesh::Color));
-        else m_colorBuffer.allocate(gpgpu_colors, 4 * sizeof(trimesh::Color));
-    }
-
-    m_normalBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    m_normalBuffer.bind();
-    if (!isGPGPU) m_normalBuffer.allocate(&(modelMesh->normals.front()), modelMesh->normals.size() * sizeof(trimesh::vec));
-    else m_normalBuffer.allocate(gpgpu_normals, 4 * sizeof(trimesh::vec));
-
-    if ((modelMesh->texcoords.size() > 0) || isGPGPU) {
-        m_texcoordBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-        m_texcoordBuffer.bind();
-        if (!isGPGPU) m_texcoordBuffer.allocate(&(modelMesh->texcoords.front()), modelMesh->texcoords.size() * sizeof(trimesh::vec2));
-        else m_texcoordBuffer.allocate(gpgpu_texcoords, 4 * sizeof(trimesh::vec2));
-    }
     m_program->bind();
-    // Enable the "vertex" attribute to bind it to our vertex buffer
+    // All the attributes come from the interleaved vertices of m_vertexBuffer
     m_vertexBuffer.bind();
-    m_program->setAttributeBuffer( "vertex", GL_FLOAT, 0, 4 );
-    m_program->enableAttributeArray( "vertex" );
-
-    // Enable the "color" attribute to bind it to our colors buffer
-    if (modelMesh->colors.size() > 0) {
-        m_colorBuffer.bind();
-        m_program->setAttributeBuffer( "color", GL_FLOAT, 0, 4 );
-        m_program->enableAttributeArray( "color" );
-        m_program->setUniformValue("noColor", false);
-    } else {
-        m_program->setUniformValue("noColor", true);
-    }
-    m_normalBuffer.bind();
-    m_program->setAttributeBuffer( "normal", GL_FLOAT, 0, 4 );
-    m_program->enableAttributeArray( "normal" );
-
-    if ((modelMesh->texcoords.size() > 0) || isGPGPU){
-        m_texcoordBuffer.bind();
-        m_program->setAttributeBuffer( "texcoords", GL_FLOAT, 0, 2 );
-        m_program->enableAttributeArray( "texcoords" );
-    }
+    setPackedAttributes(m_program, hasColors, hasTexcoords);
+    m_program->setUniformValue("noColor", !hasColors);
     m_program->release();
     shadowMapGenerationProgram->bind();
-    // Enable the "vertex" attribute to bind it to our vertex buffer
-    m_vertexBuffer.bind();
-    shadowMapGenerationProgram->setAttributeBuffer( "vertex", GL_FLOAT, 0, 4 );
-    shadowMapGenerationProgram->enableAttributeArray( "vertex" );
-    if (modelMesh->colors.size() > 0) {
-        m_colorBuffer.bind();
-        shadowMapGenerationProgram->setAttributeBuffer( "color", GL_FLOAT, 0, 4 );
-        shadowMapGenerationProgram->enableAttributeArray( "color" );
-    }
-    m_normalBuffer.bind();
-    shadowMapGenerationProgram->setAttributeBuffer( "normal", GL_FLOAT, 0, 4 );
-    shadowMapGenerationProgram->enableAttributeArray( "normal" );
-    if (modelMesh->texcoords.size() > 0) {
-        m_texcoordBuffer.bind();
-        shadowMapGenerationProgram->setAttributeBuffer( "texcoords", GL_FLOAT, 0, 2 );
-        shadowMapGenerationProgram->enableAttributeArray( "texcoords" );
-    }
+    setPackedAttributes(shadowMapGenerationProgram, hasColors, hasTexcoords);
     shadowMapGenerationProgram->release();
     m_vao.release();
+    m_skinAttributesStale = true;
+    m_skinWeightsStale = true;
 
     // Bind ground VAO to ground program as well
     // We create a VAO for the ground from scratch
@@ -800,18 +756,10 @@ void glShaderWindow::bindSceneToProgram()
             //g_texcoords[p] = trimesh::vec2(g_vertices[p][0], g_vertices[p][2]);
         }
     }
+    m_packedGround.pack(g_vertices, g_normals, &(g_colors[0][0]), g_texcoords, g_numPoints);
     ground_vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
     ground_vertexBuffer.bind();
-    ground_vertexBuffer.allocate(g_vertices, g_numPoints * sizeof(trimesh::point));
-    ground_normalBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    ground_normalBuffer.bind();
-    ground_normalBuffer.allocate(g_normals, g_numPoints * sizeof(trimesh::vec));
-    ground_colorBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    ground_colorBuffer.bind();
-    ground_colorBuffer.allocate(g_colors, g_numPoints * sizeof(trimesh::point));
-    ground_texcoordBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    ground_texcoordBuffer.bind();
-    ground_texcoordBuffer.allocate(g_texcoords, g_numPoints * (sizeof(trimesh::vec2)+4));
+    ground_vertexBuffer.allocate(m_packedGround.data(), m_packedGround.bytes());
 
     g_numIndices = 0;
     for (int i = 0; i < numR - 1; i++) {
@@ -832,35 +780,13 @@ void glShaderWindow::bindSceneToProgram()
 
     ground_program->bind();
     ground_vertexBuffer.bind();
-    ground_program->setAttributeBuffer( "vertex", GL_FLOAT, 0, 4 );
-    ground_program->enableAttributeArray( "vertex" );
-    ground_colorBuffer.bind();
-    ground_program->setAttributeBuffer( "color", GL_FLOAT, 0, 4 );
-    ground_program->enableAttributeArray( "color" );
-    ground_normalBuffer.bind();
-    ground_program->setAttributeBuffer( "normal", GL_FLOAT, 0, 4 );
-    ground_program->enableAttributeArray( "normal" );
+    setPackedAttributes(ground_program, true, true);
     ground_program->setUniformValue("noColor", false);
-    ground_texcoordBuffer.bind();
-    ground_program->setAttributeBuffer( "texcoords", GL_FLOAT, 0, 2 );
-    ground_program->enableAttributeArray( "texcoords" );
     ground_program->release();
     // Also bind the ground to the shadow mapping program:
     shadowMapGenerationProgram->bind();
-    ground_vertexBuffer.bind();
-    shadowMapGenerationProgram->setAttributeBuffer( "vertex", GL_FLOAT, 0, 4 );
-    shadowMapGenerationProgram->enableAttributeArray( "vertex" );
+    setPackedAttributes(shadowMapGenerationProgram, true, true);
     shadowMapGenerationProgram->release();
-    ground_colorBuffer.bind();
-    shadowMapGenerationProgram->setAttributeBuffer( "color", GL_FLOAT, 0, 4 );
-    shadowMapGenerationProgram->enableAttributeArray( "color" );
-    ground_normalBuffer.bind();
-    shadowMapGenerationProgram->setAttributeBuffer( "normal", GL_FLOAT, 0, 4 );
-    shadowMapGenerationProgram->enableAttributeArray( "normal" );
-    ground_texcoordBuffer.bind();
-    shadowMapGenerationProgram->setAttributeBuffer( "texcoords", GL_FLOAT, 0, 2 );
-    shadowMapGenerationProgram->enableAttributeArray( "texcoords" );
-    ground_program->release();
     ground_vao.release();
 
     // Bind Joint VAO to joint program as well
@@ -914,9 +840,6 @@ void glShaderWindow::openScene()
         delete(modelMesh);
         m_vertexBuffer.release();
         m_indexBuffer.release();
-        m_colorBuffer.release();
-        m_normalBuffer.release();
-        m_texcoordBuffer.release();
         m_vao.release();
     }
 
@@ -932,6 +855,29 @@ void glShaderWindow::openScene()
     modelMesh->need_faces();
 
 	m_animatedMesh = std::vector<trimesh::point>(modelMesh->vertices.size());
+	// Influences were those of the previous mesh
+	m_skin.clear();
+	m_skinBatches.clear();
+	m_vertexOrder.reset(modelMesh->vertices.size());
+	// Triangles in cache order, vertices in the order they are fetched
+	m_fileCacheStats = TriangleOrder::simulate(modelMesh->faces, modelMesh->vertices.size());
+	m_meshCacheStats = m_fileCacheStats;
+	if (m_optimizeTriangles) {
+		std::vector<int> order;
+		TriangleOrder::optimize(modelMesh, order);
+		m_vertexOrder.reorder(modelMesh, order);
+		m_meshCacheStats = TriangleOrder::simulate(modelMesh->faces, modelMesh->vertices.size());
+	}
+	std::cout << "Vertex cache of " << TriangleOrder::kCacheSize << " : ACMR " << m_fileCacheStats.acmr << " -> " << m_meshCacheStats.acmr
+	          << ", ATVR " << m_fileCacheStats.atvr << " -> " << m_meshCacheStats.atvr << std::endl;
+	m_drawMs = 0;
+	m_drawSamples = 0;
+	m_renderMs = 0;
+	m_renderSamples = 0;
+	m_skinLod.clear();
+	m_lodLevel = 0;
+	m_vertexCache.close();
+	j_weightedJointNb = -1;
 
     m_center = QVector3D(modelMesh->bsphere.center[0],
             modelMesh->bsphere.center[1],
@@ -1046,7 +992,10 @@ void glShaderWindow::setShader(const QString& shader)
         glDeleteBuffers(1, &ssbo[1]);
         glDeleteBuffers(1, &ssbo[2]);
         glDeleteBuffers(1, &ssbo[3]);
+        for (int i = 0; i < 4; i++) ssbo[i] = 0;
     }
+    printProgramStats();
+    resolveUniforms();
     bindSceneToProgram();
     loadTexturesForShaders();
     renderNow();
@@ -1193,6 +1142,8 @@ void glShaderWindow::initialize()
         delete(m_program);
     }
     QString shaderPath = workingDirectory + "../shaders/";
+    QDir().mkpath(shaderPath + "cache");
+    m_programCache.setContext(this, (shaderPath + "cache/").toStdString());
     m_program = prepareShaderProgram(shaderPath + "2_phong.vert", shaderPath + "2_phong.frag");
     if (ground_program) {
         ground_program->release();
@@ -1211,6 +1162,20 @@ void glShaderWindow::initialize()
     }
     joint_program = prepareShaderProgram(shaderPath + "2_phong.vert", shaderPath + "2_phong.frag");
 
+#ifndef __APPLE__
+    // Skinning into the vertex SSBOs, needs compute shaders
+    if (skinning_program) delete skinning_program;
+    skinning_program = linkProgram(QString(), QString(), shaderPath + "h_skinning.comp");
+    if (skinning_program->isLinked()) {
+        GLuint palette = glGetUniformBlockIndex(skinning_program->programId(), "JointPalette");
+        if (palette != GL_INVALID_INDEX) glUniformBlockBinding(skinning_program->programId(), palette, kJointPaletteBinding);
+    } else {
+        delete skinning_program;
+        skinning_program = 0;
+    }
+#endif
+    printProgramStats();
+
     // loading texture:
     loadTexturesForShaders();
 
@@ -1218,9 +1183,8 @@ void glShaderWindow::initialize()
     m_vao.bind();
     m_vertexBuffer.create();
     m_indexBuffer.create();
-    m_colorBuffer.create();
-    m_normalBuffer.create();
-    m_texcoordBuffer.create();
+    m_skinJointBuffer.create();
+    m_skinWeightBuffer.create();
     if (width() > height()) m_screenSize = width(); else m_screenSize = height();
     initPermTexture(); // create Perlin noise texture
     m_vao.release();
@@ -1229,9 +1193,6 @@ void glShaderWindow::initialize()
     ground_vao.bind();
     ground_vertexBuffer.create();
     ground_indexBuffer.create();
-    ground_colorBuffer.create();
-    ground_normalBuffer.create();
-    ground_texcoordBuffer.create();
     ground_vao.release();
 
     joint_vao.create();
@@ -1240,9 +1201,33 @@ void glShaderWindow::initialize()
     joint_indexBuffer.create();
     joint_colorBuffer.create();
     joint_vao.release();
+
+    // Joint matrices of the pose, read by the vertex shaders
+    if (!m_jointPaletteUbo) glGenBuffers(1, &m_jointPaletteUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_jointPaletteUbo);
+    glBufferData(GL_UNIFORM_BUFFER, kMaxPaletteJoints * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kJointPaletteBinding, m_jointPaletteUbo);
+    // Camera, light and material, written once per frame
+    if (!m_frameUbo) glGenBuffers(1, &m_frameUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frameUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameParameters), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, kFrameParametersBinding, m_frameUbo);
+    if (!m_drawQuery) glGenQueries(1, &m_drawQuery);
+    resolveUniforms();
     openScene();
 }
 
+void glShaderWindow::resolveUniforms()
+{
+    m_uniforms.resolve(m_program);
+    ground_uniforms.resolve(ground_program);
+    joint_uniforms.resolve(joint_program);
+    shadowMap_uniforms.resolve(shadowMapGenerationProgram);
+    if (compute_program) compute_uniforms.resolve(compute_program);
+}
+
 void glShaderWindow::resizeEvent(QResizeEvent* event)
 {
     OpenGLWindow::resizeEvent(event);
@@ -1286,34 +1271,77 @@ void glShaderWindow::resize(int x, int y)
     }
 }
 
-QOpenGLShaderProgram* glShaderWindow::prepareShaderProgram(const QString& vertexShaderPath,
-        const QString& fragmentShaderPath)
+// Shaders of the non-empty paths linked, from the binary of the same sources
+// when the cache has it. Errors are logged, the program returned all the same.
+QOpenGLShaderProgram* glShaderWindow::linkProgram(const QString& vertexShaderPath,
+        const QString& fragmentShaderPath, const QString& computeShaderPath)
 {
-    QOpenGLShaderProgram* program = new QOpenGLShaderProgram(this);
+    std::vector<std::string> sources;
+    if (vertexShaderPath.length() > 0) sources.push_back(vertexShaderPath.toStdString());
+    if (fragmentShaderPath.length() > 0) sources.push_back(fragmentShaderPath.toStdString());
+    if (computeShaderPath.length() > 0) sources.push_back(computeShaderPath.toStdString());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t key = m_programCache.key(sources);
+    QOpenGLShaderProgram* program = m_programCache.load(key, this);
+    if (program) {
+        m_linkMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return program;
+    }
+
+    program = new QOpenGLShaderProgram(this);
     if (!program) qWarning() << "Failed to allocate the shader";
-    bool result = program->addShaderFromSourceFile(QOpenGLShader::Vertex, vertexShaderPath);
-    if ( !result )
-        qWarning() << program->log();
-    result = program->addShaderFromSourceFile(QOpenGLShader::Fragment, fragmentShaderPath);
-    if ( !result )
-        qWarning() << program->log();
+    bool result;
+    if (vertexShaderPath.length() > 0) {
+        result = program->addShaderFromSourceFile(QOpenGLShader::Vertex, vertexShaderPath);
+        if ( !result )
+            qWarning() << program->log();
+    }
+    if (fragmentShaderPath.length() > 0) {
+        result = program->addShaderFromSourceFile(QOpenGLShader::Fragment, fragmentShaderPath);
+        if ( !result )
+            qWarning() << program->log();
+    }
+    if (computeShaderPath.length() > 0) {
+        result = program->addShaderFromSourceFile(QOpenGLShader::Compute, computeShaderPath);
+        if ( !result )
+            qWarning() << program->log();
+    }
+    program->bindAttributeLocation("skinJoints", kSkinJointsLocation);
+    program->bindAttributeLocation("skinWeights", kSkinWeightsLocation);
+    m_programCache.markRetrievable(program);
     result = program->link();
     if ( !result )
         qWarning() << program->log();
+    else m_programCache.store(key, program);
+    m_linkMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return program;
+}
+
+void glShaderWindow::printProgramStats()
+{
+    const ProgramCache::Stats & stats = m_programCache.stats();
+    std::cout << "Shader programs ready in " << m_linkMs << " ms since start (" << stats.compiled << " compiled, " << stats.fromMemory
+              << " from memory, " << stats.fromDisk << " from disk"
+              << (m_programCache.isEnabled() ? "" : ", no binary formats to cache them") << ")" << std::endl;
+}
+
+QOpenGLShaderProgram* glShaderWindow::prepareShaderProgram(const QString& vertexShaderPath,
+        const QString& fragmentShaderPath)
+{
+    QOpenGLShaderProgram* program = linkProgram(vertexShaderPath, fragmentShaderPath, QString());
+    GLuint palette = glGetUniformBlockIndex(program->programId(), "JointPalette");
+    if (palette != GL_INVALID_INDEX) glUniformBlockBinding(program->programId(), palette, kJointPaletteBinding);
+    GLuint frame = glGetUniformBlockIndex(program->programId(), "FrameParameters");
+    if (frame != GL_INVALID_INDEX) glUniformBlockBinding(program->programId(), frame, kFrameParametersBinding);
     return program;
 }
 
 QOpenGLShaderProgram* glShaderWindow::prepareComputeProgram(const QString& computeShaderPath)
 {
-    QOpenGLShaderProgram* program = new QOpenGLShaderProgram(this);
-    if (!program) qWarning() << "Failed to allocate the shader";
-    bool result = program->addShaderFromSourceFile(QOpenGLShader::Compute, computeShaderPath);
-    if ( !result )
-        qWarning() << program->log();
-    result = program->link();
-    if ( !result )
-        qWarning() << program->log();
-    else hasComputeShaders = true;
+    QOpenGLShaderProgram* program = linkProgram(QString(), QString(), computeShaderPath);
+    if (program->isLinked()) hasComputeShaders = true;
+    GLuint frame = glGetUniformBlockIndex(program->programId(), "FrameParameters");
+    if (frame != GL_INVALID_INDEX) glUniformBlockBinding(program->programId(), frame, kFrameParametersBinding);
     return program;
 }
 
@@ -1379,59 +1407,410 @@ void glShaderWindow::keyPressEvent(QKeyEvent* e) {
             computeNextFrame();
             printState();
             break;
+        case Qt::Key_Backspace:
+            if (m_maxFrameNb > 0) goToFrame((m_frameNb + m_maxFrameNb - 1) % m_maxFrameNb);
+            break;
         case Qt::Key_J:
-            j_weightedJointNb++;
-            j_weightedJointNb %= j_numPoints;
-            displayWeightColor(j_weightedJointNb);
+            // Every joint in turn, then the mesh colors again
+            if (m_skin.nbVertices() > 0) displayWeightColor(j_weightedJointNb + 1 < j_numPoints ? j_weightedJointNb + 1 : -1);
             break;
         case Qt::Key_L:
-			m_animated = !m_animated;
+			m_animated = !m_animated && m_maxFrameNb > 0;
+			if (m_animated) {
+				m_scheduler.start(m_frameTime, m_maxFrameNb, m_frameNb);
+				if (m_skeleton != NULL) m_skeleton->resetPoseStats();
+				renderLater();
+			} else {
+				m_scheduler.stop();
+				m_frameTimer.stop();
+				printFrameStats();
+			}
+            break;
+        case Qt::Key_I:
+			m_interpolate = !m_interpolate;
+			if (m_animated) renderLater();
+            break;
+        case Qt::Key_T:
+			printFrameStats();
+            break;
+        case Qt::Key_G:
+			m_gpuSkinning = !m_gpuSkinning;
+			std::cout << "Skinning on the " << (m_gpuSkinning ? "GPU" : "CPU") << std::endl;
+			restartSkinning();
+            break;
+        case Qt::Key_O:
+			// Draw times of both orders, for the same model loaded again
+			m_optimizeTriangles = !m_optimizeTriangles;
+			std::cout << "Triangle order " << (m_optimizeTriangles ? "optimized" : "of the file") << std::endl;
+			openScene();
+			renderNow();
+            break;
+        case Qt::Key_K:
+			exportVertexCache();
+            break;
+        case Qt::Key_P:
+			toggleVertexCache();
+            break;
+        case Qt::Key_D:
+			m_skinLodEnabled = !m_skinLodEnabled;
+			std::cout << "Skinning levels of detail " << (m_skinLodEnabled ? "on" : "off") << std::endl;
+			if (m_skinLodEnabled && m_skin.nbVertices() > 0) m_skinLod.build(modelMesh->vertices, modelMesh->faces, m_skin);
+			m_lodLevel = 0;
+			m_lodSkipped = 0;
+			// All the mesh triangles again, then the level of the next frame
+			restartSkinning();
             break;
         case Qt::Key_R:
 			rigidSkinning();
+			fillSkinData();
+            break;
         case Qt::Key_S:
 			smoothSkinning();
+			fillSkinData();
+            break;
         case Qt::Key_V:
 			_shift = !_shift;
+			m_jointPaletteStale = true;
+            break;
         default:
             break;
     }
 }
 
 void glShaderWindow::updateJointVertexArray() {
-    m_skeleton->computePointPositions(j_vertices, j_vertTransMatrix);
+	size_t bytes = j_numPoints * sizeof(trimesh::point);
+	m_jointRing.allocate(this, bytes);
+	int offset = m_jointRing.write(j_vertices.data(), bytes);
+	// The colors of the joints are read from their positions as well
 	joint_vao.bind();
-	joint_vertexBuffer.bind();
-    joint_vertexBuffer.write(0, j_vertices.data(), j_numPoints * sizeof(trimesh::point));
-    joint_vao.release();
+	glBindBuffer(GL_ARRAY_BUFFER, m_jointRing.bufferId());
+	joint_program->setAttributeBuffer("vertex", GL_FLOAT, offset, 4);
+	joint_program->setAttributeBuffer("color", GL_FLOAT, offset, 4);
+	joint_vao.release();
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void glShaderWindow::updateMeshVertexArray() {
-	if(!j_weightData.empty()) {
-		animateMesh();
-		m_program->bind();
+	if (activeSkinning() != CpuSkinning) {
+		// Only the joint matrices change, uploaded by the next render
+		m_jointPaletteStale = true;
+	} else if ((m_skin.nbVertices() > 0 || m_vertexCache.isOpen()) && isGPGPU) {
+		// The ray tracer reads the vertex SSBO
+		animateMesh(m_animatedMesh.data());
+		if (compute_program) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo[0]);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_animatedMesh.size() * sizeof(trimesh::point), m_animatedMesh.data());
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+		m_bbmin = m_bbmax = QVector3D(m_animatedMesh[0][0], m_animatedMesh[0][1], m_animatedMesh[0][2]);
+		for (size_t i = 1; i < m_animatedMesh.size(); i++) {
+			QVector3D p(m_animatedMesh[i][0], m_animatedMesh[i][1], m_animatedMesh[i][2]);
+			m_bbmin = QVector3D(std::min(m_bbmin.x(), p.x()), std::min(m_bbmin.y(), p.y()), std::min(m_bbmin.z(), p.z()));
+			m_bbmax = QVector3D(std::max(m_bbmax.x(), p.x()), std::max(m_bbmax.y(), p.y()), std::max(m_bbmax.z(), p.z()));
+		}
+	} else if(m_skin.nbVertices() > 0 || m_vertexCache.isOpen()) {
+		if (lodActive()) {
+			int level = m_skinLod.select(screenRadius());
+			if (level != m_lodLevel) {
+				setLodLevel(level);
+			} else if (++m_lodSkipped < m_skinLod.level(level).updateInterval) {
+				// Far away : the previous pose is shown a few more frames
+				return;
+			}
+			m_lodSkipped = 0;
+		}
+		// Skinned straight into the region of this frame while the GPU draws the previous ones
+		// (float positions : the other attributes stay in the packed m_vertexBuffer)
+		m_meshRing.allocate(this, m_animatedMesh.size() * sizeof(trimesh::point));
+		trimesh::point* out = (trimesh::point*)m_meshRing.beginWrite();
+		int offset;
+		if (out != NULL) {
+			animateMesh(out);
+			offset = m_meshRing.endWrite();
+		} else {
+			animateMesh(m_animatedMesh.data());
+			offset = m_meshRing.write(m_animatedMesh.data(), m_animatedMesh.size() * sizeof(trimesh::point));
+		}
 		m_vao.bind();
-    	m_vertexBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
-    	m_vertexBuffer.bind();
-    	m_vertexBuffer.allocate(m_animatedMesh.data(), m_animatedMesh.size() * sizeof(trimesh::point));
+		glBindBuffer(GL_ARRAY_BUFFER, m_meshRing.bufferId());
+		m_program->setAttributeBuffer("vertex", GL_FLOAT, offset, 4);
+		shadowMapGenerationProgram->setAttributeBuffer("vertex", GL_FLOAT, offset, 4);
 		m_vao.release();
-		m_program->release();
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		m_packedPositions = false;
+		m_skinAttributesStale = true;
+	}
+}
+
+// Levels of detail only for the CPU skinning of the raster shaders
+bool glShaderWindow::lodActive() {
+	return m_skinLodEnabled && m_skinLod.nbLevels() > 0 && !isGPGPU && !m_vertexCache.isOpen();
+}
+
+// Radius in pixels of the bounding sphere of the mesh
+float glShaderWindow::screenRadius() {
+	float distance = -(m_matrix[0] * m_center).z();
+	if (distance <= 0) return FLT_MAX;
+	return modelMesh->bsphere.r * m_perspective(1, 1) * 0.5f * height() * devicePixelRatio() / distance;
+}
+
+// Triangles of a level : those of the mesh, or of the proxy over its vertices
+void glShaderWindow::setLodLevel(int level) {
+	m_lodLevel = level;
+	const SkinLodLevel & l = m_skinLod.level(level);
+	m_vao.bind();
+	m_indexBuffer.bind();
+	if (l.indices.empty()) {
+		m_numFaces = modelMesh->faces.size();
+		m_indexBuffer.allocate(&(modelMesh->faces.front()), m_numFaces * 3 * sizeof(int));
+	} else {
+		m_numFaces = l.indices.size() / 3;
+		m_indexBuffer.allocate(l.indices.data(), l.indices.size() * sizeof(int));
+	}
+	m_vao.release();
+	std::cout << "Skinning level " << level << " : " << l.nbSkinned() << " vertices, " << m_numFaces << " triangles, every "
+	          << l.updateInterval << " frame(s)" << std::endl;
+}
+
+// Vertex buffers back to the bind pose, then the current frame by the new path
+void glShaderWindow::restartSkinning() {
+	if (compute_program) createSSBO();
+	bindSceneToProgram();
+	if (m_skeleton != NULL) setPose(m_frameNb);
+	renderNow();
+}
+
+// walk1.bvh and skin.off -> walk1_skin.vac, next to the animation
+QString glShaderWindow::vertexCacheFileName() {
+	QFileInfo bvh(bvhfileName);
+	return bvh.path() + "/" + bvh.completeBaseName() + "_" + QFileInfo(modelName).completeBaseName() + ".vac";
+}
+
+void glShaderWindow::exportVertexCache() {
+	if (m_skeleton == NULL || m_maxFrameNb == 0 || m_skin.nbVertices() == 0) {
+		std::cout << "No skinned animation to export" << std::endl;
+		return;
+	}
+	m_vertexCache.close();
+	// Joint tables of every frame, even over the memory cap of playback
+	AnimationBake unbounded;
+	if (!m_bake.isBaked()) unbounded.bake(*m_skeleton, (size_t)-1);
+	const AnimationBake & bake = m_bake.isBaked() ? m_bake : unbounded;
+	QString fileName = vertexCacheFileName();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	// Frames in file order, whatever the order of the vertices of the mesh
+	SkinInfluences fileSkin;
+	if (!m_vertexOrder.isFileOrder()) fileSkin.copyVertices(m_skin, m_vertexOrder.meshVertices());
+	if (!VertexCache::write(fileName.toStdString(), m_vertexOrder.isFileOrder() ? m_skin : fileSkin, bake, m_frameTime)) {
+		std::cerr << "Could not write " << fileName.toStdString() << std::endl;
+		return;
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	toggleVertexCache();
+	if (m_vertexCache.isOpen()) {
+		size_t raw = (size_t)m_maxFrameNb * m_skin.nbVertices() * sizeof(trimesh::point);
+		std::cout << "Exported " << m_maxFrameNb << " frames in " << elapsed.count() << " ms : "
+		          << m_vertexCache.bytes() / 1024 << " KB for " << raw / 1024 << " KB of vertices" << std::endl;
+	}
+}
+
+void glShaderWindow::toggleVertexCache() {
+	if (m_vertexCache.isOpen()) {
+		m_vertexCache.close();
+		std::cout << "Vertex cache closed, skinning again" << std::endl;
+	} else {
+		QString fileName = vertexCacheFileName();
+		if (!m_vertexCache.open(fileName.toStdString())) {
+			std::cout << "No vertex cache " << fileName.toStdString() << " (K exports it)" << std::endl;
+			return;
+		}
+		if (m_vertexCache.nbVertices() != (int)modelMesh->vertices.size() || m_vertexCache.nbFrames() != m_maxFrameNb) {
+			std::cout << fileName.toStdString() << " was exported for another mesh or clip" << std::endl;
+			m_vertexCache.close();
+			return;
+		}
+		std::cout << "Playing back " << fileName.toStdString() << std::endl;
+	}
+	restartSkinning();
+}
+
+// Influences as vertex attributes, read by the skinning and the weight colors
+void glShaderWindow::uploadSkinWeights() {
+	if (!m_skinWeightsStale) return;
+	std::vector<uint8_t> joints;
+	std::vector<float> weights;
+	m_skin.vertexAttributes(joints, weights);
+	m_vao.bind();
+	m_skinJointBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+	m_skinJointBuffer.bind();
+	m_skinJointBuffer.allocate(joints.data(), joints.size() * sizeof(uint8_t));
+	// Joint numbers, not normalized
+	glVertexAttribPointer(kSkinJointsLocation, kMaxInfluences, GL_UNSIGNED_BYTE, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(kSkinJointsLocation);
+	m_skinWeightBuffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+	m_skinWeightBuffer.bind();
+	m_skinWeightBuffer.allocate(weights.data(), weights.size() * sizeof(float));
+	glVertexAttribPointer(kSkinWeightsLocation, kMaxInfluences, GL_FLOAT, GL_FALSE, 0, 0);
+	glEnableVertexAttribArray(kSkinWeightsLocation);
+	m_vao.release();
+	m_skinWeightsStale = false;
+}
+
+glShaderWindow::SkinningMode glShaderWindow::activeSkinning() {
+	if (!m_gpuSkinning || m_vertexCache.isOpen() || m_skin.nbVertices() == 0 || j_numPoints > kMaxPaletteJoints
+	    || (int)j_vertTransMatrix.size() != j_numPoints) return CpuSkinning;
+	// The ray tracer reads the vertex SSBOs, skinned in place
+	if (isGPGPU) return (compute_program && skinning_program) ? ComputeSkinning : CpuSkinning;
+	if (m_uniforms.skinning != -1) return ShaderSkinning;
+	// Shaders without skinning draw the SSBOs skinned by the compute pass
+	return skinning_program ? ComputeSkinning : CpuSkinning;
+}
+
+void glShaderWindow::uploadSkinning(SkinningMode mode) {
+	if (m_skinAttributesStale && mode == ComputeSkinning) {
+#ifndef __APPLE__
+		std::vector<uint8_t> joints;
+		std::vector<float> weights;
+		m_skin.vertexAttributes(joints, weights);
+		// ssbo[0] and ssbo[1] receive the pose, from the bind pose and normals
+		createSSBO();
+		if (!skin_ssbo[0]) glGenBuffers(5, skin_ssbo);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, skin_ssbo[0]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, modelMesh->vertices.size() * sizeof(trimesh::point), &(modelMesh->vertices.front()), GL_STATIC_READ);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, skin_ssbo[1]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, modelMesh->normals.size() * sizeof(trimesh::vec), &(modelMesh->normals.front()), GL_STATIC_READ);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, skin_ssbo[2]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, joints.size() * sizeof(uint8_t), joints.data(), GL_STATIC_READ);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, skin_ssbo[3]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, weights.size() * sizeof(float), weights.data(), GL_STATIC_READ);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, skin_ssbo[4]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 8 * sizeof(GLint), NULL, GL_DYNAMIC_COPY);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		for (int i = 0; i < 5; i++) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5 + i, skin_ssbo[i]);
+		if (!isGPGPU) {
+			// The raster VAO draws the same buffers
+			m_vao.bind();
+			glBindBuffer(GL_ARRAY_BUFFER, ssbo[0]);
+			m_program->setAttributeBuffer("vertex", GL_FLOAT, 0, 4);
+			shadowMapGenerationProgram->setAttributeBuffer("vertex", GL_FLOAT, 0, 4);
+			glBindBuffer(GL_ARRAY_BUFFER, ssbo[1]);
+			m_program->setAttributeBuffer("normal", GL_FLOAT, 0, 4);
+			shadowMapGenerationProgram->setAttributeBuffer("normal", GL_FLOAT, 0, 4);
+			m_vao.release();
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			m_packedPositions = false;
+		}
+		m_skinAttributesStale = false;
+		m_jointPaletteStale = true;
+#endif
+	}
+	if (m_skinAttributesStale) {
+		uploadSkinWeights();
+		// The shaders deform the bind pose, not the last frame skinned on the CPU
+		m_vao.bind();
+		m_vertexBuffer.bind();
+		m_program->setAttributeBuffer("vertex", GL_UNSIGNED_SHORT, PackedMesh::kPositionOffset, 4, sizeof(PackedVertex));
+		shadowMapGenerationProgram->setAttributeBuffer("vertex", GL_UNSIGNED_SHORT, PackedMesh::kPositionOffset, 4, sizeof(PackedVertex));
+		m_vao.release();
+		m_packedPositions = true;
+		m_skinAttributesStale = false;
+		m_jointPaletteStale = true;
+	}
+	if (m_jointPaletteStale) {
+		// Joint matrices from the bind pose : M_j * translate(-bindJoint_j)
+		m_jointPalette.resize(j_numPoints);
+		for (int j = 0; j < j_numPoints; j++) {
+			const glm::mat4 & m = j_vertTransMatrix[j];
+			const trimesh::point & b = j_bindVertices[j];
+			m_jointPalette[j] = m;
+			m_jointPalette[j][3] = m[3] - m[0] * b[0] - m[1] * b[1] - m[2] * b[2];
+			if (_shift) m_jointPalette[j][3][0] += 50;
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, m_jointPaletteUbo);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, j_numPoints * sizeof(glm::mat4), m_jointPalette.data());
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		m_jointPaletteStale = false;
+#ifndef __APPLE__
+		if (mode == ComputeSkinning) {
+			// Bounds start empty, then every group merges its own
+			const GLint emptyBounds[8] = { INT_MAX, INT_MAX, INT_MAX, INT_MAX, INT_MIN, INT_MIN, INT_MIN, INT_MIN };
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, skin_ssbo[4]);
+			glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(emptyBounds), emptyBounds);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+			skinning_program->bind();
+			skinning_program->setUniformValue("nbVertices", m_skin.nbVertices());
+			glDispatchCompute((m_skin.nbVertices() + 63) / 64, 1, 1);
+			skinning_program->release();
+			// Read next by the ray tracer and the vertex fetch
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+		}
+#endif
 	}
 }
 
 
 
 void glShaderWindow::computeNextFrame() {
-    m_frameNb++;
-    m_frameNb = m_frameNb % m_maxFrameNb;
-    std::cout<<m_frameNb<<std::endl;
+    if (m_maxFrameNb > 0) goToFrame((m_frameNb + 1) % m_maxFrameNb);
+    else renderNow();
+}
+
+void glShaderWindow::goToFrame(int frame) {
+    std::cout<<frame<<std::endl;
+    setPose(frame);
+    renderNow();
+}
 
-    if(!(m_skeleton==NULL)) {
+void glShaderWindow::setPose(int frame, float alpha) {
+    m_frameNb = frame;
+    if (m_skeleton == NULL) return;
+    if (alpha > 0) {
+        m_skeleton->animate(m_frameNb, (m_frameNb + 1) % m_maxFrameNb, alpha);
+        m_skeleton->computePointPositions(j_vertices, j_vertTransMatrix);
+    } else if (m_bake.isBaked()) {
+        // Baked animation : the joints of any frame are a table lookup
+        m_bake.fetch(m_frameNb, j_vertices, j_vertTransMatrix);
+    } else {
         m_skeleton->animate(m_frameNb);
-        updateJointVertexArray();
-        updateMeshVertexArray();
+        m_skeleton->computePointPositions(j_vertices, j_vertTransMatrix);
+    }
+    updateJointVertexArray();
+    updateMeshVertexArray();
+}
+
+// Called at the start of each render while playing
+void glShaderWindow::advanceAnimation() {
+    m_scheduler.tick();
+    if (m_interpolate) {
+        setPose(m_scheduler.frame(), m_scheduler.alpha());
+    } else if (m_scheduler.frame() != m_frameNb) {
+        setPose(m_scheduler.frame());
+    }
+}
+
+void glShaderWindow::printFrameStats() {
+    const FrameStats & stats = m_scheduler.stats();
+    std::cout << "Frame time (last " << stats.count << ") : mean " << stats.meanMs << " ms, min " << stats.minMs
+              << " ms, max " << stats.maxMs << " ms, last " << stats.lastMs << " ms" << std::endl;
+    std::cout << stats.rendered << " frames rendered, " << stats.skipped << " animation frames skipped"
+              << " (animation at " << (m_frameTime > 0 ? 1 / m_frameTime : 0) << " fps)" << std::endl;
+    if (m_skeleton != NULL && m_skeleton->poseStats().poses > 0) {
+        const Skeleton::PoseStats & pose = m_skeleton->poseStats();
+        std::cout << "Joints evaluated : " << 100.0 * pose.evaluated / pose.joints << " % composed, "
+                  << 100.0 * pose.rotations / pose.joints << " % rotated (" << m_skeleton->nbStaticJoints() << " of "
+                  << m_skeleton->nbJoints() << " joints static) over " << pose.poses << " poses" << std::endl;
+    }
+    if (m_drawSamples > 0) {
+        std::cout << "Model drawn in " << m_drawMs / m_drawSamples << " ms on the GPU (" << m_drawSamples << " frames), triangles "
+                  << (m_optimizeTriangles ? "optimized" : "in file order") << ", ACMR " << m_meshCacheStats.acmr << std::endl;
+    }
+    if (m_renderSamples > 0) {
+        std::cout << "Frame submitted in " << m_renderMs / m_renderSamples << " ms on the CPU (" << m_renderSamples << " frames)" << std::endl;
+    }
+    if (m_meshRing.isCreated()) {
+        std::cout << "Skinned vertices in " << DynamicBuffer::kRegions << " " << (m_meshRing.isPersistent() ? "persistently mapped" : "mapped")
+                  << " regions, " << m_meshRing.nbStalls() << " waits for the GPU" << std::endl;
     }
-    renderNow();
 }
 
 void glShaderWindow::mouseMoveEvent(QMouseEvent *e)
@@ -1543,22 +1922,28 @@ void glShaderWindow::printState()
 #endif
 }
 
-void glShaderWindow::waitFrame() {
-	
-	if(m_timePrevFram != 0){
-		float frameTime = (float)CLOCKS_PER_SEC * m_frameTime;
-		int time = int(m_timePrevFram + frameTime - clock());
-		//int time = 1;
-		if (time > 0) {	
-			std::this_thread::sleep_for(std::chrono::seconds(time));
-		}
-	}
-	m_timePrevFram = clock();		
-
-}
-
 void glShaderWindow::render()
 {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (m_drawQueryPending) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(m_drawQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(m_drawQuery, GL_QUERY_RESULT, &elapsed);
+            m_drawMs += elapsed * 1e-6;
+            m_drawSamples++;
+            m_drawQueryPending = false;
+        }
+    }
+    if (m_animated) advanceAnimation();
+    const SkinningMode skinning = activeSkinning();
+    if (skinning != CpuSkinning) uploadSkinning(skinning);
+    if (j_weightedJointNb >= 0 && !isGPGPU) uploadSkinWeights();
+    const bool gpuSkinning = skinning == ShaderSkinning;
+    // Zoomed in or out while paused
+    if (skinning == CpuSkinning && lodActive() && m_skinLod.select(screenRadius()) != m_lodLevel) updateMeshVertexArray();
+
     QVector3D lightPosition = m_matrix[1] * (m_center + lightDistance * modelMesh->bsphere.r * QVector3D(0.5, 0.5, 1));
 
     QMatrix4x4 lightCoordMatrix;
@@ -1571,6 +1956,35 @@ void glShaderWindow::render()
         mat_inverse = mat_inverse.inverted(&invertible);
         persp_inverse = persp_inverse.inverted(&invertible);
     } 
+    // Shared by all the programs : one upload for the frame
+    FrameParameters frame;
+    memcpy(frame.matrix, m_matrix[0].constData(), sizeof(frame.matrix));
+    memcpy(frame.perspective, m_perspective.constData(), sizeof(frame.perspective));
+    memcpy(frame.lightMatrix, m_matrix[1].constData(), sizeof(frame.lightMatrix));
+    memcpy(frame.matInverse, mat_inverse.constData(), sizeof(frame.matInverse));
+    memcpy(frame.perspInverse, persp_inverse.constData(), sizeof(frame.perspInverse));
+    QMatrix3x3 normalMatrix = m_matrix[0].normalMatrix();
+    for (int c = 0; c < 3; c++) {
+        for (int r = 0; r < 3; r++) frame.normalMatrix[4 * c + r] = normalMatrix(r, c);
+        frame.normalMatrix[4 * c + 3] = 0;
+    }
+    for (int k = 0; k < 3; k++) {
+        frame.lightPosition[k] = lightPosition[k];
+        frame.center[k] = m_center[k];
+    }
+    frame.lightIntensity = lightIntensity;
+    frame.radius = modelMesh->bsphere.r;
+    frame.shininess = shininess;
+    frame.eta = eta;
+    frame.kr = kr;
+    frame.bouncesNb = bounces;
+    frame.blinnPhong = blinnPhong;
+    frame.transparent = transparent;
+    frame.pad[0] = frame.pad[1] = 0;
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frameUbo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
     if (hasComputeShaders) {
         // We bind the texture generated to texture unit 2 (0 is for the texture, 1 for the env map)
 #ifndef __APPLE__
@@ -1578,24 +1992,12 @@ void glShaderWindow::render()
         compute_program->bind();
         computeResult->bind(2);
         // Send parameters to compute program:
-        compute_program->setUniformValue("bbmin", m_bbmin);
-        compute_program->setUniformValue("bbmax", m_bbmax);
-        compute_program->setUniformValue("center", m_center);
-        compute_program->setUniformValue("radius", modelMesh->bsphere.r);
-        compute_program->setUniformValue("groundDistance", groundDistance * modelMesh->bsphere.r - m_center[1]);
-        compute_program->setUniformValue("mat_inverse", mat_inverse);
-        compute_program->setUniformValue("persp_inverse", persp_inverse);
-        compute_program->setUniformValue("lightPosition", lightPosition);
-        compute_program->setUniformValue("lightIntensity", 1.0f);
-        compute_program->setUniformValue("blinnPhong", blinnPhong);
-        compute_program->setUniformValue("transparent", transparent);
-        compute_program->setUniformValue("lightIntensity", lightIntensity);
-        compute_program->setUniformValue("shininess", shininess);
-        compute_program->setUniformValue("bouncesNb", bounces);
-        compute_program->setUniformValue("kr", kr);
-        compute_program->setUniformValue("eta", eta);
-        compute_program->setUniformValue("framebuffer", 2);
-        compute_program->setUniformValue("colorTexture", 0);
+        compute_program->setUniformValue(compute_uniforms.bbmin, m_bbmin);
+        compute_program->setUniformValue(compute_uniforms.bbmax, m_bbmax);
+        compute_program->setUniformValue(compute_uniforms.skinnedBounds, skinning == ComputeSkinning);
+        compute_program->setUniformValue(compute_uniforms.groundDistance, groundDistance * modelMesh->bsphere.r - m_center[1]);
+        compute_program->setUniformValue(compute_uniforms.framebuffer, 2);
+        compute_program->setUniformValue(compute_uniforms.colorTexture, 0);
         glBindImageTexture(2, computeResult->textureId(), 0, false, 0, GL_WRITE_ONLY, GL_RGBA32F);
         int worksize_x = nextPower2(width());
         int worksize_y = nextPower2(height());
@@ -1604,7 +2006,7 @@ void glShaderWindow::render()
         glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
         compute_program->release();
 #endif
-    } else if ((ground_program->uniformLocation("shadowMap") != -1) || (m_program->uniformLocation("shadowMap") != -1) ){
+    } else if ((ground_uniforms.shadowMap != -1) || (m_uniforms.shadowMap != -1) ){
         glActiveTexture(GL_TEXTURE2);
         // The program uses a shadow map, let's compute it.
         glBindFramebuffer(GL_FRAMEBUFFER, shadowMap_fboId);
@@ -1623,12 +2025,16 @@ void glShaderWindow::render()
         lightCoordMatrix.lookAt(lightPosition, m_center, QVector3D(0,1,0));
         lightPerspective.perspective(45, 1.0, 0.1 * modelMesh->bsphere.r, 20 * modelMesh->bsphere.r);
 
-        shadowMapGenerationProgram->setUniformValue("matrix", lightCoordMatrix);
-        shadowMapGenerationProgram->setUniformValue("perspective", lightPerspective);
+        shadowMapGenerationProgram->setUniformValue(shadowMap_uniforms.matrix, lightCoordMatrix);
+        shadowMapGenerationProgram->setUniformValue(shadowMap_uniforms.perspective, lightPerspective);
         // Draw the entire scene:
+        shadowMapGenerationProgram->setUniformValue(shadowMap_uniforms.skinning, gpuSkinning);
+        setPositionTransform(shadowMapGenerationProgram, shadowMap_uniforms, m_packedPositions ? &m_packedMesh : NULL);
         m_vao.bind();
         glDrawElements(GL_TRIANGLES, 3 * m_numFaces, GL_UNSIGNED_INT, 0);
         m_vao.release();
+        shadowMapGenerationProgram->setUniformValue(shadowMap_uniforms.skinning, false);
+        setPositionTransform(shadowMapGenerationProgram, shadowMap_uniforms, &m_packedGround);
         ground_vao.bind();
         glDrawElements(GL_TRIANGLES, g_numIndices, GL_UNSIGNED_INT, 0);
         ground_vao.release();
@@ -1645,68 +2051,42 @@ void glShaderWindow::render()
     const qreal retinaScale = devicePixelRatio();
     glViewport(0, 0, width() * retinaScale, height() * retinaScale);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    if (isGPGPU) {
-        m_program->setUniformValue("computeResult", 2);
-        m_program->setUniformValue("center", m_center);
-        m_program->setUniformValue("mat_inverse", mat_inverse);
-        m_program->setUniformValue("persp_inverse", persp_inverse);
-    } else {
-        m_program->setUniformValue("matrix", m_matrix[0]);
-        m_program->setUniformValue("perspective", m_perspective);
-        m_program->setUniformValue("lightMatrix", m_matrix[1]);
-        m_program->setUniformValue("normalMatrix", m_matrix[0].normalMatrix());
-    }
-    m_program->setUniformValue("lightPosition", lightPosition);
-    m_program->setUniformValue("lightIntensity", 1.0f);
-    m_program->setUniformValue("blinnPhong", blinnPhong);
-    m_program->setUniformValue("transparent", transparent);
-    m_program->setUniformValue("lightIntensity", lightIntensity);
-    m_program->setUniformValue("shininess", shininess);
-    m_program->setUniformValue("bouncesNb", bounces);
-    m_program->setUniformValue("kr", kr);
-    m_program->setUniformValue("eta", eta);
-    m_program->setUniformValue("k_a", 0.2f);
-    m_program->setUniformValue("k_d", 0.7f);
-    m_program->setUniformValue("radius", modelMesh->bsphere.r);
-    if (m_program->uniformLocation("colorTexture") != -1) m_program->setUniformValue("colorTexture", 0);
-    if (m_program->uniformLocation("envMap") != -1)  m_program->setUniformValue("envMap", 1);
-    else if (m_program->uniformLocation("permTexture") != -1)  m_program->setUniformValue("permTexture", 1);
+    if (isGPGPU) m_program->setUniformValue(m_uniforms.computeResult, 2);
+    m_program->setUniformValue(m_uniforms.k_a, 0.2f);
+    m_program->setUniformValue(m_uniforms.k_d, 0.7f);
+    setPositionTransform(m_program, m_uniforms, m_packedPositions ? &m_packedMesh : NULL);
+    m_program->setUniformValue(m_uniforms.skinning, gpuSkinning);
+    m_program->setUniformValue(m_uniforms.weightJoint, j_weightedJointNb);
+    m_program->setUniformValue(m_uniforms.colorTexture, 0);
+    if (m_uniforms.envMap != -1) m_program->setUniformValue(m_uniforms.envMap, 1);
+    else m_program->setUniformValue(m_uniforms.permTexture, 1);
 
     // Shadow Mapping
-    if (m_program->uniformLocation("shadowMap") != -1) {
-        m_program->setUniformValue("shadowMap", 2);
-        m_program->setUniformValue("worldToLightspace", lightPerspective * lightCoordMatrix);
+    if (m_uniforms.shadowMap != -1) {
+        m_program->setUniformValue(m_uniforms.shadowMap, 2);
+        m_program->setUniformValue(m_uniforms.worldToLightspace, lightPerspective * lightCoordMatrix);
     }
 
-	if(m_animated){
-		waitFrame();
-	}
     m_vao.bind();
+    // One query at a time : not begun again before its result is read
+    bool timed = m_drawQuery && !m_drawQueryPending;
+    if (timed) glBeginQuery(GL_TIME_ELAPSED, m_drawQuery);
     glDrawElements(GL_TRIANGLES, 3 * m_numFaces, GL_UNSIGNED_INT, 0);
+    if (timed) {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_drawQueryPending = true;
+    }
     m_vao.release();
     m_program->release();
 
     if (!isGPGPU) {
         // also draw the ground, with a different shader program
         ground_program->bind();
-        ground_program->setUniformValue("lightPosition", lightPosition);
-        ground_program->setUniformValue("matrix", m_matrix[0]);
-        ground_program->setUniformValue("lightMatrix", m_matrix[1]);
-        ground_program->setUniformValue("perspective", m_perspective);
-        ground_program->setUniformValue("normalMatrix", m_matrix[0].normalMatrix());
-        ground_program->setUniformValue("lightIntensity", 1.0f);
-        ground_program->setUniformValue("blinnPhong", blinnPhong);
-        ground_program->setUniformValue("transparent", transparent);
-        ground_program->setUniformValue("lightIntensity", lightIntensity);
-        ground_program->setUniformValue("shininess", shininess);
-        ground_program->setUniformValue("bouncesNb", bounces);
-        ground_program->setUniformValue("eta", eta);
-        ground_program->setUniformValue("kr", kr);
-        ground_program->setUniformValue("radius", modelMesh->bsphere.r);
-        if (ground_program->uniformLocation("colorTexture") != -1) ground_program->setUniformValue("colorTexture", 0);
-        if (ground_program->uniformLocation("shadowMap") != -1) {
-            ground_program->setUniformValue("shadowMap", 2);
-            ground_program->setUniformValue("worldToLightspace", lightPerspective * lightCoordMatrix);
+        setPositionTransform(ground_program, ground_uniforms, &m_packedGround);
+        ground_program->setUniformValue(ground_uniforms.colorTexture, 0);
+        if (ground_uniforms.shadowMap != -1) {
+            ground_program->setUniformValue(ground_uniforms.shadowMap, 2);
+            ground_program->setUniformValue(ground_uniforms.worldToLightspace, lightPerspective * lightCoordMatrix);
         }
         ground_vao.bind();
         glDrawElements(GL_TRIANGLES, g_numIndices, GL_UNSIGNED_INT, 0);
@@ -1715,28 +2095,22 @@ void glShaderWindow::render()
     }
     // also draw the joint, with a different shader program
     joint_program->bind();
-    joint_program->setUniformValue("lightPosition", lightPosition);
-    joint_program->setUniformValue("matrix", m_matrix[0]);
-    joint_program->setUniformValue("lightMatrix", m_matrix[1]);
-    joint_program->setUniformValue("perspective", m_perspective);
-    joint_program->setUniformValue("normalMatrix", m_matrix[0].normalMatrix());
-    joint_program->setUniformValue("lightIntensity", 1.0f);
-    joint_program->setUniformValue("blinnPhong", blinnPhong);
-    joint_program->setUniformValue("transparent", transparent);
-    joint_program->setUniformValue("lightIntensity", lightIntensity);
-    joint_program->setUniformValue("shininess", shininess);
-    joint_program->setUniformValue("bouncesNb", bounces);
-    joint_program->setUniformValue("eta", eta);
-    joint_program->setUniformValue("kr", kr);
-    if (joint_program->uniformLocation("colorTexture") != -1) joint_program->setUniformValue("colorTexture", 0);
+    joint_program->setUniformValue(joint_uniforms.colorTexture, 0);
     joint_vao.bind();
 
     glDrawElements(GL_LINES, j_numIndices, GL_UNSIGNED_INT, 0);
     joint_vao.release();
     joint_program->release();
-
-	if(m_animated){
-		computeNextFrame();
+    // Regions drawn : not written again before the GPU is done with them
+    m_meshRing.fence();
+    m_jointRing.fence();
+    m_renderMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_renderSamples++;
+
+	if (m_animated) {
+		// Interpolated frames change continuously, otherwise wait for the next one
+		if (m_interpolate) renderLater();
+		else m_frameTimer.start(m_scheduler.msToNextFrame());
 	}
 
 }
@@ -4,6 +4,19 @@
 #include "openglwindow.h"
 #include "TriMesh.h"
 #include "joint.h"
+#include "skeleton.h"
+#include "animationbake.h"
+#include "framescheduler.h"
+#include "skininfluences.h"
+#include "skinningengine.h"
+#include "vertexcache.h"
+#include "skinlod.h"
+#include "skinbinding.h"
+#include "vertexorder.h"
+#include "dynamicbuffer.h"
+#include "vertexformat.h"
+#include "triangleorder.h"
+#include "programcache.h"
 
 #include <QtGui/QGuiApplication>
 #include <QtGui/QMatrix4x4>
@@ -15,12 +28,42 @@
 #include <QtGui/QOpenGLFunctions>
 #include <QtGui/QScreen>
 #include <QMouseEvent>
+#include <QTimer>
 
-struct skinningData {
-    int joint_id;
-    trimesh::point translation;
+// FrameParameters block of the shaders (std140) : camera, light and material
+// of the frame, written once per frame and read by every program
+struct FrameParameters {
+	float matrix[16];
+	float perspective[16];
+	float lightMatrix[16];
+	float matInverse[16];
+	float perspInverse[16];
+	float normalMatrix[12];		// 3 columns padded to vec4
+	float lightPosition[3];
+	float lightIntensity;
+	float center[3];
+	float radius;
+	float shininess;
+	float eta;
+	float kr;
+	int32_t bouncesNb;
+	int32_t blinnPhong;
+	int32_t transparent;
+	float pad[2];
+};
+
+// Uniforms a program gets on its own every frame, located once after it is
+// linked : -1 for those it does not have, which setUniformValue ignores
+struct UniformLocations {
+	int matrix, perspective;
+	int worldToLightspace, shadowMap;
+	int k_a, k_d;
+	int skinning, weightJoint;
+	int colorTexture, envMap, permTexture, computeResult;
+	int positionBias, positionScale;
+	int bbmin, bbmax, skinnedBounds, groundDistance, framebuffer;
 
-    skinningData(int id, trimesh::point trans) : joint_id(id), translation(trans) { }
+	void resolve(QOpenGLShaderProgram* program);
 };
 
 class glShaderWindow : public OpenGLWindow
@@ -71,6 +114,9 @@ protected:
 private:
     QOpenGLShaderProgram* prepareShaderProgram(const QString& vertexShaderPath, const QString& fragmentShaderPath);
     QOpenGLShaderProgram* prepareComputeProgram(const QString& computeShaderPath);
+    QOpenGLShaderProgram* linkProgram(const QString& vertexShaderPath, const QString& fragmentShaderPath,
+                                      const QString& computeShaderPath);
+    void printProgramStats();
     void createSSBO();
     void bindSceneToProgram();
     void initializeTransformForScene();
@@ -106,15 +152,67 @@ private:
     int j_numPoints;
     int j_numIndices;
     int j_weightedJointNb;
-    std::vector<std::vector<skinningData>> j_initialSkinningData;
+    std::vector<trimesh::point> j_bindVertices;	// joints in bind pose
     int m_frameNb;
     int m_maxFrameNb;
-    int m_timePrevFram;
     double m_frameTime;
 	bool m_animated;
+	bool m_interpolate;		// blend between frames instead of showing the nearest one
+	FrameScheduler m_scheduler;
+	QTimer m_frameTimer;	// next render when the shown frame changes
     std::vector<glm::mat4> j_vertTransMatrix;
-    // j_weightData[i][j]->poids du joint i sur le vertex j
-    std::vector<std::vector<double>> j_weightData;
+    // Influences of the joints on each vertex of modelMesh
+    SkinInfluences m_skin;
+    SkinningEngine m_skinning;
+    std::vector<SkinBatch> m_skinBatches;		// runs of vertices of m_skin moved by the same joints
+    // Vertices of modelMesh grouped by their joints, file order kept for weight files and vertex caches
+    VertexOrder m_vertexOrder;
+    // Triangles of modelMesh reordered at load for the vertex caches and overdraw
+    bool m_optimizeTriangles;
+    CacheStats m_fileCacheStats;
+    CacheStats m_meshCacheStats;
+    // GPU time of the draws of the model, read back a frame late
+    GLuint m_drawQuery;
+    bool m_drawQueryPending;
+    double m_drawMs;
+    int m_drawSamples;
+    SkinBinding m_binding;		// bones in bind pose, for the R and S weights
+    // Skinning in the vertex shaders : influences uploaded once, joint matrices per frame
+    bool m_gpuSkinning;
+    bool m_skinAttributesStale;		// influences or bind pose to upload again
+    bool m_skinWeightsStale;		// influence attributes to upload again
+    bool m_jointPaletteStale;
+    std::vector<glm::mat4> m_jointPalette;
+    GLuint m_jointPaletteUbo;
+    // Per-frame parameters of all the programs, then what each sets on its own
+    GLuint m_frameUbo;
+    UniformLocations m_uniforms;
+    UniformLocations ground_uniforms;
+    UniformLocations joint_uniforms;
+    UniformLocations shadowMap_uniforms;
+    UniformLocations compute_uniforms;
+    void resolveUniforms();
+    // Programs compiled once per driver, loaded from their binary since
+    ProgramCache m_programCache;
+    double m_linkMs;
+    // CPU time spent in render()
+    double m_renderMs;
+    int m_renderSamples;
+    // Skinned frames read back from disk instead of skinning, when open
+    VertexCache m_vertexCache;
+    // Skinning on the CPU at the level of detail of the size of the mesh on screen
+    bool m_skinLodEnabled;
+    SkinLod m_skinLod;
+    int m_lodLevel;
+    int m_lodSkipped;		// frames shown since the last skinning
+    std::vector<trimesh::point> m_lodScratch;
+    // Vertices skinned on the CPU and joint positions, written each frame into rings of regions
+    DynamicBuffer m_meshRing;
+    DynamicBuffer m_jointRing;
+    // Static attributes of the model and the ground, interleaved and quantized
+    PackedMesh m_packedMesh;
+    PackedMesh m_packedGround;
+    bool m_packedPositions;		// "vertex" of m_vao read from m_vertexBuffer, not floats from a ring or ssbo
     // GPGPU
     trimesh::point *gpgpu_vertices;
     trimesh::vec *gpgpu_normals;
@@ -125,6 +223,8 @@ private:
     int compute_groupsize_y;
     // ComputeShader:
     GLuint ssbo[4];
+    // Compute skinning inputs : bind vertices, bind normals, joints, weights, and the bounds of the pose
+    GLuint skin_ssbo[5];
     // Parameters controlled by UI
     bool blinnPhong;
     bool transparent;
@@ -142,16 +242,16 @@ private:
     QOpenGLShaderProgram *joint_program;
     QOpenGLShaderProgram *compute_program;
     QOpenGLShaderProgram *shadowMapGenerationProgram;
+    QOpenGLShaderProgram *skinning_program;
     QOpenGLTexture* environmentMap;
     QOpenGLTexture* texture;
     QOpenGLTexture* permTexture;   // for Perlin noise
     QOpenGLTexture* computeResult; // output of compute shader
     // Model
-    QOpenGLBuffer m_vertexBuffer;
+    QOpenGLBuffer m_vertexBuffer;	// PackedVertex of m_packedMesh
     QOpenGLBuffer m_indexBuffer;
-    QOpenGLBuffer m_normalBuffer;
-    QOpenGLBuffer m_colorBuffer;
-    QOpenGLBuffer m_texcoordBuffer;
+    QOpenGLBuffer m_skinJointBuffer;
+    QOpenGLBuffer m_skinWeightBuffer;
     QOpenGLVertexArrayObject m_vao;
     int m_numFaces;
 	QVector3D m_center;
@@ -159,11 +259,8 @@ private:
 	QVector3D m_bbmax;
     // Ground
     QOpenGLVertexArrayObject ground_vao;
-    QOpenGLBuffer ground_vertexBuffer;
+    QOpenGLBuffer ground_vertexBuffer;	// PackedVertex of m_packedGround
     QOpenGLBuffer ground_indexBuffer;
-    QOpenGLBuffer ground_normalBuffer;
-    QOpenGLBuffer ground_colorBuffer;
-    QOpenGLBuffer ground_texcoordBuffer;
 	// Joint
     QOpenGLVertexArrayObject joint_vao;
     QOpenGLBuffer joint_vertexBuffer;
@@ -188,19 +285,34 @@ private:
     float m_screenSize; // max window dimension
     QWidget* auxWidget; // window for parameters
     QWidget* container;
-	Joint* m_skeleton;
-	void waitFrame();
+	Skeleton* m_skeleton;
+	AnimationBake m_bake;	// per-frame joint tables, empty when evaluated live
     void computeNextFrame();
+    void goToFrame(int frame);
+    void setPose(int frame, float alpha = 0);
+    void advanceAnimation();
+    void printFrameStats();
     void updateJointVertexArray();
 	void printState();
 	void displayWeightColor(int jointId);
     void parseWeightFile(std::string fileName);
-	void animateMesh();
+	void animateMesh(trimesh::point* out);
     void rigidSkinning();
     void smoothSkinning();
     trimesh::point getMeshCenter();
-    trimesh::point animatePoint(trimesh::point,skinningData);
 	void updateMeshVertexArray();
+	// Where the mesh is deformed this frame
+	enum SkinningMode { CpuSkinning, ShaderSkinning, ComputeSkinning };
+	SkinningMode activeSkinning();
+	void uploadSkinWeights();
+	bool lodActive();
+	float screenRadius();
+	void setLodLevel(int level);
+	void uploadSkinning(SkinningMode mode);
+	void restartSkinning();
+	QString vertexCacheFileName();
+	void exportVertexCache();
+	void toggleVertexCache();
 	std::vector<trimesh::point> m_animatedMesh;
 	void fillSkinData();
 	bool _shift;
@@ -26,6 +26,16 @@ const std::string kZrot = "Zrotation";
 const std::string kOpenBracket = "{";
 const std::string kCloseBracket = "}";
 
+ChannelType channelTypeFromName(const std::string & name) {
+	if (name == kXpos) return chXpos;
+	if (name == kYpos) return chYpos;
+	if (name == kZpos) return chZpos;
+	if (name == kXrot) return chXrot;
+	if (name == kYrot) return chYrot;
+	if (name == kZrot) return chZrot;
+	return chUnknown;
+}
+
 Joint* Joint::createFromFile(std::string fileName, int & nb_children, int & nb_indices, int & maxFrameNb, double & frameTime) {
 	Joint* root = NULL;
     std::stack<Joint*> currentHierarchyStack;
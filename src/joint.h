@@ -13,15 +13,21 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// Kind of a dof, resolved from its name when the file is read
+enum ChannelType {chXpos=0, chYpos, chZpos, chXrot, chYrot, chZrot, chUnknown};
+
+ChannelType channelTypeFromName(const std::string & name);
+
 class AnimCurve {
 public :
-	AnimCurve() {};
-	AnimCurve(std::string n_name) : name(n_name) {};
+	AnimCurve() : type(chUnknown) {};
+	AnimCurve(std::string n_name) : name(n_name), type(channelTypeFromName(n_name)) {};
 	~AnimCurve() {
 		_values.clear();
 	}
 public :
 	std::string name;					// name of dof
+	ChannelType type;					// dof named by name
 	std::vector<double> _values;		// different keyframes = animation curve
 };
 
@@ -47,9 +53,10 @@ public :
 public :
 	// Constructor :
 	Joint() {};
-	// Destructor :
+	// Destructor (frees the whole subtree) :
 	~Joint() {
 		_dofs.clear();
+		for (Joint* child : _children) delete child;
 		_children.clear();
 	}
 
@@ -86,6 +93,7 @@ public :
     void computePointPositions(std::vector<trimesh::point> & positions, std::vector<glm::mat4> & transMatrix);
 
 private :
+	friend class BvhLoader;
     int _id;           // id of Joint
     void fillAnimCurve(std::ifstream & inputfile);
     void recursiveFillPointPositions(glm::mat4 parentMatrix, std::vector<trimesh::point> & positions, std::vector<glm::mat4> & transMatrix);
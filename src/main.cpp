@@ -11,6 +11,8 @@
 #include <QHBoxLayout>
 
 #include "glshaderwindow.h"
+#include "weightfile.h"
+#include "benchmark.h"
 
 static QSignalMapper sizeMapper;
 static QSignalMapper shaderMapper;
@@ -19,6 +21,8 @@ void printUsage(const char *myname)
 {
     fprintf(stderr, "\n");
     fprintf(stderr, "\n Usage    : %s [infile]\n", myname);
+    fprintf(stderr, "            %s -benchmark\n", myname);
+    fprintf(stderr, "            %s -exportweights weights.txt\n", myname);
     exit(1);
 }
 
@@ -139,11 +143,17 @@ int main( int argc, char* argv[] )
 
     // Read scene name from arguments:
     QStringList arguments = app.arguments();
+    bool benchmark = false;
     for (int i = 1; i < arguments.size(); i++)
     {
         const QString& arg = arguments[i];
         if (i == 1 && !arg.startsWith("-")) {
             sceneName = arg;
+        } else if (arg == "-benchmark") {
+            benchmark = true;
+        } else if (arg == "-exportweights" && i + 1 < arguments.size()) {
+            // Sparse text and binary copies of a weight file, no window needed
+            return WeightFile::exportFile(arguments[i + 1].toStdString()) ? 0 : 1;
         } else printUsage(argv[0]);
     }
 
@@ -169,6 +179,9 @@ int main( int argc, char* argv[] )
 #else
     appPath = appPath + "/models/";
 #endif
+    // Timings on the bundled files, no window needed
+    if (benchmark) return runBenchmarks(appPath.toStdString());
+
     window->setWorkingDirectory(appPath, sceneName, textureName, envMapName);
     // Embedding a QWindow in a QWidget, only way to combine it with widgets
     QWidget * container = QWidget::createWindowContainer(window);
@@ -0,0 +1,52 @@
+#include "mappedfile.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+bool MappedFile::open(const std::string & fileName) {
+	close();
+	int fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference on the file
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		return false;
+	}
+	// Files are read front to back
+	madvise(addr, st.st_size, MADV_SEQUENTIAL);
+	_data = static_cast<const char*>(addr);
+	_size = st.st_size;
+	return true;
+}
+
+void MappedFile::close() {
+	if (_data != NULL) {
+		munmap(const_cast<char*>(_data), _size);
+	}
+	_data = NULL;
+	_size = 0;
+}
+
+bool writeFileAtomically(const std::string & fileName, const void* data, size_t size) {
+	return writeFileAtomically(fileName, [data, size](FILE* out) { return fwrite(data, 1, size, out) == size; });
+}
+
+void MappedFile::willNeed(size_t offset, size_t length) const {
+	if (_data == NULL || offset >= _size) return;
+	// madvise wants a page-aligned start
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t begin = offset / page * page;
+	size_t end = std::min(_size, offset + length);
+	madvise(const_cast<char*>(_data) + begin, end - begin, MADV_WILLNEED);
+}
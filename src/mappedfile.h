@@ -0,0 +1,59 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <string>
+#include <cstddef>
+#include <cstdio>
+
+// Read-only view of a whole file mapped in memory (POSIX mmap).
+// The mapping lives as long as the object : tokens pointing into data()
+// must not outlive it.
+class MappedFile {
+public :
+	MappedFile() : _data(NULL), _size(0) {};
+	~MappedFile() { close(); }
+
+	bool open(const std::string & fileName);
+	void close();
+
+	bool isOpen() const { return _data != NULL; }
+	const char* data() const { return _data; }
+	const char* end() const { return _data + _size; }
+	size_t size() const { return _size; }
+	// Asks the kernel to start reading a range ahead of its use
+	void willNeed(size_t offset, size_t length) const;
+
+private :
+	MappedFile(const MappedFile &);
+	MappedFile & operator=(const MappedFile &);
+
+	const char* _data;
+	size_t _size;
+};
+
+// Sections of the binary files start on 8 bytes
+inline size_t align8(size_t n) {
+	return (n + 7) & ~size_t(7);
+}
+
+// Writes fileName through write(FILE*), which returns false on failure.
+// The file is written aside then renamed, so a reader never maps a partial
+// one; nothing is left behind on failure.
+template<typename Write>
+bool writeFileAtomically(const std::string & fileName, Write write) {
+	std::string tmpName = fileName + ".tmp";
+	FILE* out = fopen(tmpName.c_str(), "wb");
+	if (out == NULL) return false;
+	bool ok = write(out);
+	ok = (fclose(out) == 0) && ok;
+	if (!ok || rename(tmpName.c_str(), fileName.c_str()) != 0) {
+		remove(tmpName.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Same, from a buffer
+bool writeFileAtomically(const std::string & fileName, const void* data, size_t size);
+
+#endif
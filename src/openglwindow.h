@@ -41,8 +41,10 @@
 #include <QtGui/QWindow>
 #ifndef __APPLE__
 #include <QOpenGLFunctions_4_3_Core>
+typedef QOpenGLFunctions_4_3_Core OpenGLFunctions;
 #else
 #include <QOpenGLFunctions_4_1_Core>
+typedef QOpenGLFunctions_4_1_Core OpenGLFunctions;
 #endif
 
 
@@ -54,11 +56,7 @@ class QOpenGLPaintDevice;
 QT_END_NAMESPACE
 
 //! [1]
-#ifndef __APPLE__
-class OpenGLWindow : public QWindow, protected QOpenGLFunctions_4_3_Core
-#else
-class OpenGLWindow : public QWindow, protected QOpenGLFunctions_4_1_Core
-#endif
+class OpenGLWindow : public QWindow, protected OpenGLFunctions
 {
     Q_OBJECT
 public:
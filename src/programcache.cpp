@@ -0,0 +1,132 @@
+#include "programcache.h"
+#include "fnvhash.h"
+#include "mappedfile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char kMagic[4] = {'P', 'R', 'G', 'B'};
+const uint32_t kVersion = 1;
+
+std::string glString(OpenGLFunctions* gl, GLenum name) {
+	const GLubyte* s = gl->glGetString(name);
+	return s ? std::string((const char*)s) : std::string();
+}
+
+}
+
+ProgramCache::ProgramCache() : _gl(NULL), _enabled(false), _driverHash(0) {
+	_stats.compiled = _stats.fromMemory = _stats.fromDisk = 0;
+}
+
+void ProgramCache::setContext(OpenGLFunctions* gl, const std::string & directory) {
+	_gl = gl;
+	_directory = directory;
+	std::string driver = glString(gl, GL_VENDOR) + "\n" + glString(gl, GL_RENDERER) + "\n" + glString(gl, GL_VERSION);
+	uint64_t driverHash = fnv1a(driver.data(), driver.size());
+	// Binaries of another context may not load in this one
+	if (driverHash != _driverHash) _binaries.clear();
+	_driverHash = driverHash;
+	GLint nbFormats = 0;
+	_gl->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nbFormats);
+	_enabled = nbFormats > 0;
+}
+
+std::string ProgramCache::fileName(const std::string & directory, uint64_t key) {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return directory + name;
+}
+
+uint64_t ProgramCache::key(const std::vector<std::string> & sourceFiles) const {
+	if (!_enabled) return 0;
+	uint64_t h = fnv1a((const char*)&_driverHash, sizeof(_driverHash));
+	for (size_t i = 0; i < sourceFiles.size(); i++) {
+		MappedFile file;
+		if (!file.open(sourceFiles[i])) return 0;
+		// Sizes first, so that no two lists of sources hash the same bytes
+		uint64_t size = file.size();
+		h = fnv1a((const char*)&size, sizeof(size), h);
+		h = fnv1a(file.data(), file.size(), h);
+	}
+	return h;
+}
+
+QOpenGLShaderProgram* ProgramCache::load(uint64_t key, QObject* parent) {
+	if (!_enabled || key == 0) return NULL;
+	std::map<uint64_t, Binary>::iterator it = _binaries.find(key);
+	bool fromDisk = (it == _binaries.end());
+	if (fromDisk) {
+		Binary binary;
+		if (!read(fileName(_directory, key), key, binary.format, binary.data)) return NULL;
+		it = _binaries.insert(std::make_pair(key, binary)).first;
+	}
+	QOpenGLShaderProgram* program = new QOpenGLShaderProgram(parent);
+	if (program->create()) {
+		_gl->glProgramBinary(program->programId(), it->second.format, it->second.data.data(), it->second.data.size());
+		// Without shaders, link only reads the status left by glProgramBinary
+		if (program->link()) {
+			if (fromDisk) _stats.fromDisk++;
+			else _stats.fromMemory++;
+			return program;
+		}
+	}
+	// Driver updated without changing its strings : compiled again, then stored over it
+	delete program;
+	_binaries.erase(it);
+	return NULL;
+}
+
+void ProgramCache::markRetrievable(QOpenGLShaderProgram* program) {
+	_stats.compiled++;
+	if (_enabled && program->programId() != 0) {
+		_gl->glProgramParameteri(program->programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+}
+
+void ProgramCache::store(uint64_t key, QOpenGLShaderProgram* program) {
+	if (!_enabled || key == 0 || !program->isLinked() || _binaries.count(key) > 0) return;
+	GLint length = 0;
+	_gl->glGetProgramiv(program->programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+	Binary binary;
+	binary.data.resize(length);
+	GLsizei written = 0;
+	GLenum format = 0;
+	_gl->glGetProgramBinary(program->programId(), length, &written, &format, binary.data.data());
+	if (written <= 0) return;
+	binary.data.resize(written);
+	binary.format = format;
+	_binaries.insert(std::make_pair(key, binary));
+	if (!write(fileName(_directory, key), key, binary.format, binary.data)) {
+		std::cerr << "Could not write the program cache " << fileName(_directory, key) << std::endl;
+	}
+}
+
+bool ProgramCache::read(const std::string & fileName, uint64_t key, uint32_t & format, std::vector<char> & binary) {
+	MappedFile file;
+	if (!file.open(fileName) || file.size() < sizeof(ProgramBinaryHeader)) return false;
+	const ProgramBinaryHeader & h = *reinterpret_cast<const ProgramBinaryHeader*>(file.data());
+	if (memcmp(h.magic, kMagic, 4) != 0 || h.version != kVersion || h.key != key) return false;
+	if (sizeof(ProgramBinaryHeader) + h.size != file.size()) return false;
+	format = h.format;
+	binary.assign(file.data() + sizeof(ProgramBinaryHeader), file.end());
+	return true;
+}
+
+bool ProgramCache::write(const std::string & fileName, uint64_t key, uint32_t format, const std::vector<char> & binary) {
+	ProgramBinaryHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, kMagic, 4);
+	h.version = kVersion;
+	h.key = key;
+	h.format = format;
+	h.size = binary.size();
+	return writeFileAtomically(fileName, [&h, &binary](FILE* out) {
+		return fwrite(&h, 1, sizeof(h), out) == sizeof(h)
+		    && fwrite(binary.data(), 1, binary.size(), out) == binary.size();
+	});
+}
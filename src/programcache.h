@@ -0,0 +1,74 @@
+#ifndef _PROGRAMCACHE_H_
+#define _PROGRAMCACHE_H_
+
+#include "openglwindow.h"
+#include <QtGui/QOpenGLShaderProgram>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Linked programs kept as glGetProgramBinary blobs, so that a program is
+// compiled once per driver : the programs of the same sources made later in
+// the session, or in the next runs, are loaded from the binary. A key hashes
+// the driver strings and the shader sources; the blobs are kept in memory
+// and written to directory/<key>.bin.
+//
+// File layout (native endianness) :
+//   ProgramBinaryHeader
+//   binary    : size bytes, in the driver format
+struct ProgramBinaryHeader {
+	char magic[4];				// "PRGB"
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;			// from glGetProgramBinary
+	uint32_t size;
+};
+
+class ProgramCache {
+public :
+	struct Stats {
+		int compiled;
+		int fromMemory;
+		int fromDisk;
+	};
+
+	ProgramCache();
+
+	// Driver of the current context, read once it is made. Nothing is cached
+	// without binary formats.
+	void setContext(OpenGLFunctions* gl, const std::string & directory);
+	bool isEnabled() const { return _enabled; }
+
+	// Hash of the driver and of the content of the files, 0 if one cannot be read
+	uint64_t key(const std::vector<std::string> & sourceFiles) const;
+	// Program of the binary of key, linked. NULL when there is none or the
+	// driver rejects it : the sources are to be compiled.
+	QOpenGLShaderProgram* load(uint64_t key, QObject* parent);
+	// Before linking a program compiled from its sources, to store it after
+	void markRetrievable(QOpenGLShaderProgram* program);
+	// Keeps the binary of a program just linked from its sources
+	void store(uint64_t key, QOpenGLShaderProgram* program);
+
+	const Stats & stats() const { return _stats; }
+
+	static std::string fileName(const std::string & directory, uint64_t key);
+	// Binary of a cache file, false if unreadable or not made for key
+	static bool read(const std::string & fileName, uint64_t key, uint32_t & format, std::vector<char> & binary);
+	static bool write(const std::string & fileName, uint64_t key, uint32_t format, const std::vector<char> & binary);
+
+private :
+	struct Binary {
+		uint32_t format;
+		std::vector<char> data;
+	};
+
+	OpenGLFunctions* _gl;
+	bool _enabled;
+	std::string _directory;
+	uint64_t _driverHash;
+	std::map<uint64_t, Binary> _binaries;
+	Stats _stats;
+};
+
+#endif
@@ -0,0 +1,382 @@
+#include "skeleton.h"
+#include "eulerkernel.h"
+
+#include <stack>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+const size_t kAlign = 16;
+
+inline size_t alignUp(size_t n) {
+	return (n + kAlign - 1) & ~(kAlign - 1);
+}
+
+// Hands out consecutive aligned arrays of the skeleton block
+template<typename T>
+T* carve(unsigned char* & cursor, int n) {
+	T* array = reinterpret_cast<T*>(cursor);
+	cursor += alignUp(n * sizeof(T));
+	return array;
+}
+
+enum JointFlag {
+	kStaticJoint = 1,		// all channels constant over the clip : local transform computed once
+	kNoRotation = 2,		// static with a null rotation : world = parent translated
+	kChanged = 4			// world matrix evaluated again by the current call
+};
+
+// World matrix of a joint from the world matrix of its parent and its local
+// rotation (row-major, entry k at rot[k * stride]) and translation, as a
+// 3x4 affine transform : the last row of the matrices is never multiplied.
+inline void composeJoint(const glm::mat4* parent, const float* rot, int stride, const glm::vec3 & local, glm::mat4 & world) {
+	if (parent == NULL) {
+		world = glm::mat4(1.0);
+		for (int c = 0; c < 3; c++) {
+			world[c] = glm::vec4(rot[c * stride], rot[(3 + c) * stride], rot[(6 + c) * stride], 0.0f);
+		}
+		world[3] = glm::vec4(local, 1.0f);
+	} else {
+		const glm::mat4 & p = *parent;
+		for (int c = 0; c < 3; c++) {
+			world[c] = p[0] * rot[c * stride] + p[1] * rot[(3 + c) * stride] + p[2] * rot[(6 + c) * stride];
+		}
+		world[3] = p[0] * local.x + p[1] * local.y + p[2] * local.z + p[3];
+	}
+}
+
+// World matrices of all joints from their local translation and rotation,
+// given by pose(joint, t, r). Rotations are computed kEulerBatch joints at
+// a time, then each joint composes with its parent.
+template<typename Pose>
+void composeWorld(const Skeleton & skeleton, const Pose & pose, trimesh::point* positions, glm::mat4* transMatrix) {
+	int nbJoints = skeleton.nbJoints();
+	int order = skeleton.uniformRotateOrder();
+	for (int b = 0; b < nbJoints; b += kEulerBatch) {
+		int n = std::min(kEulerBatch, nbJoints - b);
+		glm::vec3 t[kEulerBatch];
+		float rx[kEulerBatch], ry[kEulerBatch], rz[kEulerBatch];
+		for (int i = 0; i < n; i++) {
+			glm::vec3 r;
+			pose(b + i, t[i], r);
+			rx[i] = r.x;
+			ry[i] = r.y;
+			rz[i] = r.z;
+		}
+		float rot[9][kEulerBatch];
+		if (order >= 0) {
+			eulerBatch((RotateOrder)order, n, rx, ry, rz, rot);
+		} else {
+			for (int i = 0; i < n; i++) {
+				eulerRotation((RotateOrder)skeleton._rotateOrder[b + i], rx[i], ry[i], rz[i], &rot[0][i], kEulerBatch);
+			}
+		}
+
+		for (int i = 0; i < n; i++) {
+			int j = b + i;
+			int parent = skeleton._parent[j];
+			// Parents are always already computed
+			composeJoint(parent < 0 ? NULL : &transMatrix[parent], &rot[0][i], kEulerBatch, skeleton._offset[j] + t[i], transMatrix[j]);
+			positions[j] = trimesh::point(transMatrix[j][3]);
+		}
+	}
+}
+
+}
+
+Skeleton::Skeleton(int nbJoints, int nbChannels) : _nbJoints(nbJoints), _nbChannels(nbChannels), _nbFrames(0), _frameTime(0), _uniformOrder(roZYX),
+                                                   _nbStaticChannels(0), _nbStaticJoints(0), _cacheValid(false) {
+	size_t size = 4 * alignUp(nbJoints * sizeof(int)) + 3 * alignUp(nbJoints * sizeof(glm::vec3))
+	            + 2 * alignUp(nbJoints) + alignUp(nbChannels) + alignUp(nbChannels * sizeof(int))
+	            + 3 * alignUp(nbJoints * sizeof(glm::vec3)) + alignUp(9 * nbJoints * sizeof(float)) + alignUp(nbJoints * sizeof(glm::mat4));
+	_block = static_cast<unsigned char*>(aligned_alloc(kAlign, size));
+	unsigned char* cursor = _block;
+	_parent = carve<int>(cursor, nbJoints);
+	_channelBegin = carve<int>(cursor, nbJoints);
+	_channelCount = carve<int>(cursor, nbJoints);
+	_offset = carve<glm::vec3>(cursor, nbJoints);
+	_pose = carve<glm::vec3>(cursor, 2 * nbJoints);
+	_rotateOrder = carve<unsigned char>(cursor, nbJoints);
+	_channelType = carve<unsigned char>(cursor, nbChannels);
+	_channelSlot = carve<int>(cursor, nbChannels);
+	_jointFlags = carve<unsigned char>(cursor, nbJoints);
+	_cachedPose = carve<glm::vec3>(cursor, 2 * nbJoints);
+	_localRot = carve<float>(cursor, 9 * nbJoints);
+	_localT = carve<glm::vec3>(cursor, nbJoints);
+	_world = carve<glm::mat4>(cursor, nbJoints);
+	_dirty = carve<int>(cursor, nbJoints);
+	_names.resize(nbJoints);
+	std::fill(_pose, _pose + 2 * nbJoints, glm::vec3(0.0f));
+	std::fill(_jointFlags, _jointFlags + nbJoints, 0);
+	resetPoseStats();
+}
+
+Skeleton::~Skeleton() {
+	free(_block);
+}
+
+Skeleton* Skeleton::fromJoint(const Joint* root) {
+	if (root == NULL) return NULL;
+
+	// Depth-first order, children in file order : same numbering as the tree
+	std::vector<const Joint*> order;
+	std::vector<int> parents;
+	std::stack<std::pair<const Joint*, int> > dfs;
+	dfs.push(std::make_pair(root, -1));
+	int nbChannels = 0;
+	while (!dfs.empty()) {
+		const Joint* j = dfs.top().first;
+		int parent = dfs.top().second;
+		dfs.pop();
+		int id = order.size();
+		order.push_back(j);
+		parents.push_back(parent);
+		nbChannels += j->_dofs.size();
+		for (int i = j->_children.size() - 1; i >= 0; i--) {
+			dfs.push(std::make_pair(j->_children[i], id));
+		}
+	}
+
+	Skeleton* skeleton = new Skeleton(order.size(), nbChannels);
+	int c = 0;
+	for (int i = 0; i < skeleton->_nbJoints; i++) {
+		const Joint* j = order[i];
+		skeleton->_names[i] = j->_name;
+		skeleton->_parent[i] = parents[i];
+		skeleton->_offset[i] = glm::vec3(j->_offX, j->_offY, j->_offZ);
+		skeleton->_channelBegin[i] = c;
+		skeleton->_channelCount[i] = j->_dofs.size();
+		for (const AnimCurve & dof : j->_dofs) {
+			skeleton->_channelType[c++] = dof.type;
+		}
+	}
+	skeleton->bindChannels();
+
+	// Curves filled by the parser : transpose them into frame rows
+	int nbFrames = 0;
+	for (const Joint* j : order) {
+		if (!j->_dofs.empty()) {
+			nbFrames = j->_dofs[0]._values.size();
+			break;
+		}
+	}
+	std::vector<float> motion(nbFrames * nbChannels);
+	c = 0;
+	for (const Joint* j : order) {
+		for (const AnimCurve & dof : j->_dofs) {
+			for (int f = 0; f < nbFrames && f < (int)dof._values.size(); f++) {
+				motion[f * nbChannels + c] = dof._values[f];
+			}
+			c++;
+		}
+	}
+	skeleton->setMotion(nbFrames, 0, motion);
+	return skeleton;
+}
+
+void Skeleton::bindChannels() {
+	// Order of the joints that rotate, -2 until the first one
+	int uniform = -2;
+	for (int j = 0; j < _nbJoints; j++) {
+		int end = _channelBegin[j] + _channelCount[j];
+		bool rotates = false;
+		for (int c = _channelBegin[j]; c < end; c++) {
+			// translation x,y,z then rotation x,y,z of joint j
+			_channelSlot[c] = (_channelType[c] == chUnknown) ? -1 : 6 * j + _channelType[c];
+			if (_channelType[c] >= chXrot && _channelType[c] <= chZrot) rotates = true;
+		}
+		_rotateOrder[j] = rotateOrderFromChannels(_channelType + _channelBegin[j], _channelCount[j]);
+		if (!rotates) continue;
+		if (uniform == -2) uniform = _rotateOrder[j];
+		else if (_rotateOrder[j] != uniform) uniform = -1;
+	}
+	_uniformOrder = (uniform == -2) ? roXYZ : uniform;
+	// Joints without rotation channels (End Sites) stay at the identity in
+	// any order : given the common one, they do not break the batches
+	if (_uniformOrder >= 0) {
+		for (int j = 0; j < _nbJoints; j++) _rotateOrder[j] = _uniformOrder;
+	}
+}
+
+void Skeleton::setMotion(int nbFrames, double frameTime, std::vector<float> & motion) {
+	_nbFrames = nbFrames;
+	_frameTime = frameTime;
+	_motion.swap(motion);
+	motion.clear();
+	findStaticChannels();
+}
+
+void Skeleton::findStaticChannels() {
+	// A channel is static when every frame has the value of the first one
+	std::vector<char> isStatic(_nbChannels, _nbFrames > 0);
+	for (int f = 1; f < _nbFrames; f++) {
+		const float* row = frame(f);
+		for (int c = 0; c < _nbChannels; c++) {
+			if (row[c] != _motion[c]) isStatic[c] = false;
+		}
+	}
+
+	// Joints with only static channels (End sites have none) get their
+	// local transform now and are never compared nor rotated again
+	_nbStaticChannels = 0;
+	_nbStaticJoints = 0;
+	for (int j = 0; j < _nbJoints; j++) {
+		int end = _channelBegin[j] + _channelCount[j];
+		bool jointStatic = true;
+		for (int c = _channelBegin[j]; c < end; c++) {
+			if (isStatic[c]) _nbStaticChannels++;
+			else jointStatic = false;
+		}
+		_jointFlags[j] = 0;
+		if (!jointStatic) continue;
+
+		_nbStaticJoints++;
+		glm::vec3 dofs[2] = {glm::vec3(0.0f), glm::vec3(0.0f)};
+		for (int c = _channelBegin[j]; c < end; c++) {
+			if (_channelSlot[c] >= 0) (&dofs[0].x)[_channelSlot[c] - 6 * j] = _motion[c];
+		}
+		_cachedPose[2 * j] = dofs[0];
+		_cachedPose[2 * j + 1] = dofs[1];
+		_localT[j] = _offset[j] + dofs[0];
+		eulerRotation((RotateOrder)_rotateOrder[j], dofs[1].x, dofs[1].y, dofs[1].z, &_localRot[9 * j]);
+		_jointFlags[j] = (dofs[1] == glm::vec3(0.0f)) ? kStaticJoint | kNoRotation : kStaticJoint;
+	}
+	_cacheValid = false;
+}
+
+void Skeleton::resetPoseStats() {
+	memset(&_poseStats, 0, sizeof(_poseStats));
+}
+
+void Skeleton::setPose(const float* row) {
+	float* pose = &_pose[0].x;
+	memset(pose, 0, 2 * _nbJoints * sizeof(glm::vec3));
+	for (int c = 0; c < _nbChannels; c++) {
+		if (_channelSlot[c] >= 0) pose[_channelSlot[c]] = row[c];
+	}
+}
+
+void Skeleton::animate(int iframe, int nextFrame, float alpha) {
+	float* pose = &_pose[0].x;
+	memset(pose, 0, 2 * _nbJoints * sizeof(glm::vec3));
+	const float* row = frame(iframe);
+	const float* next = frame(nextFrame);
+	for (int c = 0; c < _nbChannels; c++) {
+		if (_channelSlot[c] < 0) continue;
+		float delta = next[c] - row[c];
+		if (_channelType[c] >= chXrot) {
+			if (delta > 180) delta -= 360;
+			else if (delta < -180) delta += 360;
+		}
+		pose[_channelSlot[c]] = row[c] + alpha * delta;
+	}
+}
+
+void Skeleton::computeIndicesArray(std::vector<int> & indicesVector) const {
+	// One bone per joint but the root, in the order of the recursive version
+	for (int j = 1; j < _nbJoints; j++) {
+		indicesVector.push_back(_parent[j]);
+		indicesVector.push_back(j);
+	}
+}
+
+void Skeleton::initPointPositions(std::vector<trimesh::point> & positions, trimesh::point decalage) const {
+	positions[0] = trimesh::point(decalage[0], decalage[1], decalage[2], 1);
+	for (int j = 1; j < _nbJoints; j++) {
+		const trimesh::point & p = positions[_parent[j]];
+		positions[j] = trimesh::point(p[0] + _offset[j].x, p[1] + _offset[j].y, p[2] + _offset[j].z, 1);
+	}
+}
+
+void Skeleton::computePointPositions(std::vector<trimesh::point> & positions, std::vector<glm::mat4> & transMatrix) {
+	// Joints whose values changed since the previous call. Static joints keep
+	// the values of the clip and are only composed again under a moving parent.
+	int nbRotations = 0;
+	for (int j = 0; j < _nbJoints; j++) {
+		if (_jointFlags[j] & kStaticJoint) {
+			_jointFlags[j] = _cacheValid ? _jointFlags[j] & ~kChanged : _jointFlags[j] | kChanged;
+			continue;
+		}
+		_jointFlags[j] &= ~kChanged;
+		const glm::vec3 & t = translation(j);
+		const glm::vec3 & r = rotation(j);
+		if (!_cacheValid || r != _cachedPose[2 * j + 1]) {
+			_cachedPose[2 * j + 1] = r;
+			_dirty[nbRotations++] = j;
+			_jointFlags[j] |= kChanged;
+		}
+		if (!_cacheValid || t != _cachedPose[2 * j]) {
+			_cachedPose[2 * j] = t;
+			_localT[j] = _offset[j] + t;
+			_jointFlags[j] |= kChanged;
+		}
+	}
+
+	// Their rotations, kEulerBatch at a time
+	for (int b = 0; b < nbRotations; b += kEulerBatch) {
+		int n = std::min(kEulerBatch, nbRotations - b);
+		const int* joints = _dirty + b;
+		if (_uniformOrder >= 0) {
+			float rx[kEulerBatch], ry[kEulerBatch], rz[kEulerBatch];
+			for (int i = 0; i < n; i++) {
+				const glm::vec3 & r = _cachedPose[2 * joints[i] + 1];
+				rx[i] = r.x;
+				ry[i] = r.y;
+				rz[i] = r.z;
+			}
+			float rot[9][kEulerBatch];
+			eulerBatch((RotateOrder)_uniformOrder, n, rx, ry, rz, rot);
+			for (int i = 0; i < n; i++) {
+				for (int k = 0; k < 9; k++) _localRot[9 * joints[i] + k] = rot[k][i];
+			}
+		} else {
+			for (int i = 0; i < n; i++) {
+				const glm::vec3 & r = _cachedPose[2 * joints[i] + 1];
+				eulerRotation((RotateOrder)_rotateOrder[joints[i]], r.x, r.y, r.z, &_localRot[9 * joints[i]]);
+			}
+		}
+	}
+
+	// Subtrees of the changed joints : parents always come first
+	int evaluated = 0;
+	for (int j = 0; j < _nbJoints; j++) {
+		int parent = _parent[j];
+		if (parent >= 0 && (_jointFlags[parent] & kChanged)) _jointFlags[j] |= kChanged;
+		if (!(_jointFlags[j] & kChanged)) continue;
+		evaluated++;
+		if ((_jointFlags[j] & kNoRotation) && parent >= 0) {
+			// Constant translation folded into the parent matrix
+			const glm::mat4 & p = _world[parent];
+			_world[j] = p;
+			_world[j][3] = p[0] * _localT[j].x + p[1] * _localT[j].y + p[2] * _localT[j].z + p[3];
+		} else {
+			composeJoint(parent < 0 ? NULL : &_world[parent], &_localRot[9 * j], 1, _localT[j], _world[j]);
+		}
+	}
+	_cacheValid = true;
+
+	for (int j = 0; j < _nbJoints; j++) {
+		transMatrix[j] = _world[j];
+		positions[j] = trimesh::point(_world[j][3]);
+	}
+	_poseStats.poses++;
+	_poseStats.joints += _nbJoints;
+	_poseStats.evaluated += evaluated;
+	_poseStats.rotations += nbRotations;
+}
+
+void Skeleton::evaluateRow(const float* row, trimesh::point* positions, glm::mat4* transMatrix) const {
+	auto pose = [this, row](int j, glm::vec3 & t, glm::vec3 & r) {
+		// translation x,y,z then rotation x,y,z, as in _pose
+		glm::vec3 dofs[2] = {glm::vec3(0.0f), glm::vec3(0.0f)};
+		int end = _channelBegin[j] + _channelCount[j];
+		for (int c = _channelBegin[j]; c < end; c++) {
+			if (_channelSlot[c] >= 0) (&dofs[0].x)[_channelSlot[c] - 6 * j] = row[c];
+		}
+		t = dofs[0];
+		r = dofs[1];
+	};
+	composeWorld(*this, pose, positions, transMatrix);
+}
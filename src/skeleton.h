@@ -0,0 +1,114 @@
+#ifndef _SKELETON_H_
+#define _SKELETON_H_
+
+#include "joint.h"
+
+// Flat version of the Joint tree used at runtime.
+// Joints are stored in depth-first order (same ids as the tree) so that a
+// parent always comes before its children : world matrices are computed
+// with a single forward loop instead of a recursion.
+// All per-joint and per-channel arrays live in one allocation, released
+// with the skeleton.
+//
+// The motion is a frame-major float matrix : frame f is the row
+// _motion[f * nbChannels() .. (f+1) * nbChannels()[, in file order. Each
+// channel is bound at load time to the pose value it drives, so animate()
+// is a linear copy of one row.
+// World matrices are built with the closed-form Euler kernels of
+// eulerkernel.h, in the rotation order of each joint.
+// computePointPositions keeps the local transforms and world matrices of the
+// previous call : channels constant over the clip are found by setMotion and
+// their joints are never rotated again, and only the subtrees of the joints
+// whose values changed are composed again.
+class Skeleton {
+public :
+	~Skeleton();
+
+	// Copy of a tree loaded from a .bvh (the tree can be deleted afterwards)
+	static Skeleton* fromJoint(const Joint* root);
+	// Takes over a frame-major matrix of nbFrames rows (the vector is emptied)
+	void setMotion(int nbFrames, double frameTime, std::vector<float> & motion);
+
+	int nbJoints() const { return _nbJoints; }
+	int nbChannels() const { return _nbChannels; }
+	int nbFrames() const { return _nbFrames; }
+	// Channels constant over the whole clip, and joints with only such channels
+	int nbStaticChannels() const { return _nbStaticChannels; }
+	int nbStaticJoints() const { return _nbStaticJoints; }
+	// Rotation order shared by all joints, -1 if they differ
+	int uniformRotateOrder() const { return _uniformOrder; }
+	double frameTime() const { return _frameTime; }
+	const float* frame(int iframe) const { return &_motion[iframe * _nbChannels]; }
+
+	// Joints evaluated by computePointPositions
+	struct PoseStats {
+		long long poses;					// calls
+		long long joints;					// joints in these poses
+		long long evaluated;				// joints composed again
+		long long rotations;				// local rotations computed again
+	};
+	const PoseStats & poseStats() const { return _poseStats; }
+	void resetPoseStats();
+
+	// Current pose
+	const glm::vec3 & translation(int joint) const { return _pose[2 * joint]; }
+	const glm::vec3 & rotation(int joint) const { return _pose[2 * joint + 1]; }	// about X, Y, Z (deg)
+
+	void animate(int iframe=0) { setPose(frame(iframe)); }
+	void setPose(const float* row);
+	// Pose between iframe (alpha = 0) and nextFrame (alpha = 1), rotations
+	// taking the short way around
+	void animate(int iframe, int nextFrame, float alpha);
+	void computeIndicesArray(std::vector<int> & indicesVector) const;
+	void initPointPositions(std::vector<trimesh::point> & positions, trimesh::point decalage) const;
+	// World matrices of the current pose. Only the joints whose values changed
+	// since the previous call, and their subtrees, are evaluated again.
+	void computePointPositions(std::vector<trimesh::point> & positions, std::vector<glm::mat4> & transMatrix);
+	// Same result as animate(iframe) + computePointPositions, without touching
+	// the current pose : safe to call from several threads.
+	void evaluateFrame(int iframe, trimesh::point* positions, glm::mat4* transMatrix) const { evaluateRow(frame(iframe), positions, transMatrix); }
+	// Same for a row of channel values that is not in the motion (resampled, decompressed...)
+	void evaluateRow(const float* row, trimesh::point* positions, glm::mat4* transMatrix) const;
+
+public :
+	std::vector<std::string> _names;	// name of each joint
+	std::vector<float> _motion;			// nbFrames x nbChannels
+	// Per joint, inside _block :
+	int* _parent;						// index of the parent joint, -1 for root
+	int* _channelBegin;					// first channel of the joint in a frame
+	int* _channelCount;					// number of channels of the joint
+	glm::vec3* _offset;					// initial offset
+	unsigned char* _rotateOrder;		// RotateOrder, from the order of the rotation channels
+	// Per channel, inside _block :
+	unsigned char* _channelType;		// ChannelType
+	int* _channelSlot;					// float index in _pose written by the channel, -1 if none
+
+private :
+	friend class BvhCache;
+	Skeleton(int nbJoints, int nbChannels);
+	void bindChannels();
+	void findStaticChannels();
+	Skeleton(const Skeleton &);
+	Skeleton & operator=(const Skeleton &);
+
+	int _nbJoints;
+	int _nbChannels;
+	int _nbFrames;
+	double _frameTime;
+	int _uniformOrder;
+	int _nbStaticChannels;
+	int _nbStaticJoints;
+	glm::vec3* _pose;					// translation, rotation of each joint
+	// Incremental evaluation, inside _block :
+	unsigned char* _jointFlags;			// kStaticJoint, kNoRotation
+	glm::vec3* _cachedPose;				// pose _world was computed from
+	float* _localRot;					// 9 per joint, row-major
+	glm::vec3* _localT;					// offset + translation
+	glm::mat4* _world;
+	int* _dirty;						// scratch list of joints
+	bool _cacheValid;
+	PoseStats _poseStats;
+	unsigned char* _block;
+};
+
+#endif
@@ -0,0 +1,270 @@
+#include "skinbinding.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+
+const int kLeafBones = 4;
+const int kMaxDepth = 64;
+// Vertices per grid cell when binding a mesh, on average over the bounding box
+const int kCellVertices = 16;
+
+inline float distance2(const glm::vec3 & a, const glm::vec3 & b) {
+	glm::vec3 d = a - b;
+	return glm::dot(d, d);
+}
+
+// The n nearest distinct joints so far, nearest first : a joint moving
+// several bones counts once, at its nearest bone
+struct NearestJoints {
+	int n;
+	int found;
+	int joints[kMaxInfluences];
+	float best[kMaxInfluences];		// squared distances
+
+	NearestJoints(int n) : n(n), found(0) {}
+
+	float bound() const { return (found == n) ? best[n - 1] : FLT_MAX; }
+	void add(int joint, float d2) {
+		int i = 0;
+		while (i < found && joints[i] != joint) i++;
+		if (i < found) {
+			if (d2 >= best[i]) return;
+		} else if (found < n) {
+			found++;
+		} else if (d2 >= best[n - 1]) {
+			return;
+		} else {
+			i = n - 1;
+		}
+		while (i > 0 && best[i - 1] > d2) {
+			best[i] = best[i - 1];
+			joints[i] = joints[i - 1];
+			i--;
+		}
+		best[i] = d2;
+		joints[i] = joint;
+	}
+};
+
+// Squared distance from p to the box, 0 inside
+inline float boxDistance2(const glm::vec3 & p, const glm::vec3 & lo, const glm::vec3 & hi) {
+	float d2 = 0;
+	for (int k = 0; k < 3; k++) {
+		float d = std::max(std::max(lo[k] - p[k], p[k] - hi[k]), 0.0f);
+		d2 += d * d;
+	}
+	return d2;
+}
+
+}
+
+void SkinBinding::build(const Skeleton & skeleton, const std::vector<trimesh::point> & bindJoints) {
+	_bones.clear();
+	_nodes.clear();
+	for (int j = 1; j < skeleton.nbJoints(); j++) {
+		int parent = skeleton._parent[j];
+		if (parent < 0) continue;
+		Bone bone;
+		bone.a = glm::vec3(bindJoints[parent][0], bindJoints[parent][1], bindJoints[parent][2]);
+		bone.ab = glm::vec3(bindJoints[j][0], bindJoints[j][1], bindJoints[j][2]) - bone.a;
+		float length2 = glm::dot(bone.ab, bone.ab);
+		bone.invLength2 = (length2 > 0) ? 1.0f / length2 : 0.0f;
+		bone.joint = parent;
+		_bones.push_back(bone);
+	}
+	if (_bones.empty() && skeleton.nbJoints() > 0) {
+		// A single joint : a bone reduced to a point
+		Bone bone;
+		bone.a = glm::vec3(bindJoints[0][0], bindJoints[0][1], bindJoints[0][2]);
+		bone.ab = glm::vec3(0.0f);
+		bone.invLength2 = 0;
+		bone.joint = 0;
+		_bones.push_back(bone);
+	}
+	if (!_bones.empty()) buildNode(0, _bones.size());
+}
+
+// Node over bones [first, first + count[, split at the median of the longest axis
+int SkinBinding::buildNode(int first, int count) {
+	int index = _nodes.size();
+	_nodes.push_back(Node());
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+	for (int b = first; b < first + count; b++) {
+		for (int k = 0; k < 3; k++) {
+			float a = _bones[b].a[k], e = a + _bones[b].ab[k];
+			lo[k] = std::min(lo[k], std::min(a, e));
+			hi[k] = std::max(hi[k], std::max(a, e));
+		}
+	}
+	_nodes[index].lo = lo;
+	_nodes[index].hi = hi;
+	_nodes[index].first = first;
+	_nodes[index].count = count;
+	_nodes[index].right = -1;
+	if (count <= kLeafBones) return index;
+
+	int axis = 0;
+	for (int k = 1; k < 3; k++) {
+		if (hi[k] - lo[k] > hi[axis] - lo[axis]) axis = k;
+	}
+	int half = count / 2;
+	std::nth_element(_bones.begin() + first, _bones.begin() + first + half, _bones.begin() + first + count,
+	                 [axis](const Bone & x, const Bone & y) { return 2 * x.a[axis] + x.ab[axis] < 2 * y.a[axis] + y.ab[axis]; });
+	_nodes[index].count = 0;
+	buildNode(first, half);
+	int right = buildNode(first + half, count - half);
+	_nodes[index].right = right;
+	return index;
+}
+
+// Squared distance from q to a bone
+inline float SkinBinding::boneDistance2(const glm::vec3 & q, const Bone & bone) {
+	float t = std::min(std::max(glm::dot(q - bone.a, bone.ab) * bone.invLength2, 0.0f), 1.0f);
+	return distance2(q, bone.a + bone.ab * t);
+}
+
+int SkinBinding::nearestJoints(const trimesh::point & p, int n, int* joints, float* distances) const {
+	if (_nodes.empty() || n <= 0) return 0;
+	glm::vec3 q(p[0], p[1], p[2]);
+	NearestJoints nearest(std::min(n, kMaxInfluences));
+	int stack[kMaxDepth];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node & node = _nodes[stack[--top]];
+		if (boxDistance2(q, node.lo, node.hi) >= nearest.bound()) continue;
+		if (node.count == 0) {
+			int left = &node - &_nodes[0] + 1;
+			// Nearer child last, visited first
+			float dl = boxDistance2(q, _nodes[left].lo, _nodes[left].hi);
+			float dr = boxDistance2(q, _nodes[node.right].lo, _nodes[node.right].hi);
+			stack[top++] = (dl < dr) ? node.right : left;
+			stack[top++] = (dl < dr) ? left : node.right;
+			continue;
+		}
+		for (int b = node.first; b < node.first + node.count; b++) nearest.add(_bones[b].joint, boneDistance2(q, _bones[b]));
+	}
+	for (int i = 0; i < nearest.found; i++) {
+		joints[i] = nearest.joints[i];
+		distances[i] = std::sqrt(nearest.best[i]);
+	}
+	return nearest.found;
+}
+
+int SkinBinding::bonesWithin(const glm::vec3 & q, float radius, int* bones) const {
+	if (_nodes.empty()) return 0;
+	float radius2 = radius * radius;
+	int count = 0;
+	int stack[kMaxDepth];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node & node = _nodes[stack[--top]];
+		if (boxDistance2(q, node.lo, node.hi) > radius2) continue;
+		if (node.count == 0) {
+			stack[top++] = &node - &_nodes[0] + 1;
+			stack[top++] = node.right;
+			continue;
+		}
+		for (int b = node.first; b < node.first + node.count; b++) {
+			if (boneDistance2(q, _bones[b]) <= radius2) bones[count++] = b;
+		}
+	}
+	return count;
+}
+
+void SkinBinding::bindRigid(const std::vector<trimesh::point> & vertices, SkinInfluences & skin) const {
+	bind(vertices, 1, false, skin);
+}
+
+void SkinBinding::bindSmooth(const std::vector<trimesh::point> & vertices, int nbInfluences, SkinInfluences & skin) const {
+	bind(vertices, std::min(std::max(nbInfluences, 1), kMaxInfluences), true, skin);
+}
+
+void SkinBinding::bind(const std::vector<trimesh::point> & vertices, int nbInfluences, bool smooth, SkinInfluences & skin) const {
+	int nbVertices = vertices.size();
+	skin.reset(nbVertices);
+	if (_nodes.empty() || nbVertices == 0) return;
+
+	// Grid of cubic cells over the mesh, vertices sorted by cell
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+	for (int v = 0; v < nbVertices; v++) {
+		for (int k = 0; k < 3; k++) {
+			lo[k] = std::min(lo[k], vertices[v][k]);
+			hi[k] = std::max(hi[k], vertices[v][k]);
+		}
+	}
+	glm::vec3 extent = hi - lo;
+	float volume = std::max(extent[0], 1e-6f) * std::max(extent[1], 1e-6f) * std::max(extent[2], 1e-6f);
+	float cell = std::cbrt(volume * kCellVertices / nbVertices);
+	int dims[3];
+	for (int k = 0; k < 3; k++) dims[k] = std::max(1, std::min(256, (int)std::ceil(extent[k] / cell)));
+	for (int k = 0; k < 3; k++) cell = std::max(cell, extent[k] / dims[k]);
+	int nbCells = dims[0] * dims[1] * dims[2];
+	std::vector<int> cellOf(nbVertices), cellStart(nbCells + 1, 0), order(nbVertices);
+	for (int v = 0; v < nbVertices; v++) {
+		int c[3];
+		for (int k = 0; k < 3; k++) c[k] = std::min(dims[k] - 1, (int)((vertices[v][k] - lo[k]) / cell));
+		cellOf[v] = (c[2] * dims[1] + c[1]) * dims[0] + c[0];
+		cellStart[cellOf[v] + 1]++;
+	}
+	for (int c = 0; c < nbCells; c++) cellStart[c + 1] += cellStart[c];
+	{
+		std::vector<int> next(cellStart.begin(), cellStart.end() - 1);
+		for (int v = 0; v < nbVertices; v++) order[next[cellOf[v]]++] = v;
+	}
+	// Every point of a cell is within this of its center
+	float halfDiagonal = 0.5f * std::sqrt(3.0f) * cell;
+
+	// Found into flat tables, then stored
+	std::vector<int> joints((size_t)nbVertices * nbInfluences);
+	std::vector<float> weights((size_t)nbVertices * nbInfluences);
+	std::vector<int> counts(nbVertices);
+	#pragma omp parallel
+	{
+		std::vector<int> candidates(_bones.size());
+		#pragma omp for schedule(dynamic, 16)
+		for (int c = 0; c < nbCells; c++) {
+			if (cellStart[c] == cellStart[c + 1]) continue;
+			int x = c % dims[0], y = (c / dims[0]) % dims[1], z = c / (dims[0] * dims[1]);
+			glm::vec3 center = lo + glm::vec3(x + 0.5f, y + 0.5f, z + 0.5f) * cell;
+			// The n-th joint is within d + h of any vertex of the cell, so only
+			// bones within d + 2h of the center can be among its nearest
+			int nearJoints[kMaxInfluences];
+			float nearDistances[kMaxInfluences];
+			int found = nearestJoints(trimesh::point(center[0], center[1], center[2], 1), nbInfluences, nearJoints, nearDistances);
+			int nbCandidates = bonesWithin(center, nearDistances[found - 1] + 2 * halfDiagonal, &candidates[0]);
+
+			for (int i = cellStart[c]; i < cellStart[c + 1]; i++) {
+				int v = order[i];
+				glm::vec3 q(vertices[v][0], vertices[v][1], vertices[v][2]);
+				NearestJoints nearest(nbInfluences);
+				for (int b = 0; b < nbCandidates; b++) nearest.add(_bones[candidates[b]].joint, boneDistance2(q, _bones[candidates[b]]));
+				int n = nearest.found;
+				int* j = &joints[(size_t)v * nbInfluences];
+				float* w = &weights[(size_t)v * nbInfluences];
+				counts[v] = n;
+				for (int k = 0; k < n; k++) {
+					j[k] = nearest.joints[k];
+					w[k] = std::sqrt(nearest.best[k]);
+				}
+				if (!smooth || n == 1) {
+					w[0] = 1;
+					counts[v] = std::min(n, 1);
+					continue;
+				}
+				// As the weights were made from joint distances : 1 - d / sum, normalized
+				float sum = 0, total = 0;
+				for (int k = 0; k < n; k++) sum += w[k];
+				for (int k = 0; k < n; k++) {
+					w[k] = (sum > 0) ? 1 - w[k] / sum : 1;
+					total += w[k];
+				}
+				for (int k = 0; k < n; k++) w[k] /= total;
+			}
+		}
+	}
+	skin.setVertices(joints.data(), weights.data(), counts.data(), nbInfluences);
+}
@@ -0,0 +1,55 @@
+#ifndef _SKINBINDING_H_
+#define _SKINBINDING_H_
+
+#include "skeleton.h"
+#include "skininfluences.h"
+
+// Automatic weights from the bones of a skeleton in bind pose. The bone from
+// a joint to one of its children is moved by that joint, so a vertex near
+// the bone is bound to it. Bones are held in a bounding volume hierarchy.
+// Binding a mesh buckets its vertices in a grid : the tree gives the few
+// bones that can be nearest to some point of a cell, then only those are
+// measured for the vertices of the cell. Cells are bound in parallel.
+class SkinBinding {
+public :
+	SkinBinding() {};
+
+	// Bones of the skeleton, joints at bindJoints
+	void build(const Skeleton & skeleton, const std::vector<trimesh::point> & bindJoints);
+	int nbBones() const { return _bones.size(); }
+
+	// The n (at most kMaxInfluences) joints whose bones are nearest to p,
+	// nearest first, and their distances. Returns how many were found.
+	int nearestJoints(const trimesh::point & p, int n, int* joints, float* distances) const;
+
+	// Every vertex follows the joint of its nearest bone
+	void bindRigid(const std::vector<trimesh::point> & vertices, SkinInfluences & skin) const;
+	// Every vertex follows its nbInfluences nearest joints, the nearer the more
+	void bindSmooth(const std::vector<trimesh::point> & vertices, int nbInfluences, SkinInfluences & skin) const;
+
+private :
+	struct Bone {
+		glm::vec3 a;				// moving joint
+		glm::vec3 ab;				// to the child
+		float invLength2;			// 0 for a point
+		int joint;
+	};
+	// Leaves hold bones [first, first + count[, inner nodes have count 0 and
+	// their children at index + 1 and right
+	struct Node {
+		glm::vec3 lo, hi;
+		int first, count;
+		int right;
+	};
+
+	static inline float boneDistance2(const glm::vec3 & q, const Bone & bone);
+	int buildNode(int first, int count);
+	// Bones within radius of q, returns how many (at most nbBones())
+	int bonesWithin(const glm::vec3 & q, float radius, int* bones) const;
+	void bind(const std::vector<trimesh::point> & vertices, int nbInfluences, bool smooth, SkinInfluences & skin) const;
+
+	std::vector<Bone> _bones;
+	std::vector<Node> _nodes;
+};
+
+#endif
@@ -0,0 +1,163 @@
+#include "skininfluences.h"
+
+#include <algorithm>
+
+namespace {
+
+// Same threshold as the dense weights used to be read with
+const float kMinWeight = 0.00001f;
+
+}
+
+SkinInfluences::SkinInfluences() : _nbVertices(0), _stride(0), _width(0), _nbTruncated(0) {
+}
+
+void SkinInfluences::reset(int nbVertices) {
+	_nbVertices = nbVertices;
+	_stride = (nbVertices + kSkinLanes - 1) / kSkinLanes * kSkinLanes;
+	_width = 0;
+	_nbTruncated = 0;
+	size_t size = (size_t)kMaxInfluences * _stride;
+	_joint.assign(size, 0);
+	_weight.assign(size, 0.0f);
+	_offsetX.assign(size, 0.0f);
+	_offsetY.assign(size, 0.0f);
+	_offsetZ.assign(size, 0.0f);
+}
+
+int SkinInfluences::nbInfluences(int vertex) const {
+	int n = 0;
+	for (int s = 0; s < _width; s++) {
+		if (_weight[s * _stride + vertex] > 0) n++;
+	}
+	return n;
+}
+
+size_t SkinInfluences::bytes() const {
+	return _joint.capacity() * sizeof(uint16_t)
+	     + (_weight.capacity() + _offsetX.capacity() + _offsetY.capacity() + _offsetZ.capacity()) * sizeof(float);
+}
+
+void SkinInfluences::setVertex(int vertex, const int* joints, const float* weights, int n) {
+	bool truncated = false;
+	_width = std::max(_width, store(vertex, joints, weights, n, truncated));
+	if (truncated) _nbTruncated++;
+}
+
+void SkinInfluences::setVertices(const int* joints, const float* weights, const int* counts, int maxPerVertex) {
+	int width = _width, nbTruncated = 0;
+	#pragma omp parallel for schedule(static) reduction(max:width) reduction(+:nbTruncated)
+	for (int v = 0; v < _nbVertices; v++) {
+		bool truncated = false;
+		width = std::max(width, store(v, joints + (size_t)v * maxPerVertex, weights + (size_t)v * maxPerVertex, counts[v], truncated));
+		if (truncated) nbTruncated++;
+	}
+	_width = width;
+	_nbTruncated += nbTruncated;
+}
+
+int SkinInfluences::store(int vertex, const int* joints, const float* weights, int n, bool & truncated) {
+	std::pair<float, int> kept[kMaxInfluences + 1];
+	int nbKept = 0;
+	float total = 0, keptTotal = 0;
+	for (int i = 0; i < n; i++) {
+		if (weights[i] < kMinWeight) continue;
+		total += weights[i];
+		// Insertion into the heaviest kMaxInfluences, heaviest first
+		int k = nbKept;
+		while (k > 0 && kept[k - 1].first < weights[i]) {
+			kept[k] = kept[k - 1];
+			k--;
+		}
+		kept[k] = std::make_pair(weights[i], joints[i]);
+		if (nbKept < kMaxInfluences) nbKept++;
+		else truncated = true;
+	}
+	if (nbKept == 0) {
+		kept[0] = std::make_pair(1.0f, 0);
+		nbKept = 1;
+		total = 1;
+	}
+	for (int k = 0; k < nbKept; k++) keptTotal += kept[k].first;
+	float scale = truncated ? total / keptTotal : 1.0f;
+
+	for (int s = 0; s < kMaxInfluences; s++) {
+		size_t i = (size_t)s * _stride + vertex;
+		_joint[i] = (s < nbKept) ? kept[s].second : 0;
+		_weight[i] = (s < nbKept) ? kept[s].first * scale : 0.0f;
+	}
+	return nbKept;
+}
+
+void SkinInfluences::bind(const std::vector<trimesh::point> & vertices, const std::vector<trimesh::point> & bindJoints) {
+	for (int s = 0; s < _width; s++) {
+		#pragma omp parallel for schedule(static)
+		for (int v = 0; v < _nbVertices; v++) {
+			size_t i = (size_t)s * _stride + v;
+			const trimesh::point & joint = bindJoints[_joint[i]];
+			_offsetX[i] = vertices[v][0] - joint[0];
+			_offsetY[i] = vertices[v][1] - joint[1];
+			_offsetZ[i] = vertices[v][2] - joint[2];
+		}
+	}
+}
+
+void SkinInfluences::prune(int maxInfluences) {
+	maxInfluences = std::max(1, maxInfluences);
+	if (maxInfluences >= _width) return;
+	for (int v = 0; v < _nbVertices; v++) {
+		float total = 0, keptTotal = 0;
+		for (int s = 0; s < _width; s++) {
+			float w = _weight[(size_t)s * _stride + v];
+			total += w;
+			if (s < maxInfluences) keptTotal += w;
+		}
+		float scale = (keptTotal > 0) ? total / keptTotal : 1.0f;
+		for (int s = 0; s < _width; s++) {
+			size_t i = (size_t)s * _stride + v;
+			if (s < maxInfluences) {
+				_weight[i] *= scale;
+			} else {
+				_joint[i] = 0;
+				_weight[i] = _offsetX[i] = _offsetY[i] = _offsetZ[i] = 0.0f;
+			}
+		}
+	}
+	_width = maxInfluences;
+}
+
+void SkinInfluences::copyVertices(const SkinInfluences & from, const std::vector<int> & vertices) {
+	reset(vertices.size());
+	_width = from._width;
+	for (int s = 0; s < _width; s++) {
+		for (int v = 0; v < _nbVertices; v++) {
+			size_t i = (size_t)s * _stride + v;
+			size_t j = (size_t)s * from._stride + vertices[v];
+			_joint[i] = from._joint[j];
+			_weight[i] = from._weight[j];
+			_offsetX[i] = from._offsetX[j];
+			_offsetY[i] = from._offsetY[j];
+			_offsetZ[i] = from._offsetZ[j];
+		}
+	}
+}
+
+void SkinInfluences::vertexAttributes(std::vector<uint8_t> & joints, std::vector<float> & weights) const {
+	joints.assign((size_t)kMaxInfluences * _nbVertices, 0);
+	weights.assign((size_t)kMaxInfluences * _nbVertices, 0.0f);
+	for (int s = 0; s < _width; s++) {
+		for (int v = 0; v < _nbVertices; v++) {
+			size_t i = (size_t)s * _stride + v;
+			joints[(size_t)v * kMaxInfluences + s] = (uint8_t)_joint[i];
+			weights[(size_t)v * kMaxInfluences + s] = _weight[i];
+		}
+	}
+}
+
+float SkinInfluences::weight(int vertex, int joint) const {
+	for (int s = 0; s < _width; s++) {
+		size_t i = (size_t)s * _stride + vertex;
+		if (_joint[i] == joint && _weight[i] > 0) return _weight[i];
+	}
+	return 0.0f;
+}
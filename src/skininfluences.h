@@ -0,0 +1,88 @@
+#ifndef _SKININFLUENCES_H_
+#define _SKININFLUENCES_H_
+
+#include "joint.h"
+#include <stdint.h>
+
+// Largest number of joints moving one vertex
+const int kMaxInfluences = 4;
+// Vertices of a slot are padded to a multiple of this, so that kernels can
+// load several consecutive vertices at once
+const int kSkinLanes = 8;
+
+// Skin weights of a mesh packed per vertex : up to kMaxInfluences entries
+// (joint, weight, offset from the joint in bind pose), heaviest first.
+// Unused entries have a null weight on joint 0.
+// Structure of arrays, slot-major : entry s of vertex v is at index
+// s * stride() + v of every array, so one slot of consecutive vertices is
+// contiguous. Only the first width() slots are ever read.
+class SkinInfluences {
+public :
+	SkinInfluences();
+
+	// nbVertices vertices, none bound yet
+	void reset(int nbVertices);
+	void clear() { reset(0); }
+
+	int nbVertices() const { return _nbVertices; }
+	int stride() const { return _stride; }
+	// Number of influences of the vertex with the most
+	int width() const { return _width; }
+	int nbInfluences(int vertex) const;
+	size_t bytes() const;
+
+	// Influences of a vertex from n (joint, weight) pairs. Weights under the
+	// threshold are dropped; beyond kMaxInfluences the heaviest are kept,
+	// scaled back to the same total. A vertex left without any follows joint 0.
+	void setVertex(int vertex, const int* joints, const float* weights, int n);
+	// setVertex of every vertex in parallel, counts[v] pairs of vertex v at
+	// v * maxPerVertex in joints and weights
+	void setVertices(const int* joints, const float* weights, const int* counts, int maxPerVertex);
+	// Vertices truncated to kMaxInfluences since reset
+	int nbTruncated() const { return _nbTruncated; }
+	// Bind offsets of every entry : vertex minus its joint in bind pose
+	void bind(const std::vector<trimesh::point> & vertices, const std::vector<trimesh::point> & bindJoints);
+	// Keeps the maxInfluences heaviest entries of every vertex, scaled back to
+	// the same total
+	void prune(int maxInfluences);
+	// Influences (offsets included) of the given vertices of another skin, in
+	// that order
+	void copyVertices(const SkinInfluences & from, const std::vector<int> & vertices);
+
+	// Influences as vertex attributes : kMaxInfluences joints and weights per
+	// vertex, consecutive. Joints must fit in a byte
+	void vertexAttributes(std::vector<uint8_t> & joints, std::vector<float> & weights) const;
+
+	// Weight of a joint on a vertex, 0 without influence
+	float weight(int vertex, int joint) const;
+	// Skinned position of a vertex for the joint world matrices of a pose
+	inline glm::vec4 skin(int vertex, const glm::mat4* matrices) const;
+
+public :
+	std::vector<uint16_t> _joint;
+	std::vector<float> _weight;
+	std::vector<float> _offsetX;
+	std::vector<float> _offsetY;
+	std::vector<float> _offsetZ;
+
+private :
+	// Entries of a vertex, returns how many are kept
+	int store(int vertex, const int* joints, const float* weights, int n, bool & truncated);
+
+	int _nbVertices;
+	int _stride;
+	int _width;
+	int _nbTruncated;
+};
+
+inline glm::vec4 SkinInfluences::skin(int vertex, const glm::mat4* matrices) const {
+	glm::vec4 p(0.0f);
+	for (int s = 0, i = vertex; s < _width; s++, i += _stride) {
+		const glm::mat4 & m = matrices[_joint[i]];
+		p += _weight[i] * (m[0] * _offsetX[i] + m[1] * _offsetY[i] + m[2] * _offsetZ[i] + m[3]);
+	}
+	p.w = 1.0f;
+	return p;
+}
+
+#endif
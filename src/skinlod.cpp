@@ -0,0 +1,133 @@
+#include "skinlod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <unordered_map>
+
+namespace {
+
+// Radius on screen (pixels) from which a level is used. A limb of walk1.bvh
+// moves up to a sixth of the radius of skin.off from one frame to the next :
+// only characters a few pixels wide are left a frame or two behind.
+const float kFullRadius = 150.0f;
+const float kPrunedRadius = 40.0f;
+
+// Cell of a vertex on a grid of res^3 cells over [lo, hi], and the dominant
+// joint of the vertex : vertices of two limbs in one cell stay apart
+uint64_t clusterKey(const trimesh::point & p, const float* lo, const float* size, int res, uint16_t joint) {
+	uint64_t key = joint;
+	for (int k = 0; k < 3; k++) {
+		int c = (size[k] > 0) ? (int)((p[k] - lo[k]) / size[k] * res) : 0;
+		key = key * (res + 1) + std::max(0, std::min(res - 1, c));
+	}
+	return key;
+}
+
+// Cluster of each vertex for a grid resolution, returns the number of clusters
+int cluster(const std::vector<trimesh::point> & vertices, const SkinInfluences & skin, const float* lo, const float* size,
+            int res, std::vector<int> & clusterOf) {
+	std::unordered_map<uint64_t, int> clusters;
+	clusters.reserve(vertices.size());
+	clusterOf.resize(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		uint64_t key = clusterKey(vertices[v], lo, size, res, skin._joint[v]);
+		clusterOf[v] = clusters.insert(std::make_pair(key, (int)clusters.size())).first->second;
+	}
+	return clusters.size();
+}
+
+}
+
+void SkinLod::build(const std::vector<trimesh::point> & vertices, const std::vector<trimesh::TriMesh::Face> & faces,
+                    const SkinInfluences & skin) {
+	_levels.assign(3, SkinLodLevel());
+	int nbVertices = skin.nbVertices();
+
+	_levels[0].skin = skin;
+	_levels[0].minRadius = kFullRadius;
+	_levels[0].updateInterval = 1;
+
+	_levels[1].skin = skin;
+	_levels[1].skin.prune(kPrunedInfluences);
+	_levels[1].minRadius = kPrunedRadius;
+	_levels[1].updateInterval = 1;
+
+	// Proxy : the finest grid giving at most nbVertices / kProxyRatio clusters
+	SkinLodLevel & proxy = _levels[2];
+	proxy.minRadius = 0;
+	proxy.updateInterval = 3;
+	float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX}, size[3];
+	for (int v = 0; v < nbVertices; v++) {
+		for (int k = 0; k < 3; k++) {
+			lo[k] = std::min(lo[k], vertices[v][k]);
+			hi[k] = std::max(hi[k], vertices[v][k]);
+		}
+	}
+	for (int k = 0; k < 3; k++) size[k] = hi[k] - lo[k];
+	int target = std::max(1, nbVertices / kProxyRatio);
+	std::vector<int> clusterOf;
+	int low = 1, high = 1024;
+	while (low < high) {
+		int res = (low + high + 1) / 2;
+		if (cluster(vertices, skin, lo, size, res, clusterOf) <= target) low = res;
+		else high = res - 1;
+	}
+	int nbClusters = cluster(vertices, skin, lo, size, low, clusterOf);
+
+	// Each cluster stands on its vertex nearest to its centroid
+	std::vector<trimesh::point> centroid(nbClusters, trimesh::point(0, 0, 0, 0));
+	std::vector<int> count(nbClusters, 0);
+	for (int v = 0; v < nbVertices; v++) {
+		centroid[clusterOf[v]] += vertices[v];
+		count[clusterOf[v]]++;
+	}
+	for (int c = 0; c < nbClusters; c++) centroid[c] /= count[c];
+	std::vector<int> nearest(nbClusters, -1);
+	std::vector<float> nearestDist(nbClusters, FLT_MAX);
+	for (int v = 0; v < nbVertices; v++) {
+		int c = clusterOf[v];
+		float d = trimesh::dist2(vertices[v], centroid[c]);
+		if (d < nearestDist[c]) {
+			nearestDist[c] = d;
+			nearest[c] = v;
+		}
+	}
+	proxy.vertices = nearest;
+	proxy.skin.copyVertices(_levels[1].skin, proxy.vertices);
+	_proxyOf = clusterOf;
+
+	// Triangles whose corners fall in three different clusters
+	proxy.indices.clear();
+	for (size_t f = 0; f < faces.size(); f++) {
+		int a = clusterOf[faces[f][0]], b = clusterOf[faces[f][1]], c = clusterOf[faces[f][2]];
+		if (a == b || b == c || a == c) continue;
+		proxy.indices.push_back(nearest[a]);
+		proxy.indices.push_back(nearest[b]);
+		proxy.indices.push_back(nearest[c]);
+	}
+	for (int i = 0; i < nbLevels(); i++) SkinningEngine::batches(_levels[i].skin, _levels[i].batches);
+}
+
+int SkinLod::select(float radius) const {
+	for (int i = 0; i < nbLevels(); i++) {
+		if (radius >= _levels[i].minRadius) return i;
+	}
+	return nbLevels() - 1;
+}
+
+void SkinLod::skin(int level, const SkinningEngine & engine, trimesh::point* out, std::vector<trimesh::point> & scratch) const {
+	const SkinLodLevel & l = _levels[level];
+	if (l.vertices.empty()) {
+		engine.skin(l.skin, l.batches, out);
+		return;
+	}
+	scratch.resize(l.nbSkinned());
+	engine.skin(l.skin, l.batches, scratch.data());
+	for (int i = 0; i < l.nbSkinned(); i++) out[l.vertices[i]] = scratch[i];
+}
+
+glm::vec4 SkinLod::skinVertex(int level, int vertex, const glm::mat4* matrices) const {
+	const SkinLodLevel & l = _levels[level];
+	return l.skin.skin(l.vertices.empty() ? vertex : _proxyOf[vertex], matrices);
+}
@@ -0,0 +1,57 @@
+#ifndef _SKINLOD_H_
+#define _SKINLOD_H_
+
+#include "skininfluences.h"
+#include "skinningengine.h"
+#include "TriMesh.h"
+
+// One level of detail of a skinned mesh
+struct SkinLodLevel {
+	SkinInfluences skin;
+	std::vector<int> vertices;		// mesh vertex of each skinned vertex, empty for all of them in order
+	std::vector<int> indices;		// triangles over mesh vertices, empty for the mesh faces
+	std::vector<SkinBatch> batches;	// of skin, see SkinningEngine::batches
+	float minRadius;				// smallest radius on screen (pixels) drawn at this level
+	int updateInterval;				// frames between two skinnings
+
+	int nbSkinned() const { return skin.nbVertices(); }
+};
+
+// Levels of detail of a skin, finest first :
+//   0 : the skin as loaded
+//   1 : influences pruned to kPrunedInfluences per vertex, renormalized
+//   2 : proxy, the pruned skin on one mesh vertex per grid cell and dominant
+//       joint, drawn with the mesh triangles collapsed onto those vertices
+// The level is chosen from the radius of the character on screen; it also
+// sets how often the character is skinned, smaller ones less often.
+class SkinLod {
+public :
+	static const int kPrunedInfluences = 2;
+	// Proxy vertices : about one mesh vertex out of kProxyRatio
+	static const int kProxyRatio = 8;
+
+	SkinLod() {};
+
+	// Levels of a bound skin of the mesh (vertices in bind pose)
+	void build(const std::vector<trimesh::point> & vertices, const std::vector<trimesh::TriMesh::Face> & faces,
+	           const SkinInfluences & skin);
+	void clear() { _levels.clear(); }
+
+	int nbLevels() const { return _levels.size(); }
+	const SkinLodLevel & level(int i) const { return _levels[i]; }
+	// Level of a character whose bounding sphere covers radius pixels
+	int select(float radius) const;
+
+	// Skinned positions of the vertices of a level, written at their mesh
+	// index : the other vertices of out are left as they are
+	void skin(int level, const SkinningEngine & engine, trimesh::point* out, std::vector<trimesh::point> & scratch) const;
+	// Position of a mesh vertex at a level, from the joint world matrices
+	glm::vec4 skinVertex(int level, int vertex, const glm::mat4* matrices) const;
+
+private :
+	std::vector<SkinLodLevel> _levels;
+	// Skinned vertex standing for each mesh vertex at the proxy level
+	std::vector<int> _proxyOf;
+};
+
+#endif
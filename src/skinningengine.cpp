@@ -0,0 +1,328 @@
+#include "skinningengine.h"
+
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#define SKINNING_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Vertices per parallel chunk, a multiple of kSkinLanes
+const int kChunk = 512;
+// Smaller meshes are skinned in a few microseconds, less than waking threads
+const int kParallelMin = 4096;
+
+// Shorter runs of vertices with the same joints are left in mixed batches
+const int kMinShared = 4 * kSkinLanes;
+
+typedef void (*SkinKernel)(const SkinInfluences & skin, const glm::mat4* matrices, int first, int last, trimesh::point* out);
+// Vertices sharing their joints : palette[s] is the matrix of slot s
+typedef void (*SharedKernel)(const SkinInfluences & skin, const glm::mat4* palette, int first, int last, trimesh::point* out);
+
+template<int W>
+void skinScalar(const SkinInfluences & skin, const glm::mat4* matrices, int first, int last, trimesh::point* out) {
+	for (int v = first; v < last; v++) out[v] = trimesh::point(skin.skin(v, matrices));
+}
+
+template<int W>
+void skinSharedScalar(const SkinInfluences & skin, const glm::mat4* palette, int first, int last, trimesh::point* out) {
+	const int stride = skin.stride();
+	for (int v = first; v < last; v++) {
+		glm::vec4 p(0.0f);
+		for (int s = 0; s < W; s++) {
+			int i = s * stride + v;
+			const glm::mat4 & m = palette[s];
+			p += skin._weight[i] * (m[0] * skin._offsetX[i] + m[1] * skin._offsetY[i] + m[2] * skin._offsetZ[i] + m[3]);
+		}
+		out[v] = trimesh::point(p[0], p[1], p[2], 1.0f);
+	}
+}
+
+#ifdef SKINNING_X86
+
+// One vertex per register, as a vec4 : the columns of its joint matrices are
+// loaded as they are and scaled by the broadcast weighted offsets. Vertices
+// of mixed joints would need a gather per matrix element to be skinned
+// across lanes instead.
+template<int W>
+void skinSse(const SkinInfluences & skin, const glm::mat4* matrices, int first, int last, trimesh::point* out) {
+	const int stride = skin.stride();
+	const __m128 one = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+	const __m128 xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	for (int v = first; v < last; v++) {
+		__m128 p = _mm_setzero_ps();
+		for (int s = 0; s < W; s++) {
+			int i = s * stride + v;
+			const float* m = &matrices[skin._joint[i]][0][0];
+			float w = skin._weight[i];
+			p = _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(w * skin._offsetX[i])));
+			p = _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(w * skin._offsetY[i])));
+			p = _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(w * skin._offsetZ[i])));
+			p = _mm_add_ps(p, _mm_mul_ps(_mm_loadu_ps(m + 12), _mm_set1_ps(w)));
+		}
+		_mm_storeu_ps(&out[v][0], _mm_or_ps(_mm_and_ps(p, xyz), one));
+	}
+}
+
+// skinSse with two vertices per 256-bit register, one in each half : the
+// columns of their joint matrices are loaded side by side.
+template<int W>
+__attribute__((target("avx2,fma")))
+void skinAvx2(const SkinInfluences & skin, const glm::mat4* matrices, int first, int last, trimesh::point* out) {
+	const int stride = skin.stride();
+	const __m256 one = _mm256_set_ps(1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+	const __m256 xyz = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1, 0, -1, -1, -1));
+	for (int v = first; v < last; v += 2) {
+		__m256 p = _mm256_setzero_ps();
+		for (int s = 0; s < W; s++) {
+			int i = s * stride + v;
+			// Lane v + 1 exists : the stride is padded to kSkinLanes
+			const float* m0 = &matrices[skin._joint[i]][0][0];
+			const float* m1 = &matrices[skin._joint[i + 1]][0][0];
+			__m256 w = _mm256_set_m128(_mm_set1_ps(skin._weight[i + 1]), _mm_set1_ps(skin._weight[i]));
+			__m256 ox = _mm256_set_m128(_mm_set1_ps(skin._offsetX[i + 1]), _mm_set1_ps(skin._offsetX[i]));
+			__m256 oy = _mm256_set_m128(_mm_set1_ps(skin._offsetY[i + 1]), _mm_set1_ps(skin._offsetY[i]));
+			__m256 oz = _mm256_set_m128(_mm_set1_ps(skin._offsetZ[i + 1]), _mm_set1_ps(skin._offsetZ[i]));
+			__m256 q = _mm256_loadu2_m128(m1 + 12, m0 + 12);
+			q = _mm256_fmadd_ps(_mm256_loadu2_m128(m1, m0), ox, q);
+			q = _mm256_fmadd_ps(_mm256_loadu2_m128(m1 + 4, m0 + 4), oy, q);
+			q = _mm256_fmadd_ps(_mm256_loadu2_m128(m1 + 8, m0 + 8), oz, q);
+			p = _mm256_fmadd_ps(q, w, p);
+		}
+		p = _mm256_or_ps(_mm256_and_ps(p, xyz), one);
+		_mm_storeu_ps(&out[v][0], _mm256_castps256_ps128(p));
+		if (v + 1 < last) _mm_storeu_ps(&out[v + 1][0], _mm256_extractf128_ps(p, 1));
+	}
+}
+
+// Vertices sharing their joints, 4 per register in structure of arrays :
+// offsets and weights of consecutive vertices are loaded as they are stored,
+// the matrix elements are broadcast once for the batch. Lanes past last are
+// padding of the slots (see kSkinLanes), computed but not written.
+template<int W>
+void skinSharedSse(const SkinInfluences & skin, const glm::mat4* palette, int first, int last, trimesh::point* out) {
+	const int stride = skin.stride();
+	__m128 m[W][4][3];
+	for (int s = 0; s < W; s++) {
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 3; r++) m[s][c][r] = _mm_set1_ps(palette[s][c][r]);
+		}
+	}
+	for (int v = first; v < last; v += 4) {
+		__m128 x = _mm_setzero_ps(), y = _mm_setzero_ps(), z = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+		for (int s = 0; s < W; s++) {
+			int i = s * stride + v;
+			__m128 w = _mm_loadu_ps(&skin._weight[i]);
+			__m128 ox = _mm_loadu_ps(&skin._offsetX[i]);
+			__m128 oy = _mm_loadu_ps(&skin._offsetY[i]);
+			__m128 oz = _mm_loadu_ps(&skin._offsetZ[i]);
+			const __m128 (&c)[4][3] = m[s];
+			x = _mm_add_ps(x, _mm_mul_ps(w, _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0][0], ox), _mm_mul_ps(c[1][0], oy)), _mm_add_ps(_mm_mul_ps(c[2][0], oz), c[3][0]))));
+			y = _mm_add_ps(y, _mm_mul_ps(w, _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0][1], ox), _mm_mul_ps(c[1][1], oy)), _mm_add_ps(_mm_mul_ps(c[2][1], oz), c[3][1]))));
+			z = _mm_add_ps(z, _mm_mul_ps(w, _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0][2], ox), _mm_mul_ps(c[1][2], oy)), _mm_add_ps(_mm_mul_ps(c[2][2], oz), c[3][2]))));
+		}
+		// Back to one point per register
+		_MM_TRANSPOSE4_PS(x, y, z, one);
+		if (v + 4 <= last) {
+			_mm_storeu_ps(&out[v][0], x);
+			_mm_storeu_ps(&out[v + 1][0], y);
+			_mm_storeu_ps(&out[v + 2][0], z);
+			_mm_storeu_ps(&out[v + 3][0], one);
+		} else {
+			__m128 points[4] = {x, y, z, one};
+			for (int k = 0; v + k < last; k++) _mm_storeu_ps(&out[v + k][0], points[k]);
+		}
+	}
+}
+
+// skinSharedSse with 8 vertices per register
+template<int W>
+__attribute__((target("avx2,fma")))
+void skinSharedAvx2(const SkinInfluences & skin, const glm::mat4* palette, int first, int last, trimesh::point* out) {
+	const int stride = skin.stride();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	__m256 m[W][4][3];
+	for (int s = 0; s < W; s++) {
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 3; r++) m[s][c][r] = _mm256_set1_ps(palette[s][c][r]);
+		}
+	}
+	for (int v = first; v < last; v += 8) {
+		__m256 x = _mm256_setzero_ps(), y = _mm256_setzero_ps(), z = _mm256_setzero_ps();
+		for (int s = 0; s < W; s++) {
+			int i = s * stride + v;
+			__m256 w = _mm256_loadu_ps(&skin._weight[i]);
+			__m256 ox = _mm256_loadu_ps(&skin._offsetX[i]);
+			__m256 oy = _mm256_loadu_ps(&skin._offsetY[i]);
+			__m256 oz = _mm256_loadu_ps(&skin._offsetZ[i]);
+			const __m256 (&c)[4][3] = m[s];
+			x = _mm256_fmadd_ps(w, _mm256_fmadd_ps(c[0][0], ox, _mm256_fmadd_ps(c[1][0], oy, _mm256_fmadd_ps(c[2][0], oz, c[3][0]))), x);
+			y = _mm256_fmadd_ps(w, _mm256_fmadd_ps(c[0][1], ox, _mm256_fmadd_ps(c[1][1], oy, _mm256_fmadd_ps(c[2][1], oz, c[3][1]))), y);
+			z = _mm256_fmadd_ps(w, _mm256_fmadd_ps(c[0][2], ox, _mm256_fmadd_ps(c[1][2], oy, _mm256_fmadd_ps(c[2][2], oz, c[3][2]))), z);
+		}
+		// Back to one point per 128-bit half : vertices k and k + 4 in points[k]
+		__m256 xy0 = _mm256_unpacklo_ps(x, y), xy1 = _mm256_unpackhi_ps(x, y);
+		__m256 zw0 = _mm256_unpacklo_ps(z, one), zw1 = _mm256_unpackhi_ps(z, one);
+		__m256 points[4] = {
+			_mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(xy0, zw0, _MM_SHUFFLE(3, 2, 3, 2)),
+			_mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(xy1, zw1, _MM_SHUFFLE(3, 2, 3, 2))
+		};
+		if (v + 8 <= last) {
+			for (int k = 0; k < 4; k++) {
+				_mm_storeu_ps(&out[v + k][0], _mm256_castps256_ps128(points[k]));
+				_mm_storeu_ps(&out[v + k + 4][0], _mm256_extractf128_ps(points[k], 1));
+			}
+		} else {
+			for (int k = 0; v + k < last; k++) {
+				_mm_storeu_ps(&out[v + k][0], k < 4 ? _mm256_castps256_ps128(points[k]) : _mm256_extractf128_ps(points[k - 4], 1));
+			}
+		}
+	}
+}
+
+#endif
+
+enum Isa { isaScalar = 0, isaSse, isaAvx2 };
+
+Isa detectIsa() {
+#ifdef SKINNING_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return isaAvx2;
+	return isaSse;
+#else
+	return isaScalar;
+#endif
+}
+
+const Isa kIsa = detectIsa();
+
+template<int W>
+SkinKernel kernel() {
+#ifdef SKINNING_X86
+	if (kIsa == isaAvx2) return skinAvx2<W>;
+	if (kIsa == isaSse) return skinSse<W>;
+#endif
+	return skinScalar<W>;
+}
+
+template<int W>
+SharedKernel sharedKernel() {
+#ifdef SKINNING_X86
+	if (kIsa == isaAvx2) return skinSharedAvx2<W>;
+	if (kIsa == isaSse) return skinSharedSse<W>;
+#endif
+	return skinSharedScalar<W>;
+}
+
+SkinKernel kernelFor(int width) {
+	switch (width) {
+		case 1: return kernel<1>();
+		case 2: return kernel<2>();
+		case 3: return kernel<3>();
+		default: return kernel<kMaxInfluences>();
+	}
+}
+
+SharedKernel sharedKernelFor(int width) {
+	switch (width) {
+		case 1: return sharedKernel<1>();
+		case 2: return sharedKernel<2>();
+		case 3: return sharedKernel<3>();
+		default: return sharedKernel<kMaxInfluences>();
+	}
+}
+
+bool sameJoints(const SkinInfluences & skin, int a, int b) {
+	for (int i = 0; i < skin.width() * skin.stride(); i += skin.stride()) {
+		if (skin._joint[i + a] != skin._joint[i + b]) return false;
+	}
+	return true;
+}
+
+// Batches of at most kChunk vertices over [first, last[, first aligned
+void addBatches(int first, int last, int width, const uint16_t* joints, std::vector<SkinBatch> & batches) {
+	for (int b = first; b < last; b += kChunk) {
+		SkinBatch batch;
+		batch.first = b;
+		batch.last = std::min(last, b + kChunk);
+		batch.width = width;
+		for (int s = 0; s < kMaxInfluences; s++) batch.joints[s] = (s < width) ? joints[s] : 0;
+		batches.push_back(batch);
+	}
+}
+
+}
+
+SkinningEngine::SkinningEngine() {
+}
+
+void SkinningEngine::setPose(const glm::mat4* matrices, int nbJoints) {
+	_matrices.assign(matrices, matrices + nbJoints);
+}
+
+void SkinningEngine::skinRange(const SkinInfluences & skin, int first, int last, trimesh::point* out) const {
+	if (skin.width() == 0 || first >= last) return;
+	kernelFor(skin.width())(skin, _matrices.data(), first, last, out);
+}
+
+void SkinningEngine::skin(const SkinInfluences & skin, trimesh::point* out) const {
+	int nbVertices = skin.nbVertices();
+	if (skin.width() == 0 || nbVertices == 0) return;
+	SkinKernel run = kernelFor(skin.width());
+	int nbChunks = (nbVertices + kChunk - 1) / kChunk;
+	#pragma omp parallel for schedule(static) if(nbVertices >= kParallelMin)
+	for (int c = 0; c < nbChunks; c++) {
+		run(skin, _matrices.data(), c * kChunk, std::min(nbVertices, (c + 1) * kChunk), out);
+	}
+}
+
+void SkinningEngine::skin(const SkinInfluences & skin, const std::vector<SkinBatch> & batches, trimesh::point* out) const {
+	int nbVertices = skin.nbVertices();
+	if (skin.width() == 0 || nbVertices == 0) return;
+	SkinKernel mixed = kernelFor(skin.width());
+	int nbBatches = batches.size();
+	#pragma omp parallel for schedule(dynamic, 4) if(nbVertices >= kParallelMin)
+	for (int b = 0; b < nbBatches; b++) {
+		const SkinBatch & batch = batches[b];
+		if (batch.width == 0) {
+			mixed(skin, _matrices.data(), batch.first, batch.last, out);
+			continue;
+		}
+		glm::mat4 palette[kMaxInfluences];
+		for (int s = 0; s < batch.width; s++) palette[s] = _matrices[batch.joints[s]];
+		sharedKernelFor(batch.width)(skin, palette, batch.first, batch.last, out);
+	}
+}
+
+void SkinningEngine::batches(const SkinInfluences & skin, std::vector<SkinBatch> & batches) {
+	batches.clear();
+	int nbVertices = skin.nbVertices();
+	int stride = skin.stride();
+	if (skin.width() == 0) return;
+	// Mixed vertices from mixedFirst to the next run
+	int mixedFirst = 0;
+	for (int v = 0; v < nbVertices;) {
+		int end = v + 1;
+		while (end < nbVertices && sameJoints(skin, v, end)) end++;
+		// Whole groups of kSkinLanes of the run, up to the end of the skin
+		int first = (v + kSkinLanes - 1) / kSkinLanes * kSkinLanes;
+		int last = (end == nbVertices) ? end : end / kSkinLanes * kSkinLanes;
+		if (last - first >= kMinShared) {
+			int shared = 1;
+			for (int i = first; i < last; i++) shared = std::max(shared, skin.nbInfluences(i));
+			uint16_t joints[kMaxInfluences];
+			for (int s = 0; s < shared; s++) joints[s] = skin._joint[s * stride + v];
+			addBatches(mixedFirst, first, 0, joints, batches);
+			addBatches(first, last, shared, joints, batches);
+			mixedFirst = last;
+		}
+		v = end;
+	}
+	addBatches(mixedFirst, nbVertices, 0, NULL, batches);
+}
+
+const char* SkinningEngine::instructionSet() {
+	static const char* names[] = {"scalar", "SSE2", "AVX2"};
+	return names[kIsa];
+}
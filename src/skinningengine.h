@@ -0,0 +1,49 @@
+#ifndef _SKINNINGENGINE_H_
+#define _SKINNINGENGINE_H_
+
+#include "skininfluences.h"
+
+// Vertices [first, last[ of a skin, first a multiple of kSkinLanes. When
+// width > 0, every vertex of the batch has joints[s] in slot s for s < width
+// and nothing beyond : the kernel loads those matrices once for the batch.
+struct SkinBatch {
+	int first, last;
+	int width;
+	uint16_t joints[kMaxInfluences];
+};
+
+// Linear blend skinning of a whole mesh on the CPU.
+// Vertices are split in chunks across the OpenMP threads, and skinned by
+// kernels specialized at compile time on the number of influence slots of
+// the skin : one vertex per register (SSE), or two (AVX2). The instruction
+// set is chosen once from the CPU at run time; other architectures use the
+// scalar loop of SkinInfluences::skin.
+// Skinned by batches, runs of vertices moved by the same joints are skinned
+// across the lanes instead, 4 (SSE) or 8 (AVX2) vertices per register, with
+// the matrices of the run broadcast once.
+class SkinningEngine {
+public :
+	SkinningEngine();
+
+	// Joint world matrices of the pose (copied)
+	void setPose(const glm::mat4* matrices, int nbJoints);
+	// Skinned positions of every vertex (w = 1), in parallel
+	void skin(const SkinInfluences & skin, trimesh::point* out) const;
+	// Same, batch by batch (see batches)
+	void skin(const SkinInfluences & skin, const std::vector<SkinBatch> & batches, trimesh::point* out) const;
+	// Vertices [first, last[ on the calling thread, first a multiple of kSkinLanes
+	void skinRange(const SkinInfluences & skin, int first, int last, trimesh::point* out) const;
+
+	// Batches covering the skin : runs of vertices with the same joints in
+	// the same slots, the others in between. Only sorted vertices make long
+	// runs (see VertexOrder).
+	static void batches(const SkinInfluences & skin, std::vector<SkinBatch> & batches);
+
+	// "AVX2", "SSE2" or "scalar"
+	static const char* instructionSet();
+
+private :
+	std::vector<glm::mat4> _matrices;
+};
+
+#endif
@@ -0,0 +1,244 @@
+#include "triangleorder.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Clusters are also cut once the cache of their own faces is this warm,
+// leaving the overdraw sort more, smaller pieces to move
+const double kClusterAcmr = 0.75;
+
+typedef trimesh::TriMesh::Face Face;
+
+// Faces around each vertex : faces[offsets[v]] to faces[offsets[v + 1]]
+struct Adjacency {
+	std::vector<int> offsets;
+	std::vector<int> faces;
+
+	Adjacency(const std::vector<Face> & meshFaces, int nbVertices) : offsets(nbVertices + 1, 0) {
+		for (size_t f = 0; f < meshFaces.size(); f++) {
+			for (int k = 0; k < 3; k++) offsets[meshFaces[f][k] + 1]++;
+		}
+		for (int v = 0; v < nbVertices; v++) offsets[v + 1] += offsets[v];
+		faces.resize(offsets[nbVertices]);
+		std::vector<int> next(offsets.begin(), offsets.end() - 1);
+		for (size_t f = 0; f < meshFaces.size(); f++) {
+			for (int k = 0; k < 3; k++) faces[next[meshFaces[f][k]]++] = f;
+		}
+	}
+};
+
+// FIFO of cacheSize vertices, as timestamps : a vertex is in the cache while
+// fewer than cacheSize others came in after it
+struct FifoCache {
+	std::vector<int> stamp;
+	int time;
+	int cacheSize;
+
+	FifoCache(int nbVertices, int size) : stamp(nbVertices, -size), time(0), cacheSize(size) {};
+	// True on a miss
+	bool use(int v) {
+		if (time - stamp[v] < cacheSize) return false;
+		stamp[v] = ++time;
+		return true;
+	}
+	void flush() { time += cacheSize; }
+};
+
+// Soft boundaries : each cluster of Tipsify is cut where the ACMR of the
+// faces since the last cut drops under kClusterAcmr
+void splitClusters(const std::vector<Face> & faces, int nbVertices, int cacheSize,
+                   const std::vector<int> & faceOrder, std::vector<int> & clusters) {
+	std::vector<int> split;
+	FifoCache cache(nbVertices, cacheSize);
+	size_t next = 0;
+	int first = 0, misses = 0;
+	for (size_t i = 0; i < faceOrder.size(); i++) {
+		if (next < clusters.size() && clusters[next] == (int)i) {
+			next++;
+			split.push_back(i);
+			cache.flush();
+			first = i;
+			misses = 0;
+		}
+		const Face & face = faces[faceOrder[i]];
+		for (int k = 0; k < 3; k++) misses += cache.use(face[k]);
+		if (misses <= kClusterAcmr * (i + 1 - first) && i + 1 < faceOrder.size()) {
+			split.push_back(i + 1);
+			cache.flush();
+			first = i + 1;
+			misses = 0;
+			if (next < clusters.size() && clusters[next] == (int)i + 1) next++;
+		}
+	}
+	clusters.swap(split);
+}
+
+}
+
+void TriangleOrder::tipsify(const std::vector<Face> & faces, int nbVertices, int cacheSize,
+                            std::vector<int> & faceOrder, std::vector<int> & clusters) {
+	int nbFaces = faces.size();
+	Adjacency adjacency(faces, nbVertices);
+	std::vector<int> live(nbVertices);
+	for (int v = 0; v < nbVertices; v++) live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+	std::vector<int> stamp(nbVertices, 0);
+	std::vector<char> emitted(nbFaces, 0);
+	std::vector<int> deadEnd;
+	std::vector<int> candidates;
+	deadEnd.reserve(3 * nbFaces);
+	faceOrder.clear();
+	faceOrder.reserve(nbFaces);
+	clusters.clear();
+
+	int time = cacheSize + 1;
+	int cursor = 0;
+	int fan = -1;
+	while (cursor < nbVertices && live[cursor] == 0) cursor++;
+	if (cursor < nbVertices) fan = cursor;
+	bool jumped = true;
+	while (fan >= 0) {
+		if (jumped) clusters.push_back(faceOrder.size());
+		// All the faces left around fan
+		candidates.clear();
+		for (int i = adjacency.offsets[fan]; i < adjacency.offsets[fan + 1]; i++) {
+			int f = adjacency.faces[i];
+			if (emitted[f]) continue;
+			emitted[f] = 1;
+			faceOrder.push_back(f);
+			for (int k = 0; k < 3; k++) {
+				int v = faces[f][k];
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamp[v] > cacheSize) stamp[v] = time++;
+			}
+		}
+		// Next fan : the oldest vertex that stays in the cache while its faces are drawn
+		int next = -1, best = -1;
+		for (size_t c = 0; c < candidates.size(); c++) {
+			int v = candidates[c];
+			if (live[v] == 0) continue;
+			int priority = (time - stamp[v] + 2 * live[v] <= cacheSize) ? time - stamp[v] : 0;
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+		jumped = (next < 0);
+		// Dead end : the last vertices used, then the next in index order
+		while (next < 0 && !deadEnd.empty()) {
+			int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0) next = v;
+		}
+		while (next < 0 && cursor < nbVertices) {
+			if (live[cursor] > 0) next = cursor;
+			else cursor++;
+		}
+		fan = next;
+	}
+	splitClusters(faces, nbVertices, cacheSize, faceOrder, clusters);
+}
+
+void TriangleOrder::sortClusters(const trimesh::TriMesh* mesh, std::vector<int> & faceOrder, const std::vector<int> & clusters) {
+	const std::vector<trimesh::point> & vertices = mesh->vertices;
+	int nbClusters = clusters.size();
+	trimesh::point center(0, 0, 0, 0);
+	for (size_t v = 0; v < vertices.size(); v++) center += vertices[v];
+	if (vertices.size() > 0) center /= vertices.size();
+
+	// Occlusion potential : how far the cluster stands out along its own
+	// normal, area weighted
+	std::vector<std::pair<float, int> > potential(nbClusters);
+	#pragma omp parallel for schedule(dynamic, 64) if(nbClusters >= 1024)
+	for (int c = 0; c < nbClusters; c++) {
+		int end = (c + 1 < nbClusters) ? clusters[c + 1] : faceOrder.size();
+		float normal[3] = {0, 0, 0}, centroid[3] = {0, 0, 0}, area = 0;
+		for (int i = clusters[c]; i < end; i++) {
+			const Face & face = mesh->faces[faceOrder[i]];
+			const trimesh::point & a = vertices[face[0]];
+			const trimesh::point & b = vertices[face[1]];
+			const trimesh::point & p = vertices[face[2]];
+			float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+			float e2[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+			float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+			float faceArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			for (int k = 0; k < 3; k++) {
+				normal[k] += n[k];
+				centroid[k] += faceArea * (a[k] + b[k] + p[k]) / 3;
+			}
+			area += faceArea;
+		}
+		float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		float dot = 0;
+		if (area > 0 && length > 0) {
+			for (int k = 0; k < 3; k++) dot += (centroid[k] / area - center[k]) * normal[k] / length;
+		}
+		potential[c] = std::make_pair(-dot, c);
+	}
+	std::stable_sort(potential.begin(), potential.end());
+
+	std::vector<int> sorted;
+	sorted.reserve(faceOrder.size());
+	for (int s = 0; s < nbClusters; s++) {
+		int c = potential[s].second;
+		int end = (c + 1 < nbClusters) ? clusters[c + 1] : faceOrder.size();
+		sorted.insert(sorted.end(), faceOrder.begin() + clusters[c], faceOrder.begin() + end);
+	}
+	faceOrder.swap(sorted);
+}
+
+void TriangleOrder::fetchOrder(const std::vector<Face> & faces, int nbVertices, std::vector<int> & order) {
+	order.clear();
+	order.reserve(nbVertices);
+	std::vector<char> used(nbVertices, 0);
+	for (size_t f = 0; f < faces.size(); f++) {
+		for (int k = 0; k < 3; k++) {
+			int v = faces[f][k];
+			if (used[v]) continue;
+			used[v] = 1;
+			order.push_back(v);
+		}
+	}
+	// Vertices of no face keep their order, at the end
+	for (int v = 0; v < nbVertices; v++) {
+		if (!used[v]) order.push_back(v);
+	}
+}
+
+void TriangleOrder::optimize(trimesh::TriMesh* mesh, std::vector<int> & order) {
+	int nbVertices = mesh->vertices.size();
+	std::vector<int> faceOrder, clusters;
+	tipsify(mesh->faces, nbVertices, kCacheSize, faceOrder, clusters);
+	sortClusters(mesh, faceOrder, clusters);
+	std::vector<Face> faces(faceOrder.size());
+	for (size_t f = 0; f < faceOrder.size(); f++) faces[f] = mesh->faces[faceOrder[f]];
+	mesh->faces.swap(faces);
+	// Face numbers changed
+	mesh->tstrips.clear();
+	mesh->adjacentfaces.clear();
+	mesh->across_edge.clear();
+	fetchOrder(mesh->faces, nbVertices, order);
+}
+
+CacheStats TriangleOrder::simulate(const std::vector<Face> & faces, int nbVertices, int cacheSize) {
+	FifoCache cache(nbVertices, cacheSize);
+	std::vector<char> used(nbVertices, 0);
+	int misses = 0, nbUsed = 0;
+	for (size_t f = 0; f < faces.size(); f++) {
+		for (int k = 0; k < 3; k++) {
+			int v = faces[f][k];
+			misses += cache.use(v);
+			if (!used[v]) {
+				used[v] = 1;
+				nbUsed++;
+			}
+		}
+	}
+	CacheStats stats;
+	stats.acmr = faces.empty() ? 0 : (double)misses / faces.size();
+	stats.atvr = (nbUsed == 0) ? 0 : (double)misses / nbUsed;
+	return stats;
+}
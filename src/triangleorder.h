@@ -0,0 +1,41 @@
+#ifndef _TRIANGLEORDER_H_
+#define _TRIANGLEORDER_H_
+
+#include "TriMesh.h"
+
+// Transformed vertices reused from the post-transform cache, simulated as a
+// FIFO of cacheSize vertices : ACMR is the number of vertices transformed
+// per triangle (3 at worst, 0.5 at best on a closed mesh), ATVR per vertex
+// (1 at best).
+struct CacheStats {
+	double acmr;
+	double atvr;
+};
+
+// Order of the triangles of a mesh for the GPU, chosen once at load :
+//   - Tipsify (Sander, Nehab, Barczak 2007) : triangles fanned around
+//     vertices still in the cache, in linear time
+//   - overdraw : the runs of Tipsify, cut where the cache is warm, drawn
+//     outward-facing first, so that the front of convex parts hides what
+//     is behind them whatever the view
+//   - vertex fetch : vertices renumbered in the order triangles first use them
+class TriangleOrder {
+public :
+	static const int kCacheSize = 16;
+
+	// Reorders the faces of the mesh. The vertices are left to the caller,
+	// which moves vertex order[i] to i (see VertexOrder::reorder).
+	static void optimize(trimesh::TriMesh* mesh, std::vector<int> & order);
+
+	// Face order of Tipsify, and the first face of each of its clusters
+	static void tipsify(const std::vector<trimesh::TriMesh::Face> & faces, int nbVertices, int cacheSize,
+	                    std::vector<int> & faceOrder, std::vector<int> & clusters);
+	// Clusters of faceOrder sorted by their occlusion potential
+	static void sortClusters(const trimesh::TriMesh* mesh, std::vector<int> & faceOrder, const std::vector<int> & clusters);
+	// Vertices in their first use by faces
+	static void fetchOrder(const std::vector<trimesh::TriMesh::Face> & faces, int nbVertices, std::vector<int> & order);
+
+	static CacheStats simulate(const std::vector<trimesh::TriMesh::Face> & faces, int nbVertices, int cacheSize = kCacheSize);
+};
+
+#endif
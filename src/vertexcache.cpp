@@ -0,0 +1,275 @@
+#include "vertexcache.h"
+#include "skinningengine.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+const char kMagic[4] = {'V', 'A', 'C', 'H'};
+const uint32_t kVersion = 1;
+const int kQuantMax = 65535;
+
+// Value of q predicted from the frames before, within a run
+inline int32_t predict(int rank, int32_t previous, int32_t beforePrevious) {
+	if (rank == 0) return 0;
+	if (rank == 1) return previous;
+	return 2 * previous - beforePrevious;
+}
+
+// Differences of one frame, appended block by block to bytes
+void encodeFrame(const std::vector<int16_t> & residual, std::vector<uint8_t> & bytes) {
+	size_t nbValues = residual.size();
+	size_t blockValues = 3 * VertexCache::kBlockVertices;
+	size_t nbBlocks = (nbValues + blockValues - 1) / blockValues;
+	bytes.assign(nbBlocks, 0);
+	for (size_t b = 0; b < nbBlocks; b++) {
+		size_t begin = b * blockValues, end = std::min(nbValues, begin + blockValues);
+		uint8_t width = 0;
+		for (size_t i = begin; i < end; i++) {
+			if (residual[i] < -128 || residual[i] > 127) width = 2;
+			else if (residual[i] != 0 && width == 0) width = 1;
+		}
+		bytes[b] = width;
+		if (width == 1) {
+			for (size_t i = begin; i < end; i++) bytes.push_back((uint8_t)(int8_t)residual[i]);
+		} else if (width == 2) {
+			size_t at = bytes.size();
+			bytes.resize(at + (end - begin) * sizeof(int16_t));
+			memcpy(&bytes[at], &residual[begin], (end - begin) * sizeof(int16_t));
+		}
+	}
+}
+
+// q holds the frame before previous on entry, the decoded frame on return.
+// Arithmetic modulo 2^16, as the encoder's
+template <typename Residual>
+inline void decodeBlock(const Residual* r, int rank, const uint16_t* previous, uint16_t* q, size_t n) {
+	if (rank == 0) {
+		for (size_t i = 0; i < n; i++) q[i] = (uint16_t)r[i];
+	} else if (rank == 1) {
+		for (size_t i = 0; i < n; i++) q[i] = (uint16_t)(previous[i] + r[i]);
+	} else {
+		for (size_t i = 0; i < n; i++) q[i] = (uint16_t)(2 * previous[i] - q[i] + r[i]);
+	}
+}
+
+}
+
+VertexCache::VertexCache() : _offsets(NULL), _decoded(-1) {
+	memset(&_header, 0, sizeof(_header));
+}
+
+bool VertexCache::write(const std::string & fileName, const SkinInfluences & skin, const AnimationBake & bake, double frameTime) {
+	int nbVertices = skin.nbVertices();
+	int nbFrames = bake.nbFrames();
+	if (nbVertices == 0 || nbFrames == 0) return false;
+
+	// First pass : bounds of the whole clip
+	float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+	float hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	#pragma omp parallel
+	{
+		SkinningEngine engine;
+		std::vector<trimesh::point> pose(nbVertices);
+		float tlo[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+		float thi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+		#pragma omp for schedule(dynamic)
+		for (int f = 0; f < nbFrames; f++) {
+			engine.setPose(bake.matrices(f), bake.nbJoints());
+			engine.skinRange(skin, 0, nbVertices, pose.data());
+			for (int v = 0; v < nbVertices; v++) {
+				for (int k = 0; k < 3; k++) {
+					tlo[k] = std::min(tlo[k], pose[v][k]);
+					thi[k] = std::max(thi[k], pose[v][k]);
+				}
+			}
+		}
+		#pragma omp critical
+		for (int k = 0; k < 3; k++) {
+			lo[k] = std::min(lo[k], tlo[k]);
+			hi[k] = std::max(hi[k], thi[k]);
+		}
+	}
+
+	VachHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, kMagic, 4);
+	h.version = kVersion;
+	h.nbVertices = nbVertices;
+	h.nbFrames = nbFrames;
+	h.keyInterval = kKeyInterval;
+	h.frameTime = frameTime;
+	for (int k = 0; k < 3; k++) {
+		h.bias[k] = lo[k];
+		h.scale[k] = (hi[k] - lo[k]) / kQuantMax;
+	}
+
+	return writeFileAtomically(fileName, [&](FILE* out) {
+		std::vector<uint64_t> offsets(nbFrames + 1);
+		offsets[0] = sizeof(VachHeader) + offsets.size() * sizeof(uint64_t);
+		bool ok = fwrite(&h, sizeof(h), 1, out) == 1
+		       && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), out) == offsets.size();
+
+		// Second pass : runs are independent, encoded in parallel a batch at a time
+		// so that only one batch of encoded frames is held in memory
+		int nbRuns = (nbFrames + kKeyInterval - 1) / kKeyInterval;
+		int batch = 1;
+#ifdef _OPENMP
+		batch = omp_get_max_threads();
+#endif
+		std::vector<std::vector<uint8_t> > encoded(batch * kKeyInterval);
+		for (int firstRun = 0; ok && firstRun < nbRuns; firstRun += batch) {
+			int lastRun = std::min(nbRuns, firstRun + batch);
+			#pragma omp parallel
+			{
+				SkinningEngine engine;
+				std::vector<trimesh::point> pose(nbVertices);
+				std::vector<uint16_t> q(3 * nbVertices), previous(3 * nbVertices), beforePrevious(3 * nbVertices);
+				std::vector<int16_t> residual(3 * nbVertices);
+				#pragma omp for schedule(dynamic)
+				for (int run = firstRun; run < lastRun; run++) {
+					int begin = run * kKeyInterval;
+					int end = std::min(nbFrames, begin + kKeyInterval);
+					for (int f = begin; f < end; f++) {
+						engine.setPose(bake.matrices(f), bake.nbJoints());
+						engine.skinRange(skin, 0, nbVertices, pose.data());
+						for (int v = 0, i = 0; v < nbVertices; v++) {
+							for (int k = 0; k < 3; k++, i++) {
+								long quantized = 0;
+								if (h.scale[k] > 0) quantized = lround((pose[v][k] - h.bias[k]) / h.scale[k]);
+								q[i] = std::max(0L, std::min((long)kQuantMax, quantized));
+								residual[i] = (int16_t)(uint16_t)(q[i] - predict(f - begin, previous[i], beforePrevious[i]));
+							}
+						}
+						encodeFrame(residual, encoded[f - firstRun * kKeyInterval]);
+						beforePrevious.swap(previous);
+						previous.swap(q);
+					}
+				}
+			}
+			int firstFrame = firstRun * kKeyInterval;
+			int endFrame = std::min(nbFrames, lastRun * kKeyInterval);
+			for (int f = firstFrame; ok && f < endFrame; f++) {
+				const std::vector<uint8_t> & bytes = encoded[f - firstFrame];
+				ok = fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+				offsets[f + 1] = offsets[f] + bytes.size();
+			}
+		}
+
+		// Frame offsets are only known now
+		ok = ok && fseek(out, sizeof(VachHeader), SEEK_SET) == 0
+		        && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), out) == offsets.size();
+		return ok;
+	});
+}
+
+bool VertexCache::open(const std::string & fileName) {
+	close();
+	if (!_file.open(fileName) || _file.size() < sizeof(VachHeader)) {
+		_file.close();
+		return false;
+	}
+	const VachHeader & h = *reinterpret_cast<const VachHeader*>(_file.data());
+	size_t tableEnd = sizeof(VachHeader) + ((size_t)h.nbFrames + 1) * sizeof(uint64_t);
+	if (memcmp(h.magic, kMagic, 4) != 0 || h.version != kVersion || h.keyInterval == 0 || tableEnd > _file.size()) {
+		_file.close();
+		return false;
+	}
+	const uint64_t* offsets = reinterpret_cast<const uint64_t*>(_file.data() + sizeof(VachHeader));
+	if (offsets[0] != tableEnd || offsets[h.nbFrames] != _file.size()) {
+		_file.close();
+		return false;
+	}
+	for (uint32_t f = 0; f < h.nbFrames; f++) {
+		if (offsets[f + 1] < offsets[f]) {
+			_file.close();
+			return false;
+		}
+	}
+	_header = h;
+	_offsets = offsets;
+	_q.assign(3 * (size_t)h.nbVertices, 0);
+	_previous.assign(3 * (size_t)h.nbVertices, 0);
+	_decoded = -1;
+	return true;
+}
+
+void VertexCache::close() {
+	_file.close();
+	memset(&_header, 0, sizeof(_header));
+	_offsets = NULL;
+	_q.clear();
+	_previous.clear();
+	_decoded = -1;
+}
+
+bool VertexCache::decodeFrame(int iframe) {
+	static const int8_t zeros[3 * kBlockVertices] = {0};
+	int rank = iframe % _header.keyInterval;
+	size_t nbValues = _q.size();
+	size_t blockValues = 3 * kBlockVertices;
+	size_t nbBlocks = (nbValues + blockValues - 1) / blockValues;
+	const uint8_t* widths = reinterpret_cast<const uint8_t*>(_file.data() + _offsets[iframe]);
+	const uint8_t* in = widths + nbBlocks;
+	// Widths and blocks inside the frame, checked before anything is decoded
+	size_t frameBytes = _offsets[iframe + 1] - _offsets[iframe];
+	size_t payload = 0;
+	if (nbBlocks > frameBytes) return false;
+	for (size_t b = 0; b < nbBlocks; b++) {
+		if (widths[b] > 2) return false;
+		payload += widths[b] * std::min(nbValues - b * blockValues, blockValues);
+	}
+	if (nbBlocks + payload > frameBytes) return false;
+	// _q becomes this frame, _previous the one before
+	_previous.swap(_q);
+	for (size_t b = 0; b < nbBlocks; b++) {
+		size_t begin = b * blockValues, n = std::min(nbValues - begin, blockValues);
+		uint16_t* q = &_q[begin];
+		const uint16_t* previous = &_previous[begin];
+		if (widths[b] == 0) {
+			decodeBlock(zeros, rank, previous, q, n);
+		} else if (widths[b] == 1) {
+			decodeBlock(reinterpret_cast<const int8_t*>(in), rank, previous, q, n);
+			in += n;
+		} else {
+			// Blocks are not aligned in the file
+			int16_t residual[3 * kBlockVertices];
+			memcpy(residual, in, n * sizeof(int16_t));
+			decodeBlock(residual, rank, previous, q, n);
+			in += n * sizeof(int16_t);
+		}
+	}
+	_decoded = iframe;
+	return true;
+}
+
+bool VertexCache::fetch(int iframe, trimesh::point* out) {
+	if (!isOpen() || iframe < 0 || iframe >= (int)_header.nbFrames) return false;
+	int runStart = iframe - iframe % _header.keyInterval;
+	int next = (_decoded >= runStart && _decoded <= iframe) ? _decoded + 1 : runStart;
+	for (int f = next; f <= iframe; f++) {
+		if (!decodeFrame(f)) {
+			_decoded = -1;
+			return false;
+		}
+	}
+
+	for (uint32_t v = 0; v < _header.nbVertices; v++) {
+		const uint16_t* q = &_q[3 * v];
+		out[v] = trimesh::point(_header.bias[0] + _header.scale[0] * q[0],
+		                        _header.bias[1] + _header.scale[1] * q[1],
+		                        _header.bias[2] + _header.scale[2] * q[2], 1);
+	}
+
+	// Following frames, while this one is shown
+	int last = std::min((int)_header.nbFrames, iframe + 1 + kReadAhead);
+	if (iframe + 1 < last) _file.willNeed(_offsets[iframe + 1], _offsets[last] - _offsets[iframe + 1]);
+	return true;
+}
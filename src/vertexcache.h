@@ -0,0 +1,81 @@
+#ifndef _VERTEXCACHE_H_
+#define _VERTEXCACHE_H_
+
+#include "animationbake.h"
+#include "skininfluences.h"
+#include "mappedfile.h"
+#include <string>
+#include <stdint.h>
+
+// Skinned mesh of every frame of a clip, for playback without skinning.
+// Positions are quantized to 16 bits per axis over the bounding box of the
+// whole clip. Frames are grouped in runs of kKeyInterval : the first frame
+// of a run is stored as is, the next ones as the difference with a linear
+// prediction from the two frames before (a plain delta for the second),
+// modulo 2^16. Differences go by blocks of kBlockVertices vertices, each
+// block as narrow as its largest difference : nothing, int8 or int16.
+// Decoding is a fixed amount of arithmetic per vertex, without branches
+// inside a block.
+//
+// Layout (native endianness) :
+//   VachHeader
+//   offsets   : nbFrames + 1 x uint64, start of each frame from the file start
+//   frames    : one width byte per block (0, 1 or 2 bytes per value), then
+//               the blocks, 3 values per vertex, vertex-major
+struct VachHeader {
+	char magic[4];				// "VACH"
+	uint32_t version;
+	uint32_t nbVertices;
+	uint32_t nbFrames;
+	uint32_t keyInterval;
+	uint32_t pad;
+	double frameTime;
+	float bias[3];				// position = bias + scale * q
+	float scale[3];
+};
+
+class VertexCache {
+public :
+	static const int kKeyInterval = 16;
+	static const int kBlockVertices = 64;
+	// Frames whose bytes are requested from the disk ahead of playback
+	static const int kReadAhead = 8;
+
+	VertexCache();
+
+	// Skins every frame of the bake (runs of frames in parallel) and writes
+	// the cache. Returns false if the file could not be written.
+	static bool write(const std::string & fileName, const SkinInfluences & skin, const AnimationBake & bake, double frameTime);
+
+	// Maps a cache file, false if it is not one
+	bool open(const std::string & fileName);
+	void close();
+	bool isOpen() const { return _file.isOpen(); }
+	int nbVertices() const { return _header.nbVertices; }
+	int nbFrames() const { return _header.nbFrames; }
+	double frameTime() const { return _header.frameTime; }
+	size_t bytes() const { return _file.size(); }
+
+	// Positions of a frame (w = 1). Decoding goes on from the last frame
+	// fetched when it is in the same run and not after iframe, otherwise from
+	// the start of the run : at most kKeyInterval frames decoded per call.
+	// False, out left as it was, if a frame of the file is damaged.
+	bool fetch(int iframe, trimesh::point* out);
+
+private :
+	VertexCache(const VertexCache &);
+	VertexCache & operator=(const VertexCache &);
+
+	// False if the frame does not fit between its offsets
+	bool decodeFrame(int iframe);
+
+	MappedFile _file;
+	VachHeader _header;
+	const uint64_t* _offsets;
+	// Quantized positions of the last two frames decoded
+	std::vector<uint16_t> _q;
+	std::vector<uint16_t> _previous;
+	int _decoded;
+};
+
+#endif
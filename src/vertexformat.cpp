@@ -0,0 +1,106 @@
+#include "vertexformat.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <string.h>
+
+namespace {
+
+uint8_t packUnit(float x) {
+	return (uint8_t)lrintf(std::max(0.0f, std::min(1.0f, x)) * 255.0f);
+}
+
+// 10-bit signed normalized component, as GL reads it
+float unpackSnorm10(uint32_t bits) {
+	int32_t v = (int32_t)(bits << 22) >> 22;
+	return std::max(v / 511.0f, -1.0f);
+}
+
+}
+
+void PackedMesh::pack(const trimesh::point* positions, const trimesh::vec* normals, const float* colors,
+                      const trimesh::vec2* texcoords, int nbVertices) {
+	_vertices.resize(nbVertices);
+	float lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+	for (int v = 0; v < nbVertices; v++) {
+		for (int k = 0; k < 3; k++) {
+			lo[k] = std::min(lo[k], positions[v][k]);
+			hi[k] = std::max(hi[k], positions[v][k]);
+		}
+	}
+	float inverse[3];
+	for (int k = 0; k < 3; k++) {
+		_bias[k] = (nbVertices > 0) ? lo[k] : 0.0f;
+		_scale[k] = (nbVertices > 0) ? hi[k] - lo[k] : 0.0f;
+		inverse[k] = (_scale[k] > 0) ? 65535.0f / _scale[k] : 0.0f;
+	}
+
+	#pragma omp parallel for schedule(static) if(nbVertices >= 16384)
+	for (int v = 0; v < nbVertices; v++) {
+		PackedVertex & out = _vertices[v];
+		for (int k = 0; k < 3; k++) {
+			float q = (positions[v][k] - _bias[k]) * inverse[k];
+			out.position[k] = (uint16_t)lrintf(std::max(0.0f, std::min(65535.0f, q)));
+		}
+		out.position[3] = 65535;
+		out.normal = packNormal(normals[v]);
+		for (int k = 0; k < 4; k++) out.color[k] = colors ? packUnit(colors[4 * v + k]) : 0;
+		for (int k = 0; k < 2; k++) out.texcoord[k] = texcoords ? packHalf(texcoords[v][k]) : 0;
+	}
+}
+
+trimesh::point PackedMesh::position(int vertex) const {
+	trimesh::point p(0, 0, 0, 1);
+	for (int k = 0; k < 3; k++) p[k] = _bias[k] + _scale[k] * (_vertices[vertex].position[k] / 65535.0f);
+	return p;
+}
+
+trimesh::vec PackedMesh::normal(int vertex) const {
+	uint32_t n = _vertices[vertex].normal;
+	return trimesh::vec(unpackSnorm10(n), unpackSnorm10(n >> 10), unpackSnorm10(n >> 20), 0);
+}
+
+// x, y, z in bits 0-9, 10-19 and 20-29, w = 0
+uint32_t PackedMesh::packNormal(const trimesh::vec & n) {
+	uint32_t bits = 0;
+	for (int k = 0; k < 3; k++) {
+		int32_t c = (int32_t)lrintf(std::max(-1.0f, std::min(1.0f, n[k])) * 511.0f);
+		bits |= ((uint32_t)c & 0x3ff) << (10 * k);
+	}
+	return bits;
+}
+
+// Rounded to nearest even, overflow to infinity
+uint16_t PackedMesh::packHalf(float f) {
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+	uint16_t sign = (x >> 16) & 0x8000;
+	uint32_t magnitude = x & 0x7fffffff;
+	if (magnitude > 0x7f800000) return sign | 0x7e00;		// NaN
+	if (magnitude >= 0x477ff000) return sign | 0x7c00;		// 65520 and beyond
+	if (magnitude < 0x38800000) {
+		// Under the smallest normal half : multiples of 2^-24
+		float a;
+		memcpy(&a, &magnitude, sizeof(a));
+		return sign | (uint16_t)lrintf(a * 16777216.0f);
+	}
+	uint32_t h = (magnitude - 0x38000000) >> 13;
+	uint32_t rest = magnitude & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+	return sign | (uint16_t)h;
+}
+
+float PackedMesh::unpackHalf(uint16_t h) {
+	uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+	if (exponent == 0) {
+		float f = std::ldexp((float)mantissa, -24);
+		return sign ? -f : f;
+	}
+	uint32_t x = sign | ((exponent == 31) ? 0x7f800000 | (mantissa << 13) : ((exponent + 112) << 23) | (mantissa << 13));
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
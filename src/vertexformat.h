@@ -0,0 +1,57 @@
+#ifndef _VERTEXFORMAT_H_
+#define _VERTEXFORMAT_H_
+
+#include "TriMesh.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Vertex of the static buffers of the model and the ground, all attributes
+// interleaved in 20 bytes, read by the shaders as normalized values :
+//   position : 16 bits per axis over the bounding box, w = 1
+//   normal   : GL_INT_2_10_10_10_REV, w = 0
+//   color    : RGBA8
+//   texcoord : half floats
+// against 56 bytes for separate vec4 positions, normals and colors and vec2
+// texture coordinates.
+struct PackedVertex {
+	uint16_t position[4];
+	uint32_t normal;
+	uint8_t color[4];
+	uint16_t texcoord[2];
+};
+
+// Vertices of a mesh in the packed format. The vertex shaders get positions
+// back as bias + scale * position.
+class PackedMesh {
+public :
+	static const int kPositionOffset = offsetof(PackedVertex, position);
+	static const int kNormalOffset = offsetof(PackedVertex, normal);
+	static const int kColorOffset = offsetof(PackedVertex, color);
+	static const int kTexcoordOffset = offsetof(PackedVertex, texcoord);
+
+	PackedMesh() {};
+
+	// Colors (RGBA, 4 floats per vertex) and texcoords may be NULL : left at 0
+	void pack(const trimesh::point* positions, const trimesh::vec* normals, const float* colors,
+	          const trimesh::vec2* texcoords, int nbVertices);
+	int nbVertices() const { return _vertices.size(); }
+	const PackedVertex* data() const { return _vertices.data(); }
+	size_t bytes() const { return _vertices.size() * sizeof(PackedVertex); }
+	const float* bias() const { return _bias; }
+	const float* scale() const { return _scale; }
+
+	// Attributes back as the shaders read them
+	trimesh::point position(int vertex) const;
+	trimesh::vec normal(int vertex) const;
+
+	static uint32_t packNormal(const trimesh::vec & n);
+	static uint16_t packHalf(float f);
+	static float unpackHalf(uint16_t h);
+
+private :
+	std::vector<PackedVertex> _vertices;
+	float _bias[3];
+	float _scale[3];
+};
+
+#endif
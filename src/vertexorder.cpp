@@ -0,0 +1,87 @@
+#include "vertexorder.h"
+
+#include <algorithm>
+
+namespace {
+
+// Attribute of every vertex, moved with them; absent attributes are left empty
+template<class T>
+void permuteAttribute(std::vector<T> & attribute, const std::vector<int> & order) {
+	if (attribute.size() != order.size()) return;
+	std::vector<T> sorted(order.size());
+	for (size_t i = 0; i < order.size(); i++) sorted[i] = attribute[order[i]];
+	attribute.swap(sorted);
+}
+
+}
+
+void VertexOrder::reset(int nbVertices) {
+	_fileOf.resize(nbVertices);
+	_meshOf.resize(nbVertices);
+	for (int v = 0; v < nbVertices; v++) _fileOf[v] = _meshOf[v] = v;
+	_fileOrder = true;
+}
+
+void VertexOrder::sortedOrder(const SkinInfluences & skin, std::vector<int> & order) {
+	int nbVertices = skin.nbVertices();
+	int stride = skin.stride();
+	// Dominant joint and number of influences, then the other joints heaviest
+	// first : vertices with the same joints in the same slots end up together
+	std::vector<std::pair<uint64_t, uint64_t> > keys(nbVertices);
+	for (int v = 0; v < nbVertices; v++) {
+		uint64_t joints[kMaxInfluences] = {};
+		for (int s = 0; s < skin.width(); s++) joints[s] = skin._joint[s * stride + v];
+		keys[v].first = joints[0] << 3 | skin.nbInfluences(v);
+		keys[v].second = joints[1] << 32 | joints[2] << 16 | joints[3];
+	}
+	order.resize(nbVertices);
+	for (int v = 0; v < nbVertices; v++) order[v] = v;
+	std::stable_sort(order.begin(), order.end(), [&keys](int a, int b) { return keys[a] < keys[b]; });
+}
+
+void VertexOrder::permute(trimesh::TriMesh* mesh, const std::vector<int> & order) {
+	permuteAttribute(mesh->vertices, order);
+	permuteAttribute(mesh->normals, order);
+	permuteAttribute(mesh->colors, order);
+	permuteAttribute(mesh->texcoords, order);
+	std::vector<int> newIndex(order.size());
+	for (size_t i = 0; i < order.size(); i++) newIndex[order[i]] = i;
+	for (size_t f = 0; f < mesh->faces.size(); f++) {
+		for (int k = 0; k < 3; k++) mesh->faces[f][k] = newIndex[mesh->faces[f][k]];
+	}
+	// Derived from the old numbering, rebuilt on demand by need_*()
+	mesh->tstrips.clear();
+	mesh->neighbors.clear();
+	mesh->adjacentfaces.clear();
+	mesh->across_edge.clear();
+}
+
+bool VertexOrder::sort(trimesh::TriMesh* mesh, SkinInfluences & skin) {
+	int nbVertices = skin.nbVertices();
+	if (nbVertices != (int)mesh->vertices.size()) return false;
+	if (nbVertices != this->nbVertices()) reset(nbVertices);
+	std::vector<int> order;
+	sortedOrder(skin, order);
+	int v = 0;
+	while (v < nbVertices && order[v] == v) v++;
+	if (v == nbVertices) return false;
+
+	reorder(mesh, order);
+	SkinInfluences unsorted(skin);
+	skin.copyVertices(unsorted, order);
+	return true;
+}
+
+void VertexOrder::reorder(trimesh::TriMesh* mesh, const std::vector<int> & order) {
+	int nbVertices = order.size();
+	if (nbVertices != this->nbVertices()) reset(nbVertices);
+	permute(mesh, order);
+	std::vector<int> fileOf(nbVertices);
+	for (int i = 0; i < nbVertices; i++) fileOf[i] = _fileOf[order[i]];
+	_fileOf.swap(fileOf);
+	_fileOrder = true;
+	for (int i = 0; i < nbVertices; i++) {
+		_meshOf[_fileOf[i]] = i;
+		if (_fileOf[i] != i) _fileOrder = false;
+	}
+}
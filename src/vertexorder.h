@@ -0,0 +1,45 @@
+#ifndef _VERTEXORDER_H_
+#define _VERTEXORDER_H_
+
+#include "skininfluences.h"
+#include "TriMesh.h"
+
+// Order of the vertices of a skinned mesh. Meshes come in file order, where
+// consecutive vertices move with unrelated joints; sorted, vertices are
+// grouped by dominant joint, then by the rest of their influences (file
+// order among equals), so that runs of vertices share their joint matrices
+// (see SkinningEngine::batches).
+// The file index of every vertex is kept : data keyed by file vertex, as
+// weight files and vertex caches, goes through fileVertices / meshVertices.
+class VertexOrder {
+public :
+	VertexOrder() : _fileOrder(true) {};
+
+	// nbVertices vertices in file order
+	void reset(int nbVertices);
+	bool isFileOrder() const { return _fileOrder; }
+	int nbVertices() const { return _fileOf.size(); }
+	// File vertex at each mesh index
+	const std::vector<int> & fileVertices() const { return _fileOf; }
+	// Mesh index of each file vertex
+	const std::vector<int> & meshVertices() const { return _meshOf; }
+
+	// Sorts the vertices of the mesh by their influences in skin (mesh order) :
+	// vertex attributes are moved, faces renumbered and the skin reordered
+	// with them. Returns false when they were already in that order.
+	bool sort(trimesh::TriMesh* mesh, SkinInfluences & skin);
+	// Moves vertex order[i] of the mesh to i, keeping track of file vertices
+	void reorder(trimesh::TriMesh* mesh, const std::vector<int> & order);
+
+	// Vertex of skin placed at each index once sorted
+	static void sortedOrder(const SkinInfluences & skin, std::vector<int> & order);
+	// Moves vertex order[i] of the mesh to i and renumbers the faces
+	static void permute(trimesh::TriMesh* mesh, const std::vector<int> & order);
+
+private :
+	std::vector<int> _fileOf;
+	std::vector<int> _meshOf;
+	bool _fileOrder;
+};
+
+#endif
@@ -0,0 +1,308 @@
+#include "weightfile.h"
+#include "mappedfile.h"
+
+#include <charconv>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace {
+
+const char kMagic[4] = {'S', 'K', 'W', 'B'};
+const uint32_t kVersion = 1;
+
+struct Triple {
+	int vertex;
+	int joint;
+	float weight;
+};
+
+// Section offsets of a binary file described by its header
+struct SkwLayout {
+	size_t names, offsets, weights, joints, end;
+
+	SkwLayout(const SkwHeader & h) {
+		names = sizeof(SkwHeader);
+		offsets = names + h.namesSize;
+		weights = offsets + ((size_t)h.nbVertices + 1) * sizeof(uint32_t);
+		joints = weights + (size_t)h.nbInfluences * sizeof(float);
+		end = joints + (size_t)h.nbInfluences * sizeof(uint16_t);
+	}
+};
+
+inline bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skipBlanks(const char* p, const char* end) {
+	while (p < end && isBlank(*p)) p++;
+	return p;
+}
+
+inline const char* nextLine(const char* p, const char* end) {
+	const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+	return eol ? eol + 1 : end;
+}
+
+template <typename T>
+inline bool parseValue(const char* & p, const char* end, T & value) {
+	p = skipBlanks(p, end);
+	std::from_chars_result r = std::from_chars(p, end, value);
+	if (r.ec != std::errc()) return false;
+	p = r.ptr;
+	return true;
+}
+
+// Triples of the lines starting in [begin, end[, and the number of rows
+// they make (largest vertex + 1). False on a vertex outside [0, nbVertices[
+// or a joint outside [0, nbJoints[.
+bool parseChunk(const char* begin, const char* end, const char* fileEnd, bool sparse, int nbJoints, int nbVertices,
+                std::vector<Triple> & out, int & nbRows) {
+	nbRows = 0;
+	for (const char* line = begin; line < end; line = nextLine(line, fileEnd)) {
+		const char* p = line;
+		Triple t;
+		if (!parseValue(p, fileEnd, t.vertex)) continue;
+		if (t.vertex < 0 || t.vertex >= nbVertices) return false;
+		nbRows = std::max(nbRows, t.vertex + 1);
+		if (sparse) {
+			if (!parseValue(p, fileEnd, t.joint) || !parseValue(p, fileEnd, t.weight)) continue;
+			if (t.joint < 0 || t.joint >= nbJoints) return false;
+			if (t.weight != 0) out.push_back(t);
+			continue;
+		}
+		for (t.joint = 0; t.joint < nbJoints; t.joint++) {
+			if (!parseValue(p, fileEnd, t.weight)) break;
+			if (t.weight != 0) out.push_back(t);
+		}
+	}
+	return true;
+}
+
+// Text file : header line of joint names, then parallel chunks of lines.
+// Vertices are checked against nbVertices before the table is allocated.
+bool readText(const MappedFile & file, bool sparse, int nbVertices, SkinWeights & weights) {
+	const char* end = file.end();
+	const char* body = nextLine(file.data(), end);
+	weights.names.clear();
+	const char* p = file.data();
+	// First token is "id" or "sparse"
+	for (bool first = true; p < body; first = false) {
+		p = skipBlanks(p, body);
+		const char* token = p;
+		while (p < body && !isBlank(*p) && *p != '\n') p++;
+		if (p > token && !first) weights.names.push_back(std::string(token, p));
+		if (p < body && *p == '\n') break;
+	}
+	int nbJoints = weights.names.size();
+	if (nbJoints == 0 || nbJoints > 65535) return false;
+
+	int nbChunks = 1;
+#ifdef _OPENMP
+	nbChunks = 4 * omp_get_max_threads();
+#endif
+	std::vector<const char*> starts(nbChunks + 1);
+	for (int c = 0; c <= nbChunks; c++) {
+		const char* at = body + (end - body) * c / nbChunks;
+		// Each chunk starts at a line
+		starts[c] = (c == 0 || c == nbChunks) ? at : nextLine(at - 1, end);
+	}
+	std::vector<std::vector<Triple> > triples(nbChunks);
+	std::vector<int> chunkRows(nbChunks, 0);
+	bool ok = true;
+	#pragma omp parallel for schedule(dynamic) reduction(&&:ok)
+	for (int c = 0; c < nbChunks; c++) {
+		if (starts[c] < starts[c + 1]) {
+			ok = parseChunk(starts[c], starts[c + 1], end, sparse, nbJoints, nbVertices, triples[c], chunkRows[c]) && ok;
+		}
+	}
+	if (!ok) return false;
+
+	// Grouped by vertex (counting sort), in file order within a vertex
+	int nbRows = *std::max_element(chunkRows.begin(), chunkRows.end());
+	size_t nbInfluences = 0;
+	for (const std::vector<Triple> & chunk : triples) nbInfluences += chunk.size();
+	weights.offsets.assign(nbRows + 1, 0);
+	for (const std::vector<Triple> & chunk : triples) {
+		for (const Triple & t : chunk) weights.offsets[t.vertex + 1]++;
+	}
+	for (int v = 0; v < nbRows; v++) weights.offsets[v + 1] += weights.offsets[v];
+	std::vector<uint32_t> next(weights.offsets.begin(), weights.offsets.end() - 1);
+	weights.weights.resize(nbInfluences);
+	weights.joints.resize(nbInfluences);
+	for (const std::vector<Triple> & chunk : triples) {
+		for (const Triple & t : chunk) {
+			uint32_t i = next[t.vertex]++;
+			weights.weights[i] = t.weight;
+			weights.joints[i] = t.joint;
+		}
+	}
+	return true;
+}
+
+// Header and sections of a mapped binary file, NULL if it is not one
+const SkwHeader* binaryHeader(const MappedFile & file) {
+	if (file.size() < sizeof(SkwHeader)) return NULL;
+	const SkwHeader* h = reinterpret_cast<const SkwHeader*>(file.data());
+	if (memcmp(h->magic, kMagic, 4) != 0 || h->version != kVersion) return NULL;
+	if (SkwLayout(*h).end != file.size()) return NULL;
+	return h;
+}
+
+// Sections of a binary file that stay inside it : names ending in their
+// section, offsets from 0 to nbInfluences never decreasing, joints of the file
+bool validBinary(const MappedFile & file, const SkwHeader & h) {
+	SkwLayout layout(h);
+	const char* name = file.data() + layout.names;
+	const char* namesEnd = file.data() + layout.offsets;
+	for (uint32_t j = 0; j < h.nbJoints; j++) {
+		const char* nul = static_cast<const char*>(memchr(name, '\0', namesEnd - name));
+		if (nul == NULL) return false;
+		name = nul + 1;
+	}
+	const uint32_t* offsets = reinterpret_cast<const uint32_t*>(file.data() + layout.offsets);
+	if (offsets[0] != 0 || offsets[h.nbVertices] != h.nbInfluences) return false;
+	for (uint32_t v = 0; v < h.nbVertices; v++) {
+		if (offsets[v + 1] < offsets[v]) return false;
+	}
+	const uint16_t* joints = reinterpret_cast<const uint16_t*>(file.data() + layout.joints);
+	for (uint32_t i = 0; i < h.nbInfluences; i++) {
+		if (joints[i] >= h.nbJoints) return false;
+	}
+	return true;
+}
+
+// One row per vertex of the skin
+void apply(const uint32_t* offsets, const float* weights, const uint16_t* joints, int nbVertices, SkinInfluences & skin) {
+	skin.reset(nbVertices);
+	std::vector<int> vertexJoints;
+	for (int v = 0; v < nbVertices; v++) {
+		int n = offsets[v + 1] - offsets[v];
+		vertexJoints.assign(joints + offsets[v], joints + offsets[v + 1]);
+		skin.setVertex(v, vertexJoints.data(), weights + offsets[v], n);
+	}
+}
+
+}
+
+WeightFile::Format WeightFile::format(const std::string & fileName) {
+	MappedFile file;
+	if (!file.open(fileName)) return Unknown;
+	if (binaryHeader(file) != NULL) return Binary;
+	if (file.size() >= 6 && memcmp(file.data(), "sparse", 6) == 0) return Sparse;
+	return Dense;
+}
+
+bool WeightFile::load(const std::string & fileName, int nbJoints, int nbVertices, SkinInfluences & skin) {
+	MappedFile file;
+	if (!file.open(fileName)) return false;
+	const SkwHeader* h = binaryHeader(file);
+	if (h != NULL) {
+		// Used in place, nothing to parse
+		if ((int)h->nbJoints != nbJoints || (int)h->nbVertices != nbVertices || !validBinary(file, *h)) return false;
+		SkwLayout layout(*h);
+		const uint32_t* offsets = reinterpret_cast<const uint32_t*>(file.data() + layout.offsets);
+		const uint16_t* joints = reinterpret_cast<const uint16_t*>(file.data() + layout.joints);
+		apply(offsets, reinterpret_cast<const float*>(file.data() + layout.weights), joints, nbVertices, skin);
+		return true;
+	}
+	SkinWeights weights;
+	if (!readText(file, memcmp(file.data(), "sparse", std::min<size_t>(6, file.size())) == 0, nbVertices, weights)) return false;
+	if (weights.nbJoints() != nbJoints || weights.nbVertices() != nbVertices) return false;
+	apply(weights.offsets.data(), weights.weights.data(), weights.joints.data(), nbVertices, skin);
+	return true;
+}
+
+bool WeightFile::read(const std::string & fileName, SkinWeights & weights) {
+	MappedFile file;
+	if (!file.open(fileName)) return false;
+	const SkwHeader* h = binaryHeader(file);
+	if (h == NULL) {
+		// No mesh to bound the vertices with, but each has a line of its own
+		const char* body = nextLine(file.data(), file.end());
+		int nbLines = std::min<ptrdiff_t>(INT_MAX - 1, std::count(body, file.end(), '\n')) + 1;
+		return readText(file, memcmp(file.data(), "sparse", std::min<size_t>(6, file.size())) == 0, nbLines, weights);
+	}
+	if (!validBinary(file, *h)) return false;
+
+	SkwLayout layout(*h);
+	weights.names.clear();
+	const char* name = file.data() + layout.names;
+	for (uint32_t j = 0; j < h->nbJoints; j++) {
+		weights.names.push_back(name);
+		name += weights.names.back().size() + 1;
+	}
+	const uint32_t* offsets = reinterpret_cast<const uint32_t*>(file.data() + layout.offsets);
+	const float* values = reinterpret_cast<const float*>(file.data() + layout.weights);
+	const uint16_t* joints = reinterpret_cast<const uint16_t*>(file.data() + layout.joints);
+	weights.offsets.assign(offsets, offsets + h->nbVertices + 1);
+	weights.weights.assign(values, values + h->nbInfluences);
+	weights.joints.assign(joints, joints + h->nbInfluences);
+	return true;
+}
+
+bool WeightFile::writeSparse(const std::string & fileName, const SkinWeights & weights) {
+	std::string text = "sparse";
+	for (const std::string & name : weights.names) text += " " + name;
+	text += "\n";
+	char line[64];
+	for (int v = 0; v < weights.nbVertices(); v++) {
+		// Vertex alone, so that the file keeps its row
+		if (weights.offsets[v] == weights.offsets[v + 1]) text += std::to_string(v) + "\n";
+		for (uint32_t i = weights.offsets[v]; i < weights.offsets[v + 1]; i++) {
+			int n = snprintf(line, sizeof(line), "%d %d %f\n", v, weights.joints[i], weights.weights[i]);
+			text.append(line, n);
+		}
+	}
+	return writeFileAtomically(fileName, text.data(), text.size());
+}
+
+bool WeightFile::writeBinary(const std::string & fileName, const SkinWeights & weights) {
+	SkwHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, kMagic, 4);
+	h.version = kVersion;
+	h.nbJoints = weights.nbJoints();
+	h.nbVertices = weights.nbVertices();
+	h.nbInfluences = weights.nbInfluences();
+	std::string names;
+	for (const std::string & name : weights.names) {
+		names += name;
+		names += '\0';
+	}
+	names.resize(align8(names.size()), '\0');
+	h.namesSize = names.size();
+	SkwLayout layout(h);
+
+	std::vector<char> data(layout.end, 0);
+	memcpy(&data[0], &h, sizeof(h));
+	memcpy(&data[layout.names], names.data(), names.size());
+	if (weights.offsets.empty()) {
+		memset(&data[layout.offsets], 0, sizeof(uint32_t));
+	} else {
+		memcpy(&data[layout.offsets], weights.offsets.data(), weights.offsets.size() * sizeof(uint32_t));
+	}
+	memcpy(&data[layout.weights], weights.weights.data(), weights.weights.size() * sizeof(float));
+	memcpy(&data[layout.joints], weights.joints.data(), weights.joints.size() * sizeof(uint16_t));
+	return writeFileAtomically(fileName, data.data(), data.size());
+}
+
+bool WeightFile::exportFile(const std::string & fileName) {
+	SkinWeights weights;
+	if (!read(fileName, weights)) {
+		std::cerr << "Could not read the weights " << fileName << std::endl;
+		return false;
+	}
+	std::string base = fileName;
+	size_t dot = base.find_last_of('.');
+	if (dot != std::string::npos && base.find_first_of("/\\", dot) == std::string::npos) base.resize(dot);
+	bool ok = writeSparse(base + ".sparse.txt", weights) && writeBinary(base + ".skw", weights);
+	std::cout << (ok ? "Wrote " : "Could not write ") << base << ".sparse.txt and " << base << ".skw ("
+	          << weights.nbInfluences() << " weights of " << weights.nbVertices() << " vertices)" << std::endl;
+	return ok;
+}
@@ -0,0 +1,63 @@
+#ifndef _WEIGHTFILE_H_
+#define _WEIGHTFILE_H_
+
+#include "skininfluences.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Skin weights on disk. Three formats, told apart by their first bytes :
+//   dense text  : "id" and the joint names, then "vertex w_0 .. w_n-1" per
+//                 line (animation/weights.txt)
+//   sparse text : "sparse" and the joint names, then "vertex joint weight"
+//                 per line, non-zero weights only ("vertex" alone for a
+//                 vertex without any)
+//   binary      : SkwHeader, joint names, then the sparse table grouped by
+//                 vertex, loaded straight from the mapped file
+// Every vertex has at least a line in the text files. They are cut in
+// chunks at line starts and parsed in parallel with std::from_chars.
+//
+// Binary layout (native endianness) :
+//   SkwHeader
+//   names     : nbJoints zero-terminated strings, padded to 8 bytes
+//   offsets   : nbVertices + 1 x uint32, influences of vertex v are [offsets[v], offsets[v + 1][
+//   weights   : nbInfluences x float
+//   joints    : nbInfluences x uint16
+struct SkwHeader {
+	char magic[4];				// "SKWB"
+	uint32_t version;
+	uint32_t nbJoints;
+	uint32_t nbVertices;
+	uint32_t nbInfluences;
+	uint32_t namesSize;			// bytes, padding included
+};
+
+// Non-zero weights of a file, grouped by vertex
+struct SkinWeights {
+	std::vector<std::string> names;
+	std::vector<uint32_t> offsets;
+	std::vector<float> weights;
+	std::vector<uint16_t> joints;
+
+	int nbJoints() const { return names.size(); }
+	int nbVertices() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+	size_t nbInfluences() const { return weights.size(); }
+};
+
+class WeightFile {
+public :
+	enum Format { Unknown, Dense, Sparse, Binary };
+
+	static Format format(const std::string & fileName);
+	// Influences of a mesh of nbVertices vertices from a file of any format,
+	// for a skeleton of nbJoints joints. False if unreadable or made for
+	// another skeleton or mesh (a row per vertex).
+	static bool load(const std::string & fileName, int nbJoints, int nbVertices, SkinInfluences & skin);
+	static bool read(const std::string & fileName, SkinWeights & weights);
+	static bool writeSparse(const std::string & fileName, const SkinWeights & weights);
+	static bool writeBinary(const std::string & fileName, const SkinWeights & weights);
+	// weights.txt -> weights.sparse.txt and weights.skw
+	static bool exportFile(const std::string & fileName);
+};
+
+#endif
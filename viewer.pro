@@ -2,6 +2,8 @@
 DESTDIR = ../viewer
 # ENDIF
 QT       += core gui opengl 
+# std::from_chars, std::string_view
+CONFIG   += c++1z
 
 TARGET = myViewer
 TEMPLATE = app
@@ -9,6 +11,7 @@ TEMPLATE = app
 macx {
   QMAKE_CXXFLAGS += -Wno-unknown-pragmas
 } else {
+  QMAKE_CXXFLAGS += -fopenmp
   QMAKE_LFLAGS += -Wno-unknown-pragmas -fopenmp 
 }
 
@@ -16,12 +19,54 @@ SOURCES +=  \
             src/main.cpp \
             src/openglwindow.cpp \
             src/joint.cpp \
+            src/mappedfile.cpp \
+            src/bvhloader.cpp \
+            src/skeleton.cpp \
+            src/animationbake.cpp \
+            src/crowd.cpp \
+            src/skininfluences.cpp \
+            src/skinningengine.cpp \
+            src/vertexcache.cpp \
+            src/weightfile.cpp \
+            src/skinlod.cpp \
+            src/skinbinding.cpp \
+            src/vertexorder.cpp \
+            src/dynamicbuffer.cpp \
+            src/vertexformat.cpp \
+            src/triangleorder.cpp \
+            src/programcache.cpp \
+            src/compressedmotion.cpp \
+            src/framescheduler.cpp \
+            src/bvhcache.cpp \
+            src/benchmark.cpp \
             src/glshaderwindow.cpp
 
 HEADERS  += \
             src/openglwindow.h \
             src/glshaderwindow.h \
             src/joint.h \
+            src/mappedfile.h \
+            src/bvhloader.h \
+            src/skeleton.h \
+            src/eulerkernel.h \
+            src/animationbake.h \
+            src/crowd.h \
+            src/skininfluences.h \
+            src/skinningengine.h \
+            src/vertexcache.h \
+            src/weightfile.h \
+            src/skinlod.h \
+            src/skinbinding.h \
+            src/vertexorder.h \
+            src/dynamicbuffer.h \
+            src/vertexformat.h \
+            src/triangleorder.h \
+            src/programcache.h \
+            src/compressedmotion.h \
+            src/framescheduler.h \
+            src/bvhcache.h \
+            src/fnvhash.h \
+            src/benchmark.h \
     src/perlinNoise.h
 
 # trimesh library for loading objects.